@@ -4,11 +4,14 @@
 #include <omp.h>
 #include <iomanip>
 #include <algorithm>
+#include <filesystem>
+#include <limits>
 
 #include "octree.h"
+#include "build_calibration.h"
 #include "particle_config.hpp"
 
-std::vector<Particle*> createParticles(size_t numParticles)
+std::vector<ParticleConfig::Particle> createUniform(size_t numParticles)
 {
     ParticleConfig::Limits limits;
     limits.boundingBox          = {{ {-500.0, -500.0, -500.0},
@@ -17,7 +20,27 @@ std::vector<Particle*> createParticles(size_t numParticles)
     limits.accelerationLimits   = { 1.0, 10.0 };
     limits.massLimits           = { 40.0, 70.0 };
 
-    auto generated = ParticleConfig::generate(numParticles, limits);
+    return ParticleConfig::generate(numParticles, limits);
+}
+
+// "uniform" or a ParticleConfig model name, models occupy roughly the same volume as the uniform box
+std::vector<Particle*> createParticles(size_t numParticles, const std::string& workload)
+{
+    std::vector<ParticleConfig::Particle> generated;
+
+    if (workload == "uniform")
+    {
+        generated = createUniform(numParticles);
+    }
+    else
+    {
+        ParticleConfig::Model model;
+        model.distribution = ParticleConfig::distributionFromString(workload);
+        model.totalMass = 55.0 * numParticles;
+        model.scaleRadius = 50.0;
+
+        generated = ParticleConfig::generate(numParticles, model, 587);
+    }
 
     std::vector<Particle*> particles;
     for (const auto& particle : generated)
@@ -84,10 +107,27 @@ struct Result
     double partitionNodeMs;
 };
 
-int main()
+int main(int argc, char* argv[])
 {
+    const std::string workload = argc > 1 ? argv[1] : "uniform";
+    const std::string calibrationFile = argc > 2 ? argv[2] : "";
+
+    if (workload != "uniform")
+    {
+        try
+        {
+            ParticleConfig::distributionFromString(workload);
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << e.what() << "\n";
+            std::cerr << "Usage: ./benchmark_octree [uniform|plummer|hernquist|disk|pair|clustered] [calibration file]\n";
+            return 1;
+        }
+    }
+
     int maxThreads = omp_get_max_threads();
-    std::cout << "benchmarking with " << maxThreads << "\n";
+    std::cout << "benchmarking with " << maxThreads << " on " << workload << " particles\n";
 
     static constexpr size_t MAX_POINTS_PER_NODE = 1;
     static constexpr size_t THRESHOLD_FOR_SERIAL = 2;
@@ -134,7 +174,7 @@ int main()
 
         for (size_t size : testSizes)
         {
-            auto particles = createParticles(size);
+            auto particles = createParticles(size, workload);
 
             double serialSum = 0.0;
             double insertParallelSum = 0.0;
@@ -209,5 +249,151 @@ int main()
         }
     }
 
+    // whole trees (bounding box, insert and leaf list) built by the constructor, the lock
+    // free build against the task based one b_hut uses
+    {
+        static constexpr size_t THRESHOLD_FOR_TASKS = 1000;
+
+        const std::vector<std::size_t> testSizes = {
+            1000,
+            10000,
+            100000,
+            1000000
+        };
+
+        const int repetitions = 5;
+
+        std::cout << "\n"
+                  << std::setw(8)  << "Num particles"
+                  << std::setw(16) << "taskBuild(ms)"
+                  << std::setw(20) << "lockFreeBuild(ms)"
+                  << std::setw(10) << "speedup"
+                  << "\n";
+
+        std::cout << std::string(8+16+20+10, '-') << "\n";
+
+        for (size_t size : testSizes)
+        {
+            auto particles = createParticles(size, workload);
+
+            double taskSum = 0.0;
+            double lockFreeSum = 0.0;
+
+            for (int rep = 0; rep < repetitions; ++rep)
+            {
+                // freeing the tree is not timed
+                std::unique_ptr<Octree> tree;
+
+                taskSum += benchmark([&]() {
+                    tree = std::make_unique<Octree>(particles, Octree::BuildStrategy::Task, THRESHOLD_FOR_TASKS, MAX_POINTS_PER_NODE);
+                });
+                tree.reset();
+
+                lockFreeSum += benchmark([&]() {
+                    tree = std::make_unique<Octree>(particles, Octree::BuildStrategy::LockFree, THRESHOLD_FOR_TASKS, MAX_POINTS_PER_NODE);
+                });
+                tree.reset();
+            }
+
+            double taskAvg = taskSum / repetitions;
+            double lockFreeAvg = lockFreeSum / repetitions;
+
+            std::cout << std::setw(8)  << size
+                      << std::setw(16) << std::fixed << std::setprecision(3) << taskAvg
+                      << std::setw(20) << std::fixed << std::setprecision(3) << lockFreeAvg
+                      << std::setw(10) << std::fixed << std::setprecision(2) << taskAvg / lockFreeAvg
+                      << "\n";
+
+            deleteParticles(particles);
+        }
+    }
+
+    // whole builds of BuildStrategy::Auto over a grid of thresholds, the fastest pair is
+    // this thread count's row of the calibration b_hut -build auto reads, the one level
+    // table above favours serial inserts too long since it leaves out the levels below
+    {
+        static constexpr size_t NEVER = std::numeric_limits<size_t>::max();
+        static constexpr size_t NUM_PARTICLES = 1000000;
+
+        const std::vector<size_t> insertThresholds = { 100, 1000, 10000 };
+        const std::vector<size_t> taskThresholds = { 10000, 50000, 200000, NEVER };
+
+        const int repetitions = 3;
+
+        auto& calibration = BuildCalibration::getInstance();
+        auto particles = createParticles(NUM_PARTICLES, workload);
+
+        std::cout << "\n"
+                  << std::setw(16) << "insert threshold"
+                  << std::setw(16) << "task threshold"
+                  << std::setw(16) << "build(ms)"
+                  << "\n";
+
+        std::cout << std::string(16+16+16, '-') << "\n";
+
+        BuildCalibration::Row best;
+        double bestMs = std::numeric_limits<double>::max();
+
+        for (size_t insertThreshold : insertThresholds)
+        {
+            // partitioning everything above the serial inserts is the first candidate
+            std::vector<size_t> candidates = { insertThreshold };
+            for (size_t taskThreshold : taskThresholds)
+            {
+                if (taskThreshold > insertThreshold) candidates.emplace_back(taskThreshold);
+            }
+
+            for (size_t taskThreshold : candidates)
+            {
+                BuildCalibration::Row row;
+                row.threads = static_cast<size_t>(maxThreads);
+                row.parallelThresholdForInsert = insertThreshold;
+                row.taskThreshold = taskThreshold;
+                calibration.setRow(row);
+
+                double sum = 0.0;
+                for (int rep = 0; rep < repetitions; ++rep)
+                {
+                    std::unique_ptr<Octree> tree;
+
+                    sum += benchmark([&]() {
+                        tree = std::make_unique<Octree>(particles, Octree::BuildStrategy::Auto, insertThreshold, MAX_POINTS_PER_NODE);
+                    });
+                }
+
+                const double avg = sum / repetitions;
+                if (avg < bestMs)
+                {
+                    bestMs = avg;
+                    best = row;
+                }
+
+                std::cout << std::setw(16) << insertThreshold
+                          << std::setw(16) << (taskThreshold == NEVER ? "never" : std::to_string(taskThreshold))
+                          << std::setw(16) << std::fixed << std::setprecision(3) << avg
+                          << "\n";
+            }
+        }
+
+        deleteParticles(particles);
+
+        std::cout << "best: insert threshold " << best.parallelThresholdForInsert << ", task threshold "
+                  << (best.taskThreshold == NEVER ? "never" : std::to_string(best.taskThreshold)) << "\n";
+
+        // keep the rows other thread counts wrote
+        if (!calibrationFile.empty())
+        {
+            if (std::filesystem::exists(calibrationFile))
+            {
+                calibration.load(calibrationFile);
+            }
+
+            calibration.setRow(best);
+            calibration.save(calibrationFile);
+
+            std::cout << "wrote the " << best.threads << " thread row of " << calibrationFile << "\n";
+        }
+    }
+
     return 0;
 }
\ No newline at end of file
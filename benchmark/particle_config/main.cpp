@@ -0,0 +1,126 @@
+#include <iostream>
+#include <chrono>
+#include <omp.h>
+#include <iomanip>
+#include <filesystem>
+
+#include "particle_config.hpp"
+
+// the original ifstream based parser, kept as the baseline
+std::vector<ParticleConfig::Particle> streamParse(const std::string& fileName)
+{
+    std::ifstream file(fileName);
+
+    std::vector<ParticleConfig::Particle> particles;
+
+    if (!file.is_open())
+    {
+        throw std::runtime_error("unable to open: " + fileName);
+    }
+
+    std::string temp;
+    std::getline(file, temp);
+
+    while (file >> temp)
+    {
+        ParticleConfig::Particle particle;
+
+        if (temp != "Particle")
+        {
+            break;
+        }
+
+        char c;
+        file >> temp >> particle.id;
+        file >> temp >> c >> particle.position[0] >> c >> particle.position[1] >> c >> particle.position[2] >> c;
+        file >> temp >> c >> particle.velocity[0] >> c >> particle.velocity[1] >> c >> particle.velocity[2] >> c;
+        file >> temp >> c >> particle.acceleration[0] >> c >> particle.acceleration[1] >> c >> particle.acceleration[2] >> c;
+        file >> temp >> particle.mass;
+
+        particles.push_back(particle);
+    }
+
+    return particles;
+}
+
+template <class F>
+double benchmark(F&& function)
+{
+    auto start = std::chrono::steady_clock::now();
+    function();
+    auto end = std::chrono::steady_clock::now();
+
+    std::chrono::duration<double, std::milli> elapsed = end - start;
+
+    return elapsed.count();
+}
+
+int main()
+{
+    int maxThreads = omp_get_max_threads();
+    std::cout << "benchmarking with " << maxThreads << "\n";
+
+    ParticleConfig::Limits limits;
+    limits.boundingBox          = {{ {-500.0, -500.0, -500.0},
+                                     {500.0, 500.0, 500.0} }};
+    limits.velocityLimits       = { 10.0, 40.0 };
+    limits.accelerationLimits   = { 0.0, 5.0 };
+    limits.massLimits           = { 10.0, 100.0 };
+
+    const std::vector<std::size_t> testSizes = {
+        100000,
+        1000000
+    };
+
+    const int repetitions = 3;
+
+    std::cout << std::setw(10) << "Num particles"
+              << std::setw(14) << "stream(ms)"
+              << std::setw(14) << "mmap(ms)"
+              << std::setw(14) << "binary(ms)"
+              << "\n";
+
+    std::cout << std::string(10+14+14+14, '-') << "\n";
+
+    for (size_t size : testSizes)
+    {
+        std::string textFile = "benchmark_particles_" + std::to_string(size) + ".txt";
+        std::string binaryFile = "benchmark_particles_" + std::to_string(size) + ".bin";
+
+        auto particles = ParticleConfig::generate(size, limits);
+        ParticleConfig::write(particles, textFile, ParticleConfig::Format::Text);
+        ParticleConfig::write(particles, binaryFile, ParticleConfig::Format::Binary);
+
+        double streamSum = 0.0;
+        double mmapSum = 0.0;
+        double binarySum = 0.0;
+
+        for (int rep = 0; rep < repetitions; ++rep)
+        {
+            size_t streamCount = 0;
+            size_t mmapCount = 0;
+            size_t binaryCount = 0;
+
+            streamSum += benchmark([&]() { streamCount = streamParse(textFile).size(); });
+            mmapSum   += benchmark([&]() { mmapCount = ParticleConfig::parseText(textFile).size(); });
+            binarySum += benchmark([&]() { binaryCount = ParticleConfig::parseBinary(binaryFile).size(); });
+
+            if (streamCount != size || mmapCount != size || binaryCount != size)
+            {
+                std::cerr << "parsed particle count mismatch for " << size << " particles\n";
+                return 1;
+            }
+        }
+
+        std::cout << std::setw(10) << size
+                  << std::setw(14) << std::fixed << std::setprecision(3) << streamSum / repetitions
+                  << std::setw(14) << std::fixed << std::setprecision(3) << mmapSum / repetitions
+                  << std::setw(14) << std::fixed << std::setprecision(3) << binarySum / repetitions
+                  << "\n";
+
+        std::filesystem::remove(textFile);
+        std::filesystem::remove(binaryFile);
+    }
+
+    return 0;
+}
@@ -0,0 +1,228 @@
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <memory>
+#include <vector>
+
+#include "octree.h"
+#include "particle_config.hpp"
+#include "threading.h"
+
+// times the two parts of a step the threading backend matters most for: the task parallel
+// octree build and the dynamically balanced force walk, run once per build of the
+// backend (-DTHREADING_BACKEND=openmp / native) and compare the tables
+
+static constexpr double THETA = 0.5;
+static constexpr size_t FORCE_CHUNK_SIZE = 16;
+// what b_hut uses (SolverSettings)
+static constexpr size_t INSERT_THRESHOLD = 1000;
+
+std::vector<Particle*> createParticles(size_t numParticles, const std::string& workload)
+{
+    std::vector<ParticleConfig::Particle> generated;
+
+    if (workload == "uniform")
+    {
+        ParticleConfig::Limits limits;
+        limits.boundingBox          = {{ {-500.0, -500.0, -500.0},
+                                         {500.0, 500.0, 500.0} }};
+        limits.velocityLimits       = { 10.0, 20.0 };
+        limits.accelerationLimits   = { 1.0, 10.0 };
+        limits.massLimits           = { 40.0, 70.0 };
+
+        generated = ParticleConfig::generate(numParticles, limits);
+    }
+    else
+    {
+        ParticleConfig::Model model;
+        model.distribution = ParticleConfig::distributionFromString(workload);
+        model.totalMass = 55.0 * numParticles;
+        model.scaleRadius = 50.0;
+
+        generated = ParticleConfig::generate(numParticles, model, 587);
+    }
+
+    std::vector<Particle*> particles;
+    for (const auto& particle : generated)
+    {
+        particles.emplace_back(new Particle(particle));
+    }
+
+    return particles;
+}
+
+// serial, only so the walk has something to open
+void computeCenterOfMass(Octree::Node* node)
+{
+    std::array<double, 3> weighted{0.0, 0.0, 0.0};
+    double mass = 0.0;
+
+    if (node->isLeafNode())
+    {
+        for (auto* point : node->points)
+        {
+            for (size_t axis = 0; axis < 3; ++axis) weighted[axis] += point->mPosition[axis] * point->mMass;
+            mass += point->mMass;
+        }
+    }
+    else
+    {
+        for (auto* octant : node->octants)
+        {
+            if (octant == nullptr) continue;
+
+            computeCenterOfMass(octant);
+            for (size_t axis = 0; axis < 3; ++axis) weighted[axis] += octant->com[axis] * octant->totalMass;
+            mass += octant->totalMass;
+        }
+    }
+
+    for (size_t axis = 0; axis < 3; ++axis) node->com[axis] = mass > 0.0 ? weighted[axis] / mass : 0.0;
+    node->totalMass = mass;
+}
+
+// the opening criterion and interactions of BarnesHut::calculateForce
+void walk(Particle*& particle, Octree::Node* node)
+{
+    const double s = node->boundingBox.halfOfSideLength * 2.0;
+    const double dx = particle->mPosition[0] - node->com[0];
+    const double dy = particle->mPosition[1] - node->com[1];
+    const double dz = particle->mPosition[2] - node->com[2];
+    const bool far = s / std::sqrt(dx * dx + dy * dy + dz * dz) < THETA;
+
+    if (!node->boundingBox.isPointInBox(particle) && far)
+    {
+        if (node->isLeafNode())
+        {
+            for (auto& point : node->points) particle->applyForce(point);
+        }
+        else
+        {
+            particle->applyForce(node->com, node->totalMass);
+        }
+        return;
+    }
+
+    bool isLeaf = true;
+    for (auto* octant : node->octants)
+    {
+        if (octant)
+        {
+            isLeaf = false;
+            walk(particle, octant);
+        }
+    }
+
+    if (isLeaf)
+    {
+        for (auto& point : node->points)
+        {
+            if (point->mId != particle->mId) particle->applyForce(point);
+        }
+    }
+}
+
+template <class F>
+double benchmark(F&& function)
+{
+    auto start = std::chrono::steady_clock::now();
+    function();
+    auto end = std::chrono::steady_clock::now();
+
+    std::chrono::duration<double, std::milli> elapsed = end - start;
+
+    return elapsed.count();
+}
+
+int main(int argc, char* argv[])
+{
+    const std::string workload = argc > 1 ? argv[1] : "uniform";
+
+    if (workload != "uniform")
+    {
+        try
+        {
+            ParticleConfig::distributionFromString(workload);
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << e.what() << "\n";
+            std::cerr << "Usage: ./benchmark_threading [uniform|plummer|hernquist|disk|pair|clustered]\n";
+            return 1;
+        }
+    }
+
+    std::cout << "benchmarking the " << Threading::backendName() << " backend with " << Threading::numThreads()
+              << " threads on " << workload << " particles\n";
+
+    const std::vector<size_t> testSizes = { 1000, 10000, 100000, 1000000 };
+    const int repetitions = 5;
+
+    std::cout << std::setw(14) << "Num particles"
+              << std::setw(14) << "build(ms)"
+              << std::setw(14) << "force(ms)"
+              << std::setw(20) << "force/particle(us)"
+              << "\n";
+
+    std::cout << std::string(14+14+14+20, '-') << "\n";
+
+    for (size_t size : testSizes)
+    {
+        auto particles = createParticles(size, workload);
+
+        double buildSum = 0.0;
+        double forceSum = 0.0;
+
+        // one untimed round to start the threads and fault in the allocator's arenas
+        for (int rep = -1; rep < repetitions; ++rep)
+        {
+            std::unique_ptr<Octree> tree;
+
+            double build = benchmark([&]() {
+                tree = std::make_unique<Octree>(particles, true, INSERT_THRESHOLD);
+            });
+
+            computeCenterOfMass(tree->getRootNode());
+
+            auto& leafs = tree->getLeafNodes();
+            const size_t numChunks = (leafs.size() + FORCE_CHUNK_SIZE - 1) / FORCE_CHUNK_SIZE;
+
+            double force = benchmark([&]() {
+                Threading::parallelFor(0, numChunks, 1, [&](size_t first, size_t last)
+                {
+                    for (size_t i = first * FORCE_CHUNK_SIZE; i < std::min(leafs.size(), last * FORCE_CHUNK_SIZE); ++i)
+                    {
+                        for (auto& particle : leafs[i]->points)
+                        {
+                            walk(particle, tree->getRootNode());
+                        }
+                    }
+                });
+            });
+
+            if (rep >= 0)
+            {
+                buildSum += build;
+                forceSum += force;
+            }
+        }
+
+        const double buildAvg = buildSum / repetitions;
+        const double forceAvg = forceSum / repetitions;
+
+        std::cout << std::setw(14) << size
+                  << std::setw(14) << std::fixed << std::setprecision(3) << buildAvg
+                  << std::setw(14) << std::fixed << std::setprecision(3) << forceAvg
+                  << std::setw(20) << std::fixed << std::setprecision(3) << forceAvg * 1e3 / static_cast<double>(size)
+                  << "\n";
+
+        for (auto*& particle : particles)
+        {
+            delete particle;
+        }
+    }
+
+    return 0;
+}
@@ -10,7 +10,7 @@ if [ -d install ]; then
     rm -rf install
 fi
 
-cmake -DCMAKE_BUILD_TYPE=Release -DCMAKE_INSTALL_PREFIX=install -DALEMBIC_SHARED_LIBS=OFF -DENABLE_TESTING=OFF -DUSE_TESTS=OFF -DPERF_PROFILING=OFF -B build
+cmake -DCMAKE_BUILD_TYPE=Release -DCMAKE_INSTALL_PREFIX=install -DALEMBIC_SHARED_LIBS=OFF -DENABLE_TESTING=OFF -DUSE_TESTS=OFF -DPERF_PROFILING=OFF -DTIME_PROFILING=ON -B build
 
 cmake --build build
 
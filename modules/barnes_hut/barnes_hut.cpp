@@ -1,69 +1,59 @@
 #include "barnes_hut.h"
+#include "checkpoint.h"
+#include "profiler.h"
+#include "threading.h"
+#include "topology.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cmath>
 #include <cassert>
 #include <chrono>
+#include <csignal>
+#include <fstream>
+#include <iostream>
 
 #include <omp.h>
 
 namespace
 {
-
-class ScopedTimer
-{
-public:
-    ScopedTimer(double& out)
-        : mStart(std::chrono::steady_clock::now())
-        , mOut(out)
-    {}
-
-    void recordElapsedMs()
-    {
-        auto end = std::chrono::steady_clock::now();
-
-        std::chrono::duration<double, std::milli> elapsed_ms = end - mStart;
-
-        mOut = elapsed_ms.count();
-    }
-
-    ~ScopedTimer() = default;
-
-private:
-    ScopedTimer() = default;
-
-    std::chrono::steady_clock::time_point mStart;
-    double& mOut;
-};
-
-
-#define COMBINE(a, b) a##b
-#define PROFILE(sectionId, functionCall) \
-    double COMBINE(elapsed_, sectionId) = 0.0; \
-    ScopedTimer COMBINE(timer_, sectionId)(COMBINE(elapsed_, sectionId)); \
-    functionCall; \
-    COMBINE(timer_, sectionId).recordElapsedMs(); \
-    if (mProfile) \
-    { \
-        mDataStore.addProfileData(sectionId, COMBINE(elapsed_, sectionId)); \
-    } 
+    // roofline cost model of the force walk, every visited node pays for the isPointInBox
+    // subtractions and isSufficientlyFar (mul, 3 sub, 3 mul + 2 add, sqrt, div), both
+    // interaction kinds are an applyForce
+    constexpr double NODE_VISIT_FLOPS = 14.0;
+
+    // bytes are what the walk touches assuming nothing is reused from cache, so the
+    // arithmetic intensity is a lower bound: a visited node is read whole (its com and
+    // mass are what a particle cell interaction uses), a particle particle interaction
+    // reads the pointer, position and mass of the other particle
+    constexpr double NODE_VISIT_BYTES = sizeof(Octree::Node);
+    constexpr double PARTICLE_PARTICLE_BYTES = sizeof(Particle*) + sizeof(Particle::mPosition) + sizeof(Particle::mMass);
 }
 
-BarnesHut::BarnesHut(std::vector<Particle*>& particles, double dt, 
-                     double simulationLength, std::string& simulationName, bool profile)
+BarnesHut::BarnesHut(std::vector<Particle*>& particles, SolverSettings& settings,
+                     std::string& simulationName, bool profile, size_t startIteration)
     : mParticles(particles)
-    , mDt(dt)
-    , mSimulationLength(simulationLength)
+    , mSettings(settings)
+    , mDt(settings.dt)
+    , mSimulationLength(settings.simulationLength)
     , mSimulationName(simulationName)
     , mProfile(profile)
-    , mNumIterations(simulationLength / dt)
-    , mDataStore(particles.size(), dt, mNumIterations)
+    , mNumIterations(settings.simulationLength / settings.dt)
+    , mStartIteration(std::min(startIteration, mNumIterations))
+    , mDataStore(particles.size(), settings.dt, mNumIterations, mStartIteration)
 {
-    #pragma omp parallel for schedule(dynamic)
-    for (size_t i = 0; i < particles.size(); ++i)
+    auto& profiler = Profiler::getInstance();
+    profiler.setEnabled(mProfile);
+    profiler.setName(mSimulationName);
+
+    Threading::parallelFor(0, particles.size(), Threading::evenGrain(particles.size()), [&](size_t first, size_t last)
     {
-        mDataStore.addMass(particles[i]->mId, particles[i]->mMass);
-        mDataStore.addPosition(0, particles[i]->mId, particles[i]->mPosition);
-    }
+        for (size_t i = first; i < last; ++i)
+        {
+            mDataStore.addMass(particles[i]->mId, particles[i]->mMass);
+            mDataStore.addPosition(mStartIteration, particles[i]->mId, particles[i]->mPosition);
+        }
+    });
 #ifdef PERF_PROFILE
     auto& instance = PerfProfiler::getInstance();
     instance.setProfilerName(mSimulationName);
@@ -80,144 +70,370 @@ BarnesHut::BarnesHut(std::vector<Particle*>& particles, double dt,
 
 void BarnesHut::simulate()
 {
-    for (size_t i = 0; i < mNumIterations; ++i)
+    std::ofstream statsFile;
+    if (mCollectStats)
+    {
+        std::string statsFilename = mSimulationName + ".stats.csv";
+        statsFile.open(statsFilename);
+
+        if (!statsFile.is_open())
+        {
+            throw std::runtime_error("unable to open file to store simulation stats: " + statsFilename);
+        }
+
+        statsFile << "iteration,nodes,leaves,max_depth,mean_depth,tree_bytes";
+        for (size_t bin = 0; bin < Octree::TreeStats::OCCUPANCY_BINS; ++bin)
+        {
+            statsFile << ",leaf_occupancy_" << bin << (bin + 1 == Octree::TreeStats::OCCUPANCY_BINS ? "_plus" : "");
+        }
+        statsFile << ",particle_particle_mean,particle_particle_p99,particle_cell_mean,particle_cell_p99"
+                  << ",interactions_mean,interactions_p99,nodes_opened_mean,nodes_opened_p99\n";
+    }
+
+    std::ofstream rooflineFile;
+    if (mRoofline)
+    {
+        std::string rooflineFilename = mSimulationName + ".roofline.csv";
+        rooflineFile.open(rooflineFilename);
+
+        if (!rooflineFile.is_open())
+        {
+            throw std::runtime_error("unable to open file to store roofline data: " + rooflineFilename);
+        }
+
+        mMachine = Roofline::detect();
+        std::cout << "roofline machine: " << Roofline::describe(mMachine) << std::endl;
+
+        rooflineFile << "iteration,force_ms,gflop,gbyte,gflop_per_s,arithmetic_intensity,attainable_gflop_per_s"
+                     << ",peak_gflop_per_s,scalar_peak_gflop_per_s,bandwidth_gb_per_s\n";
+    }
+
+    // both need the interaction counts of every particle
+    if (mCollectStats || mRoofline)
+    {
+        mInteractions.assign(mParticles.size(), InteractionCounts{});
+    }
+
+    size_t completedIterations = mPersistent ? runPersistent(statsFile, rooflineFile) : run(statsFile, rooflineFile);
+
+    std::string filename = mSimulationName + ".abc";
     {
+        PROFILE_REGION("write simulation file");
+        mDataStore.writeToBinaryFile(filename, completedIterations);
+    }
+
+    if (mProfile && completedIterations > mStartIteration)
+    {
+        auto& profiler = Profiler::getInstance();
+        profiler.writeText(mSimulationName + ".txt");
+        profiler.writeJson(mSimulationName + ".profile.json");
+        profiler.writeCsv(mSimulationName + ".profile.csv");
+        profiler.writeBalanceCsv(mSimulationName + ".balance.csv");
+    }
+
+    if (Tracer::isEnabled())
+    {
+        filename = mSimulationName + ".trace.json";
+        size_t dropped = Tracer::getInstance().write(filename);
+
+        std::cout << "trace written to " << filename;
+        if (dropped > 0)
+        {
+            std::cout << " (" << dropped << " oldest events were overwritten, increase the -trace buffer to keep them)";
+        }
+        std::cout << std::endl;
+    }
+}
+
+size_t BarnesHut::run(std::ofstream& statsFile, std::ofstream& rooflineFile)
+{
+    const bool countInteractions = mCollectStats || mRoofline;
+    size_t completedIterations = mStartIteration;
+
+    for (size_t i = mStartIteration; i < mNumIterations; ++i)
+    {
+        Profiler::getInstance().beginIteration(i);
+
+        // the tree is used for the rest of the iteration, only its construction is timed
+        ProfileRegion octreeRegion("octree creation");
 #ifdef PERF_PROFILE
-        PROFILE(0, Octree tree(mParticles, mPerfBbox, mPerfInsert, mPerfLeaf, true, 1000, 1));
+        Octree tree(mParticles, mPerfBbox, mPerfInsert, mPerfLeaf, mBuildStrategy,
+                    mSettings.parallelThresholdForInsert, mSettings.maxPointsPerNode);
 #else
-        PROFILE(0, Octree tree(mParticles, true, 1000, 1));
+        Octree tree(mParticles, mBuildStrategy, mSettings.parallelThresholdForInsert, mSettings.maxPointsPerNode);
 #endif
-        if (mProfile)
-        {
-            auto& profileData = tree.getProfileData();
-            mDataStore.addProfileData(4, profileData[0]);
-            mDataStore.addProfileData(5, profileData[1]);
-            mDataStore.addProfileData(6, profileData[2]);
-        }
+        octreeRegion.stop();
 
         // calculate center of mass
+        {
+            PROFILE_REGION("center of mass calculation");
 #ifdef PERF_PROFILE
-        mPerfMass->start();
+            mPerfMass->start();
 #endif
-        PROFILE(1, calculateCenterOfMass(tree.getLeafNodes()));
+            calculateCenterOfMass(tree.getLeafNodes());
 #ifdef PERF_PROFILE
-        mPerfMass->stop();
+            mPerfMass->stop();
 #endif
+        }
+
+        if (mReplicatedLevels > 0)
+        {
+            PROFILE_REGION("replicate top levels");
+            replicateTopLevels(tree.getRootNode());
+        }
+
         // apply forces
+        double forceMs = 0.0;
+        {
+            PROFILE_REGION("applying forces calculation");
 #ifdef PERF_PROFILE
-        mPerfForce->start();
+            mPerfForce->start();
 #endif
-        PROFILE(2, calculateForce(tree.getLeafNodes(), tree.getRootNode()));
+            auto forceStart = std::chrono::steady_clock::now();
+
+            if (countInteractions)
+            {
+                calculateForce<true>(tree.getLeafNodes(), tree.getRootNode());
+            }
+            else
+            {
+                calculateForce<false>(tree.getLeafNodes(), tree.getRootNode());
+            }
 #ifdef PERF_PROFILE
-        mPerfForce->stop();
+            mPerfForce->stop();
 #endif
+            forceMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - forceStart).count();
+        }
+
+        // the replicas point into the tree
+        mReplicaRoots.clear();
+
+        // outside of any profiled region so the timings are not affected
+        if (mCollectStats)
+        {
+            writeStats(statsFile, i, tree.computeTreeStats());
+        }
+
+        if (mRoofline)
+        {
+            writeRoofline(rooflineFile, i, forceMs);
+        }
 
         // update pos/vel/acc
-        PROFILE(3, updateState(i));
-    }
+        {
+            PROFILE_REGION("update pos/vel/acc");
+            updateState(i);
+        }
 
-    std::string filename = mSimulationName + ".abc";
-    mDataStore.writeToBinaryFile(filename);
+        Profiler::getInstance().endIteration();
 
-    if (mProfile)
-    {
-        filename = mSimulationName + ".txt";
-        mDataStore.writeProfileData(filename);
+        completedIterations = i + 1;
+
+        if (finishIteration(completedIterations))
+        {
+            break;
+        }
     }
+
+
+    return completedIterations;
 }
 
-void BarnesHut::calculateCenterOfMass(std::vector<Octree::Node*>& leafs)
+BarnesHut::StepTimes BarnesHut::measureStep()
 {
-    std::vector<Octree::Node*> workingSet;
-    workingSet.insert(workingSet.end(), leafs.begin(), leafs.end());
+    StepTimes times;
 
-    auto numThreads = omp_get_max_threads();
-    std::vector<std::vector<Octree::Node*>> localNextSet(numThreads);
+    auto start = std::chrono::steady_clock::now();
+#ifdef PERF_PROFILE
+    Octree tree(mParticles, mPerfBbox, mPerfInsert, mPerfLeaf, mBuildStrategy,
+                mSettings.parallelThresholdForInsert, mSettings.maxPointsPerNode);
+#else
+    Octree tree(mParticles, mBuildStrategy, mSettings.parallelThresholdForInsert, mSettings.maxPointsPerNode);
+#endif
+    auto built = std::chrono::steady_clock::now();
 
-    while (!workingSet.empty())
+    calculateCenterOfMass(tree.getLeafNodes());
+    auto centered = std::chrono::steady_clock::now();
+
+    calculateForce<false>(tree.getLeafNodes(), tree.getRootNode());
+    auto end = std::chrono::steady_clock::now();
+
+    times.buildMs = std::chrono::duration<double, std::milli>(built - start).count();
+    times.centerOfMassMs = std::chrono::duration<double, std::milli>(centered - built).count();
+    times.forceMs = std::chrono::duration<double, std::milli>(end - centered).count();
+
+    return times;
+}
+
+size_t BarnesHut::runPersistent(std::ofstream& statsFile, std::ofstream& rooflineFile)
+{
+    const bool countInteractions = mCollectStats || mRoofline;
+    size_t completedIterations = mStartIteration;
+
+    if (mParticles.empty())
+    {
+        throw std::runtime_error("trying to init octree with 0 points");
+    }
+
+    // shared by the team, only written by the master between two barriers
+    std::unique_ptr<Octree> tree;
+    std::exception_ptr error = nullptr;
+    bool stop = false;
+    double forceMs = 0.0;
+
+    mNextSets.assign(2 * omp_get_max_threads(), {});
+
+    // every thread runs every statement below, master constructs are the driving thread's
+    // bookkeeping and the phases split their work with orphaned worksharing constructs
+    #pragma omp parallel
     {
-        #pragma omp parallel for schedule(static)
-        for (size_t i = 0; i < workingSet.size(); ++i)
+        for (size_t i = mStartIteration; i < mNumIterations; ++i)
         {
-            auto tid = omp_get_thread_num();
-            
-            // calculate center of mass for current node
-            double x = 0;
-            double y = 0;
-            double z = 0;
-            double totalMass = 0;
-            bool ready = true;
-            for (const auto& particle : workingSet[i]->points)
+            #pragma omp master
             {
-                if (particle->mMass == 0.0)
-                {
-                    ready = false;
-                    break;
-                }
+                Profiler::getInstance().beginIteration(i);
+                tree = std::make_unique<Octree>(Octree::Deferred{}, mParticles,
+                                                mSettings.parallelThresholdForInsert, mSettings.maxPointsPerNode);
+            }
 
-                const std::array<double, 3>& pos = particle->mPosition;
+            #pragma omp barrier
 
-                x += pos[0] * particle->mMass;
-                y += pos[1] * particle->mMass;
-                z += pos[2] * particle->mMass;
-                totalMass += particle->mMass;
+            {
+                PROFILE_REGION("octree creation");
+                tree->buildInTeam(mParticles);
             }
 
-            if (!ready)
             {
-                // place it back in worker queue to be processed later
-                localNextSet[tid].emplace_back(workingSet[i]);
-                continue;
+                PROFILE_REGION("center of mass calculation");
+                calculateCenterOfMassInTeam(tree->getLeafNodes());
             }
 
-            x = x / totalMass;
-            y = y / totalMass;
-            z = z / totalMass;
+            {
+                PROFILE_REGION("applying forces calculation");
+                auto forceStart = std::chrono::steady_clock::now();
+
+                if (countInteractions)
+                {
+                    calculateForceInTeam<true>(tree->getLeafNodes(), tree->getRootNode());
+                }
+                else
+                {
+                    calculateForceInTeam<false>(tree->getLeafNodes(), tree->getRootNode());
+                }
+
+                #pragma omp master
+                forceMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - forceStart).count();
+            }
 
-            // interior nodes have a single point representing the center of mass (do NOT clear actual particles)
-            if (!workingSet[i]->isLeafNode())
             {
-                //workingSet[i]->points.clear();
-                workingSet[i]->com[0] = x;
-                workingSet[i]->com[1] = y;
-                workingSet[i]->com[2] = z;
-                workingSet[i]->totalMass = totalMass;
-                //workingSet[i]->points.emplace_back(particle);
+                PROFILE_REGION("update pos/vel/acc");
+                updateStateInTeam(i);
             }
 
-            if (workingSet[i]->parentNode)
+            #pragma omp master
             {
-                size_t myOctantId = Octree::toOctantId(workingSet[i]->points[0], workingSet[i]->parentNode->boundingBox);
+                Profiler::getInstance().endIteration();
 
-                // have to place this node in the parent node's points vector
-                // I have to find out which index this octant maps to to place
-                int flattenedIndex = -1;
-                for (size_t j = 0; j < 8; ++j)
+                // after the barrier of the update so the stats do not run next to the team,
+                // outside of the iteration so the timings are not affected
+                if (mCollectStats)
                 {
-                    if (workingSet[i]->parentNode->octants[j])
-                    {
-                        ++flattenedIndex;
-                        if (j == myOctantId)
-                        {
-                            break;
-                        }
-                    }
+                    writeStats(statsFile, i, tree->computeTreeStats());
                 }
 
-                // these locations have been preallocated in the octree
-                auto& pos = workingSet[i]->parentNode->points[flattenedIndex]->mPosition; 
-                pos[0] = x;
-                pos[1] = y;
-                pos[2] = z;
-                workingSet[i]->parentNode->points[flattenedIndex]->mMass = totalMass;
- 
-                // smallest flattened index is always responsible for emplacing into local sets (avoid duplicates)
-                if (flattenedIndex == 0)
+                if (mRoofline)
+                {
+                    writeRoofline(rooflineFile, i, forceMs);
+                }
+
+                completedIterations = i + 1;
+                tree.reset();
+
+                try
                 {
-                    localNextSet[tid].emplace_back(workingSet[i]->parentNode);
+                    stop = finishIteration(completedIterations);
+                }
+                catch (...)
+                {
+                    error = std::current_exception();
+                    stop = true;
                 }
             }
+
+            // nobody reads stop again before the master writes it in the next iteration
+            #pragma omp barrier
+
+            if (stop) break;
         }
+    }
+
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+
+    return completedIterations;
+}
+
+bool BarnesHut::finishIteration(size_t completedIterations)
+{
+    // particle state is consistent here so this is the only place a checkpoint can be taken
+    int signal = Checkpoint::takePendingSignal();
+    bool periodic = mCheckpointInterval > 0 && completedIterations % mCheckpointInterval == 0;
+
+    if (signal != 0 || periodic)
+    {
+        writeCheckpoint(completedIterations);
+    }
+
+    if (signal == SIGTERM)
+    {
+        std::cout << "received SIGTERM, stopping after iteration " << completedIterations << std::endl;
+        return true;
+    }
+
+    return false;
+}
+
+void BarnesHut::writeCheckpoint(size_t iteration)
+{
+    Checkpoint::State state;
+    state.settings = mSettings;
+    state.iteration = iteration;
+
+    std::string filename = mSimulationName + ".ckpt";
+
+    auto start = std::chrono::steady_clock::now();
+    Checkpoint::write(filename, mParticles, state);
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::cout << "checkpoint of iteration " << iteration << " written to " << filename
+              << " in " << elapsed.count() << " ms" << std::endl;
+}
+
+void BarnesHut::calculateCenterOfMass(std::vector<Octree::Node*>& leafs)
+{
+    std::vector<Octree::Node*> workingSet;
+    workingSet.insert(workingSet.end(), leafs.begin(), leafs.end());
+
+    auto numThreads = Threading::numThreads();
+    std::vector<std::vector<Octree::Node*>> localNextSet(numThreads);
+
+    while (!workingSet.empty())
+    {
+        ParallelLoop loop("center of mass calculation");
+
+        Threading::parallelFor(0, workingSet.size(), Threading::evenGrain(workingSet.size()), [&](size_t first, size_t last)
+        {
+            ThreadBusy busy(loop);
+
+            auto& nextSet = localNextSet[Threading::threadId()];
+
+            for (size_t i = first; i < last; ++i)
+            {
+                calculateCenterOfMass(workingSet[i], nextSet);
+            }
+        });
 
         workingSet.clear();
         for (auto& nextSet : localNextSet)
@@ -228,20 +444,248 @@ void BarnesHut::calculateCenterOfMass(std::vector<Octree::Node*>& leafs)
     }
 }
 
+void BarnesHut::calculateCenterOfMass(Octree::Node* node, std::vector<Octree::Node*>& nextSet)
+{
+    // calculate center of mass for current node
+    double x = 0;
+    double y = 0;
+    double z = 0;
+    double totalMass = 0;
+    bool ready = true;
+    for (const auto& particle : node->points)
+    {
+        if (particle->mMass == 0.0)
+        {
+            ready = false;
+            break;
+        }
+
+        const std::array<double, 3>& pos = particle->mPosition;
+
+        x += pos[0] * particle->mMass;
+        y += pos[1] * particle->mMass;
+        z += pos[2] * particle->mMass;
+        totalMass += particle->mMass;
+    }
+
+    if (!ready)
+    {
+        // place it back in worker queue to be processed later
+        nextSet.emplace_back(node);
+        return;
+    }
+
+    x = x / totalMass;
+    y = y / totalMass;
+    z = z / totalMass;
+
+    // interior nodes have a single point representing the center of mass (do NOT clear actual particles)
+    if (!node->isLeafNode())
+    {
+        //node->points.clear();
+        node->com[0] = x;
+        node->com[1] = y;
+        node->com[2] = z;
+        node->totalMass = totalMass;
+        //node->points.emplace_back(particle);
+    }
+
+    if (node->parentNode)
+    {
+        size_t myOctantId = Octree::toOctantId(node->points[0], node->parentNode->boundingBox);
+
+        // have to place this node in the parent node's points vector
+        // I have to find out which index this octant maps to to place
+        int flattenedIndex = -1;
+        for (size_t j = 0; j < 8; ++j)
+        {
+            if (node->parentNode->octants[j])
+            {
+                ++flattenedIndex;
+                if (j == myOctantId)
+                {
+                    break;
+                }
+            }
+        }
+
+        // these locations have been preallocated in the octree
+        auto& pos = node->parentNode->points[flattenedIndex]->mPosition; 
+        pos[0] = x;
+        pos[1] = y;
+        pos[2] = z;
+        node->parentNode->points[flattenedIndex]->mMass = totalMass;
+ 
+        // smallest flattened index is always responsible for emplacing into local sets (avoid duplicates)
+        if (flattenedIndex == 0)
+        {
+            nextSet.emplace_back(node->parentNode);
+        }
+    }
+}
+
+void BarnesHut::calculateCenterOfMassInTeam(std::vector<Octree::Node*>& leafs)
+{
+    const size_t tid = omp_get_thread_num();
+    const size_t numThreads = omp_get_num_threads();
+
+    // the first level is the leafs, every later level is what the threads queued in the
+    // level before (in thread order), the queues are double buffered so a queue is only
+    // cleared once every thread is done reading it and one barrier per level is enough
+    std::vector<size_t> offsets(numThreads + 1, 0);
+    size_t parity = 0;
+
+    for (bool first = true; ; first = false)
+    {
+        std::vector<Octree::Node*>* current = &mNextSets[parity * numThreads];
+        std::vector<Octree::Node*>& next = mNextSets[(1 - parity) * numThreads + tid];
+        next.clear();
+
+        for (size_t t = 0; t < numThreads; ++t)
+        {
+            offsets[t + 1] = offsets[t] + (first ? 0 : current[t].size());
+        }
+
+        const size_t levelSize = first ? leafs.size() : offsets[numThreads];
+        if (levelSize == 0) break;
+
+        {
+            TRACE_SCOPE("center of mass calculation");
+
+            #pragma omp for schedule(static) nowait
+            for (size_t i = 0; i < levelSize; ++i)
+            {
+                if (first)
+                {
+                    calculateCenterOfMass(leafs[i], next);
+                }
+                else
+                {
+                    size_t t = std::upper_bound(offsets.begin(), offsets.end(), i) - offsets.begin() - 1;
+                    calculateCenterOfMass(current[t][i - offsets[t]], next);
+                }
+            }
+        }
+
+        #pragma omp barrier
+
+        parity = 1 - parity;
+    }
+}
+
+void BarnesHut::replicateTopLevels(Octree::Node* root)
+{
+    auto& topology = Topology::getInstance();
+    const size_t numNodes = topology.numNodes();
+
+    mReplicas.resize(numNodes);
+
+    // nodes without a thread walk the original
+    mReplicaRoots.assign(numNodes, root);
+
+    // the first thread found on a node copies for the node, the copy is first touched there
+    std::vector<std::atomic<bool>> claimed(numNodes);
+    Threading::onEveryThread([&](size_t)
+    {
+        const size_t node = topology.currentNode();
+        if (claimed[node].exchange(true)) return;
+
+        mReplicas[node].clear();
+        mReplicaRoots[node] = replicate(root, mReplicatedLevels - 1, mReplicas[node]);
+    });
+}
+
+Octree::Node* BarnesHut::replicate(Octree::Node* node, size_t levels, std::deque<Octree::Node>& replica)
+{
+    // parents stay the originals, the walk never goes up
+    Octree::Node& copy = replica.emplace_back(*node);
+
+    if (levels > 0)
+    {
+        for (auto& octant : copy.octants)
+        {
+            if (octant) octant = replicate(octant, levels - 1, replica);
+        }
+    }
+
+    return &copy;
+}
+
+size_t BarnesHut::forceChunkSize(size_t numLeafs) const
+{
+    return mForceChunkSize == 0 ? Threading::evenGrain(numLeafs) : mForceChunkSize;
+}
+
+template <bool CollectStats>
 void BarnesHut::calculateForce(std::vector<Octree::Node*>& leafs, Octree::Node*& root)
 {
-    #pragma omp parallel for schedule(dynamic)
-    for (size_t i = 0; i < leafs.size(); ++i)
+    // leafs are handed out in explicit chunks so each chunk shows up in the trace,
+    // neighbouring leafs (morton order) walk mostly the same part of the tree
+    const size_t chunkSize = forceChunkSize(leafs.size());
+    const size_t numChunks = (leafs.size() + chunkSize - 1) / chunkSize;
+
+    ParallelLoop loop("applying forces calculation");
+
+    Threading::parallelFor(0, numChunks, 1, [&](size_t first, size_t last)
+    {
+        ThreadBusy busy(loop);
+
+        for (size_t chunk = first; chunk < last; ++chunk)
+        {
+            calculateForceChunk<CollectStats>(leafs, root, chunk, chunkSize);
+        }
+    });
+}
+
+template <bool CollectStats>
+void BarnesHut::calculateForceInTeam(std::vector<Octree::Node*>& leafs, Octree::Node*& root)
+{
+    const size_t chunkSize = forceChunkSize(leafs.size());
+    const size_t numChunks = (leafs.size() + chunkSize - 1) / chunkSize;
+
+    // keeps its barrier, the update right after moves the particles the walks read
+    #pragma omp for schedule(dynamic)
+    for (size_t chunk = 0; chunk < numChunks; ++chunk)
+    {
+        TRACE_SCOPE("force chunk");
+        calculateForceChunk<CollectStats>(leafs, root, chunk, chunkSize);
+    }
+}
+
+template <bool CollectStats>
+void BarnesHut::calculateForceChunk(std::vector<Octree::Node*>& leafs, Octree::Node*& root, size_t chunk, size_t chunkSize)
+{
+    // the copy of the top levels on the node this thread runs on, same values as the tree
+    Octree::Node* walkRoot = mReplicaRoots.empty() ? root : mReplicaRoots[Topology::getInstance().currentNode()];
+
+    const size_t end = std::min(leafs.size(), (chunk + 1) * chunkSize);
+    for (size_t i = chunk * chunkSize; i < end; ++i)
     {
         for (size_t j = 0; j < leafs[i]->points.size(); ++j)
         {
-            calculateForce(leafs[i]->points[j], root);
+            Particle*& particle = leafs[i]->points[j];
+
+            if constexpr (CollectStats)
+            {
+                // every particle is in exactly one leaf so each slot has a single writer
+                InteractionCounts& counts = mInteractions[particle->mId];
+                counts = InteractionCounts{};
+                calculateForce<true>(particle, walkRoot, counts);
+            }
+            else
+            {
+                InteractionCounts unused;
+                calculateForce<false>(particle, walkRoot, unused);
+            }
         }
     }
 }
 
-void BarnesHut::calculateForce(Particle*& particle, Octree::Node*& node)
+template <bool CollectStats>
+void BarnesHut::calculateForce(Particle*& particle, Octree::Node*& node, InteractionCounts& counts)
 {
+    if constexpr (CollectStats) ++counts.nodesVisited;
+
     if (!node->boundingBox.isPointInBox(particle) && isSufficientlyFar(particle, node))
     {
         if (node->isLeafNode())
@@ -251,11 +695,15 @@ void BarnesHut::calculateForce(Particle*& particle, Octree::Node*& node)
             {
                 particle->applyForce(point);
             }
+
+            if constexpr (CollectStats) counts.particleParticle += node->points.size();
         }
         else
         {
             // estimate all particles within this octant using computed center of mass
             particle->applyForce(node->com, node->totalMass);
+
+            if constexpr (CollectStats) ++counts.particleCell;
         }
     }
     else
@@ -272,10 +720,15 @@ void BarnesHut::calculateForce(Particle*& particle, Octree::Node*& node)
             if (octant)
             {
                 isLeaf = false;
-                calculateForce(particle, octant);
+                calculateForce<CollectStats>(particle, octant, counts);
             }
         }
 
+        if constexpr (CollectStats)
+        {
+            if (!isLeaf) ++counts.nodesOpened;
+        }
+
         if (isLeaf)
         {
             // calculate forces with all other particles in the leaf node
@@ -286,12 +739,94 @@ void BarnesHut::calculateForce(Particle*& particle, Octree::Node*& node)
                 if (point->mId != particle->mId)
                 {
                     particle->applyForce(point);
+
+                    if constexpr (CollectStats) ++counts.particleParticle;
                 }
             }
         }
     }
 }
 
+void BarnesHut::writeRoofline(std::ostream& out, size_t iteration, double forceMs)
+{
+    // interactions, particle particle interactions, visited nodes
+    using Totals = std::array<uint64_t, 3>;
+
+    const Totals totals = Threading::parallelReduce(size_t(0), mInteractions.size(), Threading::evenGrain(mInteractions.size()), Totals{},
+        [&](size_t first, size_t last)
+        {
+            Totals local{};
+            for (size_t i = first; i < last; ++i)
+            {
+                local[0] += mInteractions[i].particleParticle + mInteractions[i].particleCell;
+                local[1] += mInteractions[i].particleParticle;
+                local[2] += mInteractions[i].nodesVisited;
+            }
+            return local;
+        },
+        [](const Totals& a, const Totals& b) { return Totals{ a[0] + b[0], a[1] + b[1], a[2] + b[2] }; });
+
+    const uint64_t interactions = totals[0];
+    const uint64_t particleParticle = totals[1];
+    const uint64_t nodesVisited = totals[2];
+
+    const double flops = static_cast<double>(interactions) * Particle::APPLY_FORCE_FLOPS
+                       + static_cast<double>(nodesVisited) * NODE_VISIT_FLOPS;
+    const double bytes = static_cast<double>(nodesVisited) * NODE_VISIT_BYTES
+                       + static_cast<double>(particleParticle) * PARTICLE_PARTICLE_BYTES;
+
+    const double gflopPerS = forceMs > 0.0 ? flops / (forceMs * 1e6) : 0.0;
+    const double intensity = bytes > 0.0 ? flops / bytes : 0.0;
+
+    // the kernel is scalar code, its roof is the scalar peak
+    out << iteration << "," << forceMs << "," << flops * 1e-9 << "," << bytes * 1e-9 << "," << gflopPerS
+        << "," << intensity << "," << Roofline::attainable(mMachine, intensity, true)
+        << "," << mMachine.peakGflops << "," << mMachine.scalarPeakGflops << "," << mMachine.bandwidthGBs << "\n";
+}
+
+void BarnesHut::writeStats(std::ostream& out, size_t iteration, const Octree::TreeStats& treeStats)
+{
+    std::vector<uint32_t> values(mInteractions.size());
+
+    // mean and nearest rank p99 over all particles
+    auto summarize = [&](auto field)
+    {
+        const uint64_t sum = Threading::parallelReduce(size_t(0), mInteractions.size(), Threading::evenGrain(mInteractions.size()), uint64_t(0),
+            [&](size_t first, size_t last)
+            {
+                uint64_t local = 0;
+                for (size_t i = first; i < last; ++i)
+                {
+                    values[i] = field(mInteractions[i]);
+                    local += values[i];
+                }
+                return local;
+            },
+            [](uint64_t a, uint64_t b) { return a + b; });
+
+        size_t rank = static_cast<size_t>(std::ceil(0.99 * static_cast<double>(values.size())));
+        auto p99 = values.begin() + (std::max<size_t>(rank, 1) - 1);
+        std::nth_element(values.begin(), p99, values.end());
+
+        out << "," << static_cast<double>(sum) / static_cast<double>(values.size()) << "," << *p99;
+    };
+
+    out << iteration << "," << treeStats.nodes << "," << treeStats.leaves << "," << treeStats.maxDepth
+        << "," << treeStats.meanDepth << "," << treeStats.bytes;
+
+    for (size_t count : treeStats.leafOccupancy)
+    {
+        out << "," << count;
+    }
+
+    summarize([](const InteractionCounts& c) { return c.particleParticle; });
+    summarize([](const InteractionCounts& c) { return c.particleCell; });
+    summarize([](const InteractionCounts& c) { return c.particleParticle + c.particleCell; });
+    summarize([](const InteractionCounts& c) { return c.nodesOpened; });
+
+    out << "\n";
+}
+
 bool BarnesHut::isSufficientlyFar(Particle*& particle, Octree::Node*& node)
 {
     double s = node->boundingBox.halfOfSideLength * 2.0;
@@ -302,9 +837,7 @@ bool BarnesHut::isSufficientlyFar(Particle*& particle, Octree::Node*& node)
 
     double quotient = s / d;
 
-    static constexpr double THETA = 0.5;
-
-    return quotient < THETA;
+    return quotient < mSettings.theta;
 }
 
 void BarnesHut::updateState(size_t iteration)
@@ -316,45 +849,25 @@ void BarnesHut::updateState(size_t iteration)
     const double halfDt = 0.5 * mDt;
     const double halfDtSquared = halfDt * mDt;
 
+    // both loops hand every thread the same particles
+    const size_t grain = Threading::evenGrain(mParticles.size());
+
     {
 #ifdef PERF_PROFILE
         mPerfLeap->start();
 #endif
-        double elapsed = 0.0;
-        ScopedTimer timer(elapsed);
-        #pragma omp parallel for schedule(static)
-        for (size_t i = 0; i < mParticles.size(); ++i)
+        PROFILE_REGION("leapfrog integration");
+        ParallelLoop loop("leapfrog integration");
+
+        Threading::parallelFor(0, mParticles.size(), grain, [&](size_t first, size_t last)
         {
-            // perform leapfrog integration
-            auto*& particle = mParticles[i];
-
-            // x_{i+1} = x_i + v_i*dt + 0.5*a_i*dt^2
-            particle->mPosition[0] += particle->mVelocity[0] * mDt + halfDtSquared * particle->mAcceleration[0];
-            particle->mPosition[1] += particle->mVelocity[1] * mDt + halfDtSquared * particle->mAcceleration[1];
-            particle->mPosition[2] += particle->mVelocity[2] * mDt + halfDtSquared * particle->mAcceleration[2];
-
-            // a_{i+1} = F / m
-            double inverseMass = 1.0 / particle->mMass;
-            double axUpdated = particle->mAppliedForce[0] * inverseMass;
-            double ayUpdated = particle->mAppliedForce[1] * inverseMass;
-            double azUpdated = particle->mAppliedForce[2] * inverseMass;
-
-            // v_{i+1} = v_i + 0.5*(a_i + a_{i+1})*dt
-            particle->mVelocity[0] += halfDt * (particle->mAcceleration[0] + axUpdated);
-            particle->mVelocity[1] += halfDt * (particle->mAcceleration[1] + ayUpdated);
-            particle->mVelocity[2] += halfDt * (particle->mAcceleration[2] + azUpdated);
-
-            particle->mAcceleration[0] = axUpdated;
-            particle->mAcceleration[1] = ayUpdated;
-            particle->mAcceleration[2] = azUpdated;
-
-            // clear out particle force
-            particle->mAppliedForce[0] = 0.0;
-            particle->mAppliedForce[1] = 0.0;
-            particle->mAppliedForce[2] = 0.0;
-        }
-        timer.recordElapsedMs();
-        mDataStore.addProfileData(7, elapsed);
+            ThreadBusy busy(loop);
+
+            for (size_t i = first; i < last; ++i)
+            {
+                integrate(mParticles[i], halfDt, halfDtSquared);
+            }
+        });
 #ifdef PERF_PROFILE
         mPerfLeap->stop();
 #endif
@@ -364,18 +877,66 @@ void BarnesHut::updateState(size_t iteration)
 #ifdef PERF_PROFILE
         mPerfStore->start();
 #endif
-        double elapsed = 0.0;
-        ScopedTimer timer(elapsed);
-        #pragma omp parallel for schedule(static)
-        for (size_t i = 0; i < mParticles.size(); ++i)
+        PROFILE_REGION("update data store");
+        ParallelLoop loop("update data store");
+
+        Threading::parallelFor(0, mParticles.size(), grain, [&](size_t first, size_t last)
         {
-            auto*& particle = mParticles[i];
-            iterationStore[particle->mId] = particle->mPosition;
-        }
-        timer.recordElapsedMs();
-        mDataStore.addProfileData(8, elapsed);
+            ThreadBusy busy(loop);
+
+            for (size_t i = first; i < last; ++i)
+            {
+                auto*& particle = mParticles[i];
+                iterationStore[particle->mId] = particle->mPosition;
+            }
+        });
 #ifdef PERF_PROFILE
         mPerfStore->stop();
 #endif
     }
 }
+
+void BarnesHut::updateStateInTeam(size_t iteration)
+{
+    auto& iterationStore = mDataStore.getIterationStore(iteration + 1);
+
+    const double halfDt = 0.5 * mDt;
+    const double halfDtSquared = halfDt * mDt;
+
+    // the next tree is built from the new positions
+    #pragma omp for schedule(static)
+    for (size_t i = 0; i < mParticles.size(); ++i)
+    {
+        integrate(mParticles[i], halfDt, halfDtSquared);
+        iterationStore[mParticles[i]->mId] = mParticles[i]->mPosition;
+    }
+}
+
+void BarnesHut::integrate(Particle* particle, double halfDt, double halfDtSquared)
+{
+    // perform leapfrog integration
+    // x_{i+1} = x_i + v_i*dt + 0.5*a_i*dt^2
+    particle->mPosition[0] += particle->mVelocity[0] * mDt + halfDtSquared * particle->mAcceleration[0];
+    particle->mPosition[1] += particle->mVelocity[1] * mDt + halfDtSquared * particle->mAcceleration[1];
+    particle->mPosition[2] += particle->mVelocity[2] * mDt + halfDtSquared * particle->mAcceleration[2];
+
+    // a_{i+1} = F / m
+    double inverseMass = 1.0 / particle->mMass;
+    double axUpdated = particle->mAppliedForce[0] * inverseMass;
+    double ayUpdated = particle->mAppliedForce[1] * inverseMass;
+    double azUpdated = particle->mAppliedForce[2] * inverseMass;
+
+    // v_{i+1} = v_i + 0.5*(a_i + a_{i+1})*dt
+    particle->mVelocity[0] += halfDt * (particle->mAcceleration[0] + axUpdated);
+    particle->mVelocity[1] += halfDt * (particle->mAcceleration[1] + ayUpdated);
+    particle->mVelocity[2] += halfDt * (particle->mAcceleration[2] + azUpdated);
+
+    particle->mAcceleration[0] = axUpdated;
+    particle->mAcceleration[1] = ayUpdated;
+    particle->mAcceleration[2] = azUpdated;
+
+    // clear out particle force
+    particle->mAppliedForce[0] = 0.0;
+    particle->mAppliedForce[1] = 0.0;
+    particle->mAppliedForce[2] = 0.0;
+}
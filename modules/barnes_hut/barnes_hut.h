@@ -1,10 +1,16 @@
 #pragma once
 
+#include <cstdint>
+#include <deque>
+#include <fstream>
+#include <ostream>
 #include <vector>
 
 #include "octree.h"
 #include "particle.h"
 #include "data_store.h"
+#include "solver_settings.h"
+#include "roofline.h"
 
 #ifdef PERF_PROFILE
 #include "perf_profiler.h"
@@ -13,32 +19,175 @@
 class BarnesHut
 {
 public:
-    BarnesHut(std::vector<Particle*>& particles, double dt, 
-              double simulationLength, std::string& simulationName, bool profile);
+    // leafs per dynamically scheduled chunk of the force calculation
+    static constexpr size_t DEFAULT_FORCE_CHUNK_SIZE = 16;
+
+    // startIteration is the number of iterations already completed (non zero when restarting)
+    BarnesHut(std::vector<Particle*>& particles, SolverSettings& settings,
+              std::string& simulationName, bool profile, size_t startIteration = 0);
     
     ~BarnesHut() = default;
 
     void simulate();
 
+    // write a checkpoint every interval iterations (0 disables periodic checkpoints)
+    inline void setCheckpointInterval(size_t interval)
+    {
+        mCheckpointInterval = interval;
+    }
+
+    // write tree shape and interaction counts of every iteration to simulationName.stats.csv
+    inline void setCollectStats(bool collectStats)
+    {
+        mCollectStats = collectStats;
+    }
+
+    // write flops, estimated bytes and gflop/s of the force calculation of every iteration
+    // to simulationName.roofline.csv next to the machine peaks measured at startup
+    inline void setRoofline(bool roofline)
+    {
+        mRoofline = roofline;
+    }
+
+    // one parallel region for the whole simulation loop instead of one per phase, the
+    // phases share the team through orphaned worksharing and only synchronize where
+    // the next phase reads what the previous one wrote (perf sections are not recorded,
+    // openmp threading backend only)
+    inline void setPersistent(bool persistent)
+    {
+        mPersistent = persistent;
+    }
+
+    // how the octree of every iteration is built (not used with setPersistent)
+    inline void setBuildStrategy(Octree::BuildStrategy strategy)
+    {
+        mBuildStrategy = strategy;
+    }
+
+    // leafs per chunk of the force calculation, 0 is one chunk per thread (a static
+    // schedule), smaller chunks balance better and cost more scheduling
+    inline void setForceChunkSize(size_t chunkSize)
+    {
+        mForceChunkSize = chunkSize;
+    }
+
+    // copies the top levels of every tree once per numa node, on a thread of that node, so
+    // the nodes every force walk starts with are read from local memory, 0 walks the tree
+    // where it was built (not used with setPersistent)
+    inline void setReplicatedLevels(size_t levels)
+    {
+        mReplicatedLevels = levels;
+    }
+
+    // theta, leaf size and insert threshold of the following steps, the time step and the
+    // length stay the constructor's (used by the tuner to try settings on one instance)
+    inline void setTreeSettings(double theta, size_t maxPointsPerNode, size_t parallelThresholdForInsert)
+    {
+        mSettings.theta = theta;
+        mSettings.maxPointsPerNode = maxPointsPerNode;
+        mSettings.parallelThresholdForInsert = parallelThresholdForInsert;
+    }
+
+    struct StepTimes
+    {
+        double buildMs = 0.0;
+        double centerOfMassMs = 0.0;
+        double forceMs = 0.0;
+    };
+
+    // tree, center of mass and forces of one step on the current particles without moving
+    // them or recording anything, the forces are added to mAppliedForce (used by the tuner)
+    StepTimes measureStep();
+
 private:
     BarnesHut() = default;
 
+    // a parallel region per phase, returns the number of completed iterations
+    size_t run(std::ofstream& statsFile, std::ofstream& rooflineFile);
+
+    // one parallel region for every iteration
+    size_t runPersistent(std::ofstream& statsFile, std::ofstream& rooflineFile);
+
+    // checkpoint/signal handling between iterations, returns true if the simulation has to stop
+    bool finishIteration(size_t completedIterations);
+
     void calculateCenterOfMass(std::vector<Octree::Node*>& leafs);
 
+    // has to be called by every thread of the team, returns once every level is done
+    void calculateCenterOfMassInTeam(std::vector<Octree::Node*>& leafs);
+
+    // adds the parent to nextSet if node is the parent's first child, the node itself if
+    // one of its children is not done yet
+    void calculateCenterOfMass(Octree::Node* node, std::vector<Octree::Node*>& nextSet);
+
+    // work done by the force calculation for one particle
+    struct InteractionCounts
+    {
+        uint32_t particleParticle = 0;
+        uint32_t particleCell = 0;
+        uint32_t nodesOpened = 0;
+        uint32_t nodesVisited = 0;
+    };
+
+    // counting is compiled out of the walk unless CollectStats
+    template <bool CollectStats>
     void calculateForce(std::vector<Octree::Node*>& leafs, Octree::Node*& root);
 
-    void calculateForce(Particle*& particle, Octree::Node*& node);
+    template <bool CollectStats>
+    void calculateForce(Particle*& particle, Octree::Node*& node, InteractionCounts& counts);
+
+    // mReplicaRoots[numa node] for the tree of the current iteration
+    void replicateTopLevels(Octree::Node* root);
+
+    // copy of node and of its children down to levels below it into replica
+    Octree::Node* replicate(Octree::Node* node, size_t levels, std::deque<Octree::Node>& replica);
+
+    // leafs per chunk for the current tree
+    size_t forceChunkSize(size_t numLeafs) const;
+
+    // every particle of one chunk of chunkSize leafs
+    template <bool CollectStats>
+    void calculateForceChunk(std::vector<Octree::Node*>& leafs, Octree::Node*& root, size_t chunk, size_t chunkSize);
+
+    // has to be called by every thread of the team, returns once every force is applied
+    template <bool CollectStats>
+    void calculateForceInTeam(std::vector<Octree::Node*>& leafs, Octree::Node*& root);
 
     bool isSufficientlyFar(Particle*& particle, Octree::Node*& node);
 
     void updateState(size_t iteration);
 
+    // leapfrog and data store write fused into one loop, has to be called by every thread of the team
+    void updateStateInTeam(size_t iteration);
+
+    void integrate(Particle* particle, double halfDt, double halfDtSquared);
+
+    void writeCheckpoint(size_t iteration);
+
+    void writeStats(std::ostream& out, size_t iteration, const Octree::TreeStats& treeStats);
+
+    void writeRoofline(std::ostream& out, size_t iteration, double forceMs);
+
     std::vector<Particle*>& mParticles;
+    SolverSettings mSettings;
     double mDt;
     double mSimulationLength;
     std::string mSimulationName;
     bool mProfile;
     size_t mNumIterations;
+    size_t mStartIteration;
+    size_t mCheckpointInterval = 0;
+    bool mCollectStats = false;
+    bool mRoofline = false;
+    bool mPersistent = false;
+    Octree::BuildStrategy mBuildStrategy = Octree::BuildStrategy::Task;
+    size_t mForceChunkSize = DEFAULT_FORCE_CHUNK_SIZE;
+    size_t mReplicatedLevels = 0;
+    std::vector<std::deque<Octree::Node>> mReplicas;    // [numa node]
+    std::vector<Octree::Node*> mReplicaRoots;           // [numa node], empty unless replicated
+    Roofline::Machine mMachine;
+    std::vector<InteractionCounts> mInteractions;   // [particle id]
+    std::vector<std::vector<Octree::Node*>> mNextSets;  // [parity][thread], center of mass levels of the team
     DataStore mDataStore;
 #ifdef PERF_PROFILE
     std::unique_ptr<PerfSection> mPerfBbox;
@@ -0,0 +1,243 @@
+#include "checkpoint.h"
+
+#include <atomic>
+#include <bit>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "threading.h"
+
+namespace
+{
+    static_assert(std::atomic<int>::is_always_lock_free, "signal handler requires a lock free flag");
+
+    std::atomic<int> gPendingSignal{0};
+
+    void onCheckpointSignal(int signal)
+    {
+        gPendingSignal.store(signal, std::memory_order_relaxed);
+    }
+
+    bool writeAll(int fd, const void* data, size_t bytes, off_t offset)
+    {
+        const char* ptr = static_cast<const char*>(data);
+
+        while (bytes > 0)
+        {
+            ssize_t written = ::pwrite(fd, ptr, bytes, offset);
+            if (written < 0)
+            {
+                if (errno == EINTR) continue;
+                return false;
+            }
+
+            ptr += written;
+            offset += written;
+            bytes -= static_cast<size_t>(written);
+        }
+
+        return true;
+    }
+
+    bool readAll(int fd, void* data, size_t bytes, off_t offset)
+    {
+        char* ptr = static_cast<char*>(data);
+
+        while (bytes > 0)
+        {
+            ssize_t numRead = ::pread(fd, ptr, bytes, offset);
+            if (numRead < 0)
+            {
+                if (errno == EINTR) continue;
+                return false;
+            }
+            if (numRead == 0)
+            {
+                return false; // truncated file
+            }
+
+            ptr += numRead;
+            offset += numRead;
+            bytes -= static_cast<size_t>(numRead);
+        }
+
+        return true;
+    }
+}
+
+void Checkpoint::write(const std::string& filename, std::vector<Particle*>& particles, const State& state)
+{
+    const uint64_t n = particles.size();
+    const uint64_t blockBytes = n * sizeof(uint64_t);
+
+    Header header{};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.numBlocks = NUM_BLOCKS;
+    header.numParticles = n;
+    header.iteration = state.iteration;
+    header.dt = state.settings.dt;
+    header.simulationLength = state.settings.simulationLength;
+    header.theta = state.settings.theta;
+    header.parallelThresholdForInsert = state.settings.parallelThresholdForInsert;
+    header.maxPointsPerNode = state.settings.maxPointsPerNode;
+
+    std::string tempFilename = filename + ".tmp";
+    int fd = ::open(tempFilename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    if (fd == -1)
+    {
+        throw std::runtime_error("unable to open: " + tempFilename + " to write checkpoint");
+    }
+
+    // size the file up front so every thread can pwrite into its own region
+    bool success = ::ftruncate(fd, sizeof(Header) + NUM_BLOCKS * blockBytes) == 0;
+    success = success && writeAll(fd, &header, sizeof(Header), 0);
+
+    // one range per thread, every thread writes its part of each block and counts the parts that failed
+    const size_t failed = Threading::parallelReduce(size_t(0), n, Threading::evenGrain(n), size_t(0),
+        [&](size_t begin, size_t end)
+        {
+            std::vector<uint64_t> buffer(end - begin);
+            size_t failedBlocks = 0;
+
+            for (size_t block = 0; block < NUM_BLOCKS; ++block)
+            {
+                for (size_t i = begin; i < end; ++i)
+                {
+                    const Particle* particle = particles[i];
+                    uint64_t& out = buffer[i - begin];
+
+                    if (block < 3)       out = std::bit_cast<uint64_t>(particle->mPosition[block]);
+                    else if (block < 6)  out = std::bit_cast<uint64_t>(particle->mVelocity[block - 3]);
+                    else if (block < 9)  out = std::bit_cast<uint64_t>(particle->mAcceleration[block - 6]);
+                    else if (block == 9) out = std::bit_cast<uint64_t>(particle->mMass);
+                    else                 out = static_cast<uint64_t>(particle->mId);
+                }
+
+                off_t offset = sizeof(Header) + block * blockBytes + begin * sizeof(uint64_t);
+                if (!writeAll(fd, buffer.data(), buffer.size() * sizeof(uint64_t), offset))
+                {
+                    ++failedBlocks;
+                }
+            }
+
+            return failedBlocks;
+        },
+        [](size_t a, size_t b) { return a + b; });
+    success = success && failed == 0;
+
+    // no fsync, the goal is to survive the process being killed (slurm time
+    // limit) not the node going down and the page cache survives the former
+    success = (::close(fd) == 0) && success;
+
+    if (!success || std::rename(tempFilename.c_str(), filename.c_str()) != 0)
+    {
+        std::remove(tempFilename.c_str());
+        throw std::runtime_error("failed to write checkpoint: " + filename + " (" + std::string(strerror(errno)) + ")");
+    }
+}
+
+void Checkpoint::read(const std::string& filename, State& state, ParticleStorage& storage)
+{
+    int fd = ::open(filename.c_str(), O_RDONLY);
+
+    if (fd == -1)
+    {
+        throw std::runtime_error("unable to open: " + filename);
+    }
+
+    Header header{};
+    struct stat fileStat{};
+
+    if (!readAll(fd, &header, sizeof(Header), 0) || ::fstat(fd, &fileStat) != 0)
+    {
+        ::close(fd);
+        throw std::runtime_error("unable to read checkpoint header: " + filename);
+    }
+
+    const uint64_t n = header.numParticles;
+    const uint64_t blockBytes = n * sizeof(uint64_t);
+
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 ||
+        header.version != VERSION ||
+        header.numBlocks != NUM_BLOCKS ||
+        static_cast<uint64_t>(fileStat.st_size) != sizeof(Header) + NUM_BLOCKS * blockBytes)
+    {
+        ::close(fd);
+        throw std::runtime_error("not a valid checkpoint file: " + filename);
+    }
+
+    state.iteration = header.iteration;
+    state.settings.dt = header.dt;
+    state.settings.simulationLength = header.simulationLength;
+    state.settings.theta = header.theta;
+    state.settings.parallelThresholdForInsert = header.parallelThresholdForInsert;
+    state.settings.maxPointsPerNode = header.maxPointsPerNode;
+
+    storage.allocate(n);
+    // one range per thread so each thread first touches the particles it reads
+    const size_t failed = Threading::parallelReduce(size_t(0), n, Threading::evenGrain(n), size_t(0),
+        [&](size_t begin, size_t end)
+        {
+            std::vector<uint64_t> buffer(end - begin);
+            size_t failedBlocks = 0;
+
+            for (size_t block = 0; block < NUM_BLOCKS; ++block)
+            {
+                off_t offset = sizeof(Header) + block * blockBytes + begin * sizeof(uint64_t);
+                if (!readAll(fd, buffer.data(), buffer.size() * sizeof(uint64_t), offset))
+                {
+                    ++failedBlocks;
+                    continue;
+                }
+
+                for (size_t i = begin; i < end; ++i)
+                {
+                    Particle* particle = &storage[i];
+                    const uint64_t in = buffer[i - begin];
+
+                    if (block < 3)       particle->mPosition[block] = std::bit_cast<double>(in);
+                    else if (block < 6)  particle->mVelocity[block - 3] = std::bit_cast<double>(in);
+                    else if (block < 9)  particle->mAcceleration[block - 6] = std::bit_cast<double>(in);
+                    else if (block == 9) particle->mMass = std::bit_cast<double>(in);
+                    else                 particle->mId = static_cast<size_t>(in);
+                }
+            }
+
+            return failedBlocks;
+        },
+        [](size_t a, size_t b) { return a + b; });
+
+    ::close(fd);
+
+    if (failed > 0)
+    {
+        storage.allocate(0);
+        throw std::runtime_error("failed to read checkpoint: " + filename);
+    }
+}
+
+void Checkpoint::installSignalHandlers()
+{
+    struct sigaction action{};
+    action.sa_handler = onCheckpointSignal;
+    sigemptyset(&action.sa_mask);
+    // restart interrupted syscalls so file io in flight is not aborted
+    action.sa_flags = SA_RESTART;
+
+    sigaction(SIGTERM, &action, nullptr);
+    sigaction(SIGUSR1, &action, nullptr);
+}
+
+int Checkpoint::takePendingSignal()
+{
+    return gPendingSignal.exchange(0, std::memory_order_relaxed);
+}
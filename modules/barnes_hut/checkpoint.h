@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "particle.h"
+#include "particle_storage.h"
+#include "solver_settings.h"
+
+// binary checkpoint of the full simulation state
+//
+// layout: Header followed by one contiguous block of N values per field
+// (position x/y/z, velocity x/y/z, acceleration x/y/z, mass, id) so that
+// each thread can read/write its slice of every block independently
+class Checkpoint
+{
+public:
+    struct State
+    {
+        SolverSettings settings;
+        uint64_t iteration = 0; // number of completed iterations
+    };
+
+    // writes to "filename.tmp" and renames on success so an interrupted write
+    // never clobbers the previous checkpoint
+    static void write(const std::string& filename, std::vector<Particle*>& particles, const State& state);
+
+    // reads straight into storage, replacing its contents
+    static void read(const std::string& filename, State& state, ParticleStorage& storage);
+
+    // SIGTERM and SIGUSR1 only raise a flag, the simulation loop polls it
+    // between iterations where the particle state is consistent
+    static void installSignalHandlers();
+
+    // returns the last signal received (0 if none) and clears it
+    static int takePendingSignal();
+
+private:
+    Checkpoint() = default;
+
+    static constexpr char MAGIC[8] = {'N', 'B', 'O', 'D', 'Y', 'C', 'K', '\0'};
+    static constexpr uint32_t VERSION = 1;
+    static constexpr size_t NUM_BLOCKS = 11;
+
+    struct Header
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t numBlocks;
+        uint64_t numParticles;
+        uint64_t iteration;
+        double dt;
+        double simulationLength;
+        double theta;
+        uint64_t parallelThresholdForInsert;
+        uint64_t maxPointsPerNode;
+    };
+};
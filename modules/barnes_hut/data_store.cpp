@@ -1,11 +1,17 @@
 #include "data_store.h"
 
 #include <fstream>
+#include <algorithm>
+#include <future>
+#include <limits>
+#include <utility>
 
 #include "Alembic/AbcGeom/All.h"
 #include "Alembic/Abc/All.h"
 #include "Alembic/AbcCoreOgawa/All.h"
 
+#include "threading.h"
+
 namespace
 {
     template <class T>
@@ -15,114 +21,130 @@ namespace
     }
 }
 
-DataStore::DataStore(uint64_t n, double dt, uint64_t numIterations)
+DataStore::DataStore(uint64_t n, double dt, uint64_t numIterations, uint64_t firstIteration)
     : mMass(n)
-    , mPositions(numIterations+1, std::vector<std::array<double, 3>>(n))
+    , mPositions(numIterations - firstIteration + 1, std::vector<std::array<double, 3>>(n))
     , mNumIterations(numIterations)
+    , mFirstIteration(firstIteration)
     , mN(n)
     , mDt(dt)
 {
-    mProfileData.fill(0.0);
 }
 
-void DataStore::writeToBinaryFile(std::string& filename)
+void DataStore::writeToBinaryFile(std::string& filename, uint64_t lastIteration)
 {
-    Alembic::Abc::OArchive archive(Alembic::AbcCoreOgawa::WriteArchive(), filename);
-
-    Alembic::Abc::OObject topObj = archive.getTop();
-
-    // create time stamps for accurate simulation
-    Alembic::Abc::TimeSampling timeSampling(mDt, 0.0);
-    Alembic::Abc::uint32_t timestamps = archive.addTimeSampling(timeSampling);
-
-    // create native point cloud object
-    Alembic::AbcGeom::OPoints pointsObj(topObj, "particles", timestamps);
-    Alembic::AbcGeom::OPointsSchema &pointsSchema = pointsObj.getSchema();
-
-    // normalize masses
-    float minMass = *std::min_element(mMass.begin(), mMass.end());
-    float maxMass = *std::max_element(mMass.begin(), mMass.end());
-    float range   = maxMass - minMass;
-    for (auto& mass : mMass)
+    // scoped so the archive is finalized (written to disk) before returning
     {
-        // normalize to [0, 5]
-        mass = ((mass - minMass) / range) * 10.0; 
-    }
+        Alembic::Abc::OArchive archive(Alembic::AbcCoreOgawa::WriteArchive(), filename);
+
+        Alembic::Abc::OObject topObj = archive.getTop();
+
+        // create time stamps for accurate simulation
+        Alembic::Abc::TimeSampling timeSampling(mDt, mFirstIteration * mDt);
+        Alembic::Abc::uint32_t timestamps = archive.addTimeSampling(timeSampling);
+
+        // create native point cloud object
+        Alembic::AbcGeom::OPoints pointsObj(topObj, "particles", timestamps);
+        Alembic::AbcGeom::OPointsSchema &pointsSchema = pointsObj.getSchema();
+
+        // normalize masses
+        using Range = std::pair<float, float>;
+        const size_t massGrain = Threading::evenGrain(mMass.size());
+
+        const Range massRange = Threading::parallelReduce(size_t(0), mMass.size(), massGrain,
+            Range{ std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity() },
+            [&](size_t first, size_t last)
+            {
+                Range local{ std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity() };
+                for (size_t i = first; i < last; ++i)
+                {
+                    local.first = std::min(local.first, mMass[i]);
+                    local.second = std::max(local.second, mMass[i]);
+                }
+                return local;
+            },
+            [](const Range& a, const Range& b) { return Range{ std::min(a.first, b.first), std::max(a.second, b.second) }; });
+
+        const float minMass = massRange.first;
+        const float range = massRange.second - massRange.first;
+        Threading::parallelFor(0, mMass.size(), massGrain, [&](size_t first, size_t last)
+        {
+            for (size_t i = first; i < last; ++i)
+            {
+                // normalize to [0, 5]
+                mMass[i] = ((mMass[i] - minMass) / range) * 10.0;
+            }
+        });
+
+        // create mass information
+        Alembic::Abc::FloatArraySample widthSample(mMass.data(), mMass.size());
+        Alembic::AbcGeom::v12::OFloatGeomParam::Sample widths;
+        widths.setVals(widthSample);
+
+        // map particle ids
+        std::vector<Alembic::Abc::uint64_t> ids(mMass.size());
+        Threading::parallelFor(0, ids.size(), Threading::evenGrain(ids.size()), [&](size_t first, size_t last)
+        {
+            for (size_t i = first; i < last; ++i)
+            {
+                ids[i] = static_cast<Alembic::Abc::uint64_t>(i);
+            }
+        });
 
-    // create mass information
-    Alembic::Abc::FloatArraySample widthSample(mMass.data(), mMass.size());
-    Alembic::AbcGeom::v12::OFloatGeomParam::Sample widths;
-    widths.setVals(widthSample);
+        // alembic requires 32 bit floating point NOT 64 bit
+        // double buffered: frame i is converted while frame i-1 is being written
+        std::array<std::vector<Alembic::AbcGeom::V3f>, 2> staging;
+        staging[0].resize(mN);
+        staging[1].resize(mN);
 
-    // map particle ids
-    std::vector<Alembic::Abc::uint64_t> ids(mMass.size());
-    for (size_t i = 0; i < ids.size(); ++i)
-    {
-        ids[i] = static_cast<Alembic::Abc::uint64_t>(i);
-    }
+        std::future<void> pendingWrite;
 
-    // loop over every iteration and create a frame for it
-    bool firstFrame = true;
-    for (auto& iteration : mPositions)
-    {
-        // alembic requires 32 bit floating point NOT 64 bit
-        std::vector<Alembic::AbcGeom::V3f> positions(iteration.size());
-        for (size_t i = 0; i < iteration.size(); ++i)
+        // loop over every iteration and create a frame for it
+        const uint64_t numFrames = std::min<uint64_t>(lastIteration - mFirstIteration + 1, mPositions.size());
+        for (uint64_t frame = 0; frame < numFrames; ++frame)
         {
-            positions[i] = Alembic::AbcGeom::V3f( static_cast<float>(iteration[i][0]),
-                                                  static_cast<float>(iteration[i][1]),
-                                                  static_cast<float>(iteration[i][2]) );
+            auto& iteration = mPositions[frame];
+            auto& positions = staging[frame % 2];
+
+            Threading::parallelFor(0, iteration.size(), Threading::evenGrain(iteration.size()), [&](size_t first, size_t last)
+            {
+                for (size_t i = first; i < last; ++i)
+                {
+                    positions[i] = Alembic::AbcGeom::V3f( static_cast<float>(iteration[i][0]),
+                                                          static_cast<float>(iteration[i][1]),
+                                                          static_cast<float>(iteration[i][2]) );
+                }
+            });
+
+            // alembic is not thread safe so only one frame may be in flight, this
+            // also guarantees the other staging buffer is free for the next frame
+            if (pendingWrite.valid())
+            {
+                pendingWrite.get();
+            }
+
+            pendingWrite = std::async(std::launch::async, [&, frame]()
+            {
+                Alembic::AbcGeom::V3fArraySample positionsSample(positions.data(), positions.size());
+
+                // construct frame
+                Alembic::AbcGeom::OPointsSchema::Sample sample;
+                sample.setPositions(positionsSample);
+                sample.setWidths(widths);
+
+                if (frame == 0)
+                {
+                    sample.setIds(ids);
+                }
+
+                // commit frame to storage
+                pointsSchema.set(sample);
+            });
         }
 
-        Alembic::AbcGeom::V3fArraySample positionsSample(positions.data(), positions.size());
-
-        // construct frame
-        Alembic::AbcGeom::OPointsSchema::Sample sample;
-        sample.setPositions(positionsSample);
-        sample.setWidths(widths);
-
-        if (firstFrame)
+        if (pendingWrite.valid())
         {
-            sample.setIds(ids);
-            firstFrame = false;
+            pendingWrite.get();
         }
-
-        // commit frame to storage
-        pointsSchema.set(sample);
     }
 }
-
-void DataStore::writeProfileData(std::string& filename)
-{
-    for (auto& data : mProfileData)
-    {
-        data /= static_cast<double>(mNumIterations);
-    }
-
-    double sum = 0.0;
-    for (size_t i = 0; i < 4; ++i)
-    {
-        sum += mProfileData[i];
-    }
-
-    std::ofstream file(filename);
-
-    if (!file.is_open())
-    {
-        throw std::runtime_error("unable to open  file to store simulation profile");
-    }
-
-    file << "all times in milliseconds\n";
-    file << "octree creation: " << mProfileData[0] << "\n";
-    file << "    compute bounding box: " << mProfileData[4] << "\n";
-    file << "    insert points "         << mProfileData[5] << "\n";
-    file << "    generate leaf nodes: "  << mProfileData[6] << "\n";
-    file << "center of mass calculation: " << mProfileData[1] << "\n";
-    file << "applying forces calculation: " << mProfileData[2] << "\n";
-    file << "update pos/vel/acc: " << mProfileData[3] << "\n";
-    file << "    leapfrog integration: " << mProfileData[7] << "\n";
-    file << "    update data store: "    << mProfileData[8] << "\n";
-    file << "overall: " << sum << "\n";
-
-    file.close();
-}
\ No newline at end of file
@@ -9,7 +9,8 @@
 class DataStore
 {
 public:
-    DataStore(uint64_t n, double dt, uint64_t numIterations);
+    // frames are stored for iterations [firstIteration, numIterations]
+    DataStore(uint64_t n, double dt, uint64_t numIterations, uint64_t firstIteration = 0);
     ~DataStore() = default;
 
     inline void addMass(uint64_t id, double mass)
@@ -24,36 +25,28 @@ public:
 
     inline std::vector<std::array<double, 3>>& getIterationStore(uint64_t iteration)
     {
-        if (iteration >= mPositions.size())
+        if (iteration < mFirstIteration || iteration - mFirstIteration >= mPositions.size())
         {
             throw std::runtime_error("trying to insert iteration out of range");
         }
         
-        return mPositions[iteration];
+        return mPositions[iteration - mFirstIteration];
     }
 
     inline void addPosition(uint64_t iteration, uint64_t id, std::array<double, 3>& position)
     {
-        if (iteration >= mPositions.size())
-        {
-            throw std::runtime_error("trying to insert iteration out of range");
-        }
-        if (id > mPositions[iteration].size())
+        auto& iterationStore = getIterationStore(iteration);
+
+        if (id > iterationStore.size())
         {
             throw std::runtime_error("trying to insert position for iteration out of range");
         }
 
-        mPositions[iteration][id] = position;
+        iterationStore[id] = position;
     }
 
-    inline void addProfileData(uint64_t section, double time)
-    {
-        mProfileData[section] += time;
-    }
-
-    void writeToBinaryFile(std::string& filename);
-
-    void writeProfileData(std::string& filename);
+    // writes frames [firstIteration, lastIteration] (a run may stop early on a signal)
+    void writeToBinaryFile(std::string& filename, uint64_t lastIteration);
 
 private:
     DataStore() = default;
@@ -61,8 +54,8 @@ private:
     // store as float because alembic requires float
     std::vector<float> mMass;
     std::vector<std::vector<std::array<double, 3>>> mPositions;
-    std::array<double, 9> mProfileData;
     uint64_t mNumIterations;
+    uint64_t mFirstIteration;
     uint64_t mN;
     double mDt;
     
@@ -2,21 +2,70 @@
 #include <vector>
 #include <memory>
 #include <iostream>
+#include <chrono>
+#include <filesystem>
+#include <limits>
+#include <cerrno>
+#include <cstdlib>
+
+#include <sys/resource.h>
 
 #include "particle.h"
+#include "particle_storage.h"
 #include "particle_config.hpp"
 #include "octree.h"
+#include "build_calibration.h"
 #include "barnes_hut.h"
+#include "tuning.h"
+#include "checkpoint.h"
+#include "tracer.h"
+#include "threading.h"
+#include "topology.h"
 
 struct UserInput
 {
     std::string particleConfig;
     std::string simulationName;
-    double t;
-    double simulationLength;
+    std::string restartFile;
+    std::string cacheDirectory;
+    std::string perfEvents;
+    size_t perfSamplePeriod = 0;
+    bool useCache = false;
+    bool trace = false;
+    bool stats = false;
+    bool roofline = false;
+    bool persistent = false;
+    Octree::BuildStrategy buildStrategy = Octree::BuildStrategy::Task;
+    bool buildGiven = false;
+    std::string calibrationFile;
+    bool tune = false;
+    size_t tuneSampleSize = Tuning::DEFAULT_SAMPLE_SIZE;
+    std::string tuningFile;
+    Topology::Binding affinity = Topology::Binding::None;
+    bool affinityGiven = false;
+    size_t replicatedLevels = 0;
+    size_t traceEvents = Tracer::DEFAULT_EVENTS_PER_THREAD;
+    double t = 0.0;
+    double simulationLength = 0.0;
+    size_t checkpointInterval = 0;
     bool profile = false;
 };
 
+// the whole argument as an unsigned count, strtoull would wrap "-1" and stop at "abc"
+bool parseCount(const char* value, size_t& out)
+{
+    if (value[0] < '0' || value[0] > '9') return false;
+
+    char* end = nullptr;
+    errno = 0;
+    unsigned long long parsed = std::strtoull(value, &end, 10);
+
+    if (errno != 0 || *end != '\0') return false;
+
+    out = parsed;
+    return true;
+}
+
 bool parseArgs(int argc, char** argv, UserInput &out)
 {
     int argsParsed = 0;
@@ -47,7 +96,130 @@ bool parseArgs(int argc, char** argv, UserInput &out)
         else if (a == "-p")
         {
             out.profile = true;
-            ++argsParsed;
+        }
+        else if (a == "-restart")
+        {
+            if (!need(1)) return false;
+
+            out.restartFile = argv[i+1];
+            ++i;
+        }
+        else if (a == "-checkpoint")
+        {
+            if (!need(1)) return false;
+
+            if (!parseCount(argv[i+1], out.checkpointInterval)) return false;
+            ++i;
+        }
+        else if (a == "-cache")
+        {
+            out.useCache = true;
+
+            // the directory is optional, without one the cache goes next to the input
+            if (need(1) && argv[i+1][0] != '-')
+            {
+                out.cacheDirectory = argv[i+1];
+                ++i;
+            }
+        }
+        else if (a == "-stats")
+        {
+            out.stats = true;
+        }
+        else if (a == "-roofline")
+        {
+            out.roofline = true;
+        }
+        else if (a == "-persistent")
+        {
+            out.persistent = true;
+        }
+        else if (a == "-build")
+        {
+            if (!need(1)) return false;
+
+            try
+            {
+                out.buildStrategy = Octree::buildStrategyFromString(argv[i+1]);
+                out.buildGiven = true;
+            }
+            catch (const std::exception& e)
+            {
+                std::cout << e.what() << std::endl;
+                return false;
+            }
+            ++i;
+        }
+        else if (a == "-calibration")
+        {
+            if (!need(1)) return false;
+
+            out.calibrationFile = argv[i+1];
+            ++i;
+        }
+        else if (a == "-tune")
+        {
+            out.tune = true;
+            if (need(1) && argv[i+1][0] != '-')
+            {
+                if (!parseCount(argv[i+1], out.tuneSampleSize) || out.tuneSampleSize == 0) return false;
+                ++i;
+            }
+        }
+        else if (a == "-tuning")
+        {
+            if (!need(1)) return false;
+
+            out.tuningFile = argv[i+1];
+            ++i;
+        }
+        else if (a == "-affinity")
+        {
+            if (!need(1)) return false;
+
+            try
+            {
+                out.affinity = Topology::bindingFromString(argv[i+1]);
+                out.affinityGiven = true;
+            }
+            catch (const std::exception& e)
+            {
+                std::cout << e.what() << std::endl;
+                return false;
+            }
+            ++i;
+        }
+        else if (a == "-replicate")
+        {
+            if (!need(1)) return false;
+
+            if (!parseCount(argv[i+1], out.replicatedLevels)) return false;
+            ++i;
+        }
+        else if (a == "-trace")
+        {
+            out.trace = true;
+
+            // ring buffer size is optional
+            if (need(1) && argv[i+1][0] != '-')
+            {
+                if (!parseCount(argv[i+1], out.traceEvents) || out.traceEvents == 0) return false;
+                ++i;
+            }
+        }
+        else if (a == "-perf_events")
+        {
+            if (!need(1)) return false;
+
+            out.perfEvents = argv[i+1];
+            ++i;
+        }
+        else if (a == "-perf_sample")
+        {
+            if (!need(1)) return false;
+
+            if (!parseCount(argv[i+1], out.perfSamplePeriod)) return false;
+            ++i;
         }
         else if (a=="-in")
         {
@@ -71,7 +243,36 @@ bool parseArgs(int argc, char** argv, UserInput &out)
         }
     }
 
-    return argsParsed >= 4;
+    // tuning only needs the particles and a file to write
+    if (out.tune)
+    {
+        return !out.particleConfig.empty() && out.restartFile.empty() && out.tuneSampleSize > 0 && out.tuningFile != "none";
+    }
+
+    // a restart takes the time step, length and particles from the checkpoint
+    return out.restartFile.empty() ? argsParsed >= 4 : !out.simulationName.empty();
+}
+
+// high water mark of the resident set in MB
+double peakRssMb()
+{
+    struct rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+
+    return static_cast<double>(usage.ru_maxrss) / 1024.0; // ru_maxrss is in KB on linux
+}
+
+const char* cacheResultName(ParticleConfig::CacheResult result)
+{
+    switch (result)
+    {
+    case ParticleConfig::CacheResult::Hit:      return "hit";
+    case ParticleConfig::CacheResult::Written:  return "written";
+    case ParticleConfig::CacheResult::Failed:   return "could not be written";
+    case ParticleConfig::CacheResult::Bypassed: return "not used for binary input";
+    }
+
+    return "";
 }
 
 int main(int argc, char* argv[])
@@ -81,30 +282,272 @@ int main(int argc, char* argv[])
 
     if (success)
     {
-        auto inputParticles = ParticleConfig::parse(input.particleConfig);
+        SolverSettings settings;
+        settings.dt = input.t;
+        settings.simulationLength = input.simulationLength;
 
-        std::vector<Particle*> particles;
-        for (const auto& particle : inputParticles)
+        if (!input.perfEvents.empty())
         {
-            particles.emplace_back(new Particle(particle));
+#ifdef PERF_PROFILE
+            PerfProfiler::getInstance().setEvents(input.perfEvents);
+#else
+            std::cout << "built without perf profiling, ignoring -perf_events" << std::endl;
+#endif
         }
 
-        BarnesHut bh(particles, input.t, input.simulationLength, input.simulationName, input.profile);
-        bh.simulate();
+        if (input.perfSamplePeriod > 0)
+        {
+#ifdef PERF_PROFILE
+            PerfProfiler::getInstance().setSamplePeriod(input.perfSamplePeriod);
+#else
+            std::cout << "built without perf profiling, ignoring -perf_sample" << std::endl;
+#endif
+        }
+
+        // before loading so the particles are first touched by the bound threads
+        if (input.affinityGiven)
+        {
+            auto& topology = Topology::getInstance();
+            const auto threadCpus = topology.bindThreads(input.affinity);
+
+            std::cout << "affinity " << Topology::bindingName(input.affinity) << " on " << topology.numNodes()
+                      << " numa node" << (topology.numNodes() == 1 ? "" : "s") << ": " << topology.describe(threadCpus) << std::endl;
+        }
+
+        ParticleStorage storage;
+        size_t startIteration = 0;
+
+        auto loadStart = std::chrono::steady_clock::now();
+
+        if (input.restartFile.empty() && input.useCache)
+        {
+            auto result = storage.loadCached(input.particleConfig, input.cacheDirectory);
+            std::cout << "particle cache " << cacheResultName(result);
+            if (result != ParticleConfig::CacheResult::Bypassed)
+            {
+                std::cout << ": " << ParticleConfig::cachePath(input.particleConfig, input.cacheDirectory);
+            }
+            std::cout << std::endl;
+        }
+        else if (input.restartFile.empty())
+        {
+            storage.load(input.particleConfig);
+        }
+        else
+        {
+            Checkpoint::State state;
+            Checkpoint::read(input.restartFile, state, storage);
+
+            settings = state.settings;
+            startIteration = state.iteration;
+
+            // allow extending a finished run, the time step has to stay the same to resume exactly
+            if (input.simulationLength > 0.0)
+            {
+                settings.simulationLength = input.simulationLength;
+            }
+
+            std::cout << "restarting from iteration " << startIteration << " of " << input.restartFile << std::endl;
+        }
+
+        std::vector<Particle*> particles = storage.pointers();
+
+        std::chrono::duration<double, std::milli> loadMs = std::chrono::steady_clock::now() - loadStart;
+        std::cout << "loaded " << particles.size() << " particles in " << loadMs.count() << " ms, peak rss " << peakRssMb() << " MB" << std::endl;
+        std::cout << "threading backend " << Threading::backendName() << " with " << Threading::numThreads() << " threads" << std::endl;
+
+        Checkpoint::installSignalHandlers();
+
+        if (input.trace)
+        {
+#ifdef TIME_PROFILE
+            Tracer::getInstance().enable(input.traceEvents);
+#else
+            std::cout << "built without time profiling, ignoring -trace" << std::endl;
+#endif
+        }
+
+        const std::string tuningFile = input.tuningFile.empty() ? Tuning::hostFilename() : input.tuningFile;
+
+        if (input.tune)
+        {
+            // keep the rows other thread counts wrote
+            auto& tuning = Tuning::getInstance();
+            if (std::filesystem::exists(tuningFile))
+            {
+                tuning.load(tuningFile);
+            }
 
-        for (auto* particle : particles)
+            const auto row = Tuning::tune(particles, input.tuneSampleSize);
+            tuning.setRow(row);
+            tuning.save(tuningFile);
+
+            std::cout << "wrote the " << row.threads << " thread row of " << tuningFile << ": theta " << row.theta
+                      << ", leaf size " << row.maxPointsPerNode << ", insert threshold " << row.parallelThresholdForInsert
+                      << ", task threshold " << (row.taskThreshold == std::numeric_limits<size_t>::max() ? "never" : std::to_string(row.taskThreshold))
+                      << ", traversal work " << row.traversalWorkPerThread
+                      << ", force chunk " << (row.forceChunkSize == 0 ? "static" : std::to_string(row.forceChunkSize)) << std::endl;
+
+            return 0;
+        }
+
+        // the host's tuning is used unless told otherwise, theta and the leaf size change the
+        // results so a restart keeps the settings of its checkpoint
+        bool tuned = false;
+        size_t forceChunkSize = BarnesHut::DEFAULT_FORCE_CHUNK_SIZE;
+
+        if (input.tuningFile != "none" && (!input.tuningFile.empty() || std::filesystem::exists(tuningFile)))
+        {
+            auto& tuning = Tuning::getInstance();
+            tuning.load(tuningFile);
+
+            const auto row = tuning.lookup(Threading::numThreads());
+            if (input.restartFile.empty())
+            {
+                settings.theta = row.theta;
+                settings.maxPointsPerNode = row.maxPointsPerNode;
+                settings.parallelThresholdForInsert = row.parallelThresholdForInsert;
+            }
+
+            forceChunkSize = row.forceChunkSize;
+
+            // the tuned build thresholds are an auto build's calibration
+            if (!input.buildGiven)
+            {
+                input.buildStrategy = Octree::BuildStrategy::Auto;
+            }
+
+            // an auto build takes its insert threshold from the calibration, so a restart
+            // passes on the checkpoint's
+            if (input.calibrationFile.empty())
+            {
+                BuildCalibration::Row calibration;
+                calibration.threads = row.threads;
+                calibration.parallelThresholdForInsert = settings.parallelThresholdForInsert;
+                calibration.taskThreshold = row.taskThreshold;
+                calibration.traversalWorkPerThread = row.traversalWorkPerThread;
+                BuildCalibration::getInstance().setRow(calibration);
+            }
+
+            tuned = true;
+
+            std::cout << "tuning: theta " << settings.theta << ", leaf size " << settings.maxPointsPerNode
+                      << ", insert threshold " << settings.parallelThresholdForInsert
+                      << ", task threshold " << (row.taskThreshold == std::numeric_limits<size_t>::max() ? "never" : std::to_string(row.taskThreshold))
+                      << ", traversal work " << row.traversalWorkPerThread
+                      << ", force chunk " << (forceChunkSize == 0 ? "static" : std::to_string(forceChunkSize))
+                      << " (" << row.threads << " thread row of " << tuningFile << ")" << std::endl;
+
+            if (!input.restartFile.empty())
+            {
+                std::cout << "restarting, theta, leaf size and insert threshold are the checkpoint's" << std::endl;
+            }
+        }
+
+        BarnesHut bh(particles, settings, input.simulationName, input.profile, startIteration);
+        bh.setCheckpointInterval(input.checkpointInterval);
+        bh.setCollectStats(input.stats);
+        bh.setRoofline(input.roofline);
+#ifdef THREADING_NATIVE
+        if (input.persistent)
+        {
+            std::cout << "built with the native threading backend, ignoring -persistent" << std::endl;
+            input.persistent = false;
+        }
+#endif
+        bh.setPersistent(input.persistent);
+
+        if (input.persistent && input.replicatedLevels > 0)
         {
-            delete particle;
+            std::cout << "-persistent walks the tree where it was built, ignoring -replicate" << std::endl;
         }
+        else
+        {
+            bh.setReplicatedLevels(input.replicatedLevels);
+        }
+
+        if (input.persistent && input.buildGiven && input.buildStrategy != Octree::BuildStrategy::Task)
+        {
+            std::cout << "-persistent builds the tree with the team's task insert, ignoring -build" << std::endl;
+        }
+        else if (input.buildStrategy == Octree::BuildStrategy::Auto)
+        {
+            // the default file is optional, one given with -calibration is not
+            auto& calibration = BuildCalibration::getInstance();
+            std::string calibrationFile = input.calibrationFile;
+
+            if (calibrationFile.empty() && !tuned && std::filesystem::exists(BuildCalibration::DEFAULT_FILENAME))
+            {
+                calibrationFile = BuildCalibration::DEFAULT_FILENAME;
+            }
+
+            if (calibrationFile.empty())
+            {
+                if (!tuned)
+                {
+                    std::cout << "octree build auto: no " << BuildCalibration::DEFAULT_FILENAME << ", building hybrid with the default thresholds" << std::endl;
+                }
+            }
+            else
+            {
+                calibration.load(calibrationFile);
+
+                const auto row = calibration.lookup(Threading::numThreads());
+                std::cout << "octree build auto: serial insert up to " << row.parallelThresholdForInsert << " points, partitioning above ";
+                if (row.taskThreshold == std::numeric_limits<size_t>::max())
+                {
+                    std::cout << "never";
+                }
+                else
+                {
+                    std::cout << row.taskThreshold << " points";
+                }
+
+                std::cout << " (" << row.threads << " thread row of " << calibrationFile << ")" << std::endl;
+            }
+        }
+        else if (!input.calibrationFile.empty())
+        {
+            std::cout << "-calibration is only used with -build auto, ignoring it" << std::endl;
+        }
+
+        bh.setBuildStrategy(input.buildStrategy);
+        bh.setForceChunkSize(forceChunkSize);
+#ifdef PERF_PROFILE
+        if (input.persistent)
+        {
+            std::cout << "perf sections are not recorded with -persistent" << std::endl;
+        }
+#endif
+        bh.simulate();
+
+        std::cout << "peak rss " << peakRssMb() << " MB" << std::endl;
     }
     else
     {
-        std::cout << "Usage: ./b_hut -t A -l B -in particleConfig -out simulationName -p" << std::endl;
+        std::cout << "Usage: ./b_hut -t A -l B -in particleConfig -out simulationName -p -checkpoint C -cache D -perf_events E -perf_sample S -trace F -stats -roofline -persistent -build G -calibration H -tuning T -affinity P -replicate R" << std::endl;
+        std::cout << "       ./b_hut -restart checkpointFile -out simulationName -p -checkpoint C -l B" << std::endl;
+        std::cout << "       ./b_hut -tune N -in particleConfig -tuning T" << std::endl;
         std::cout << "A - time step (s)" << std::endl;
-        std::cout << "B - length of simulation (s)" << std::endl;
+        std::cout << "B - length of simulation (s), optional when restarting" << std::endl;
         std::cout << "particleConfig - particle config file for the simulation" << std::endl;
         std::cout << "simulationName - name to be assigned to this simulation... no spaces and file extension" << std::endl;
         std::cout << "-p - optional flag that turns on profiling for barnes hut" << std::endl;
+        std::cout << "C - optional, write simulationName.ckpt every C iterations (SIGTERM/SIGUSR1 always write one)" << std::endl;
+        std::cout << "checkpointFile - checkpoint to resume the simulation from" << std::endl;
+        std::cout << "-perf_events E - optional, perf events to count when built with perf profiling (presets default, memory, frontend, vectorization, event names or raw codes like r01c7, comma separated)" << std::endl;
+        std::cout << "-perf_sample S - optional, sample the instruction pointer every S cycles (S ns of task-clock without a pmu) in every perf section and report its hottest functions" << std::endl;
+        std::cout << "-cache D - optional, cache the parsed particle config in directory D (next to particleConfig if D is omitted)" << std::endl;
+        std::cout << "-stats - optional, write tree shape and interaction counts of every iteration to simulationName.stats.csv" << std::endl;
+        std::cout << "-roofline - optional, write flops, estimated bytes and gflop/s of the force calculation of every iteration with the machine peaks to simulationName.roofline.csv" << std::endl;
+        std::cout << "-persistent - optional, run the whole simulation loop in one parallel region instead of one per phase" << std::endl;
+        std::cout << "-build G - optional, octree build strategy serial, task (default, auto with a tuning), partition, hybrid, lockfree or auto (hybrid with the thresholds benchmark_octree measured on this machine)" << std::endl;
+        std::cout << "-calibration H - optional, calibration file for -build auto (" << BuildCalibration::DEFAULT_FILENAME << " in the working directory if it exists)" << std::endl;
+        std::cout << "-tune N - measure the fastest settings for this host on N particles of particleConfig (" << Tuning::DEFAULT_SAMPLE_SIZE << " if N is omitted) and write them to the tuning file" << std::endl;
+        std::cout << "-tuning T - optional, tuning file to write or use (" << Tuning::hostFilename() << " in the working directory if it exists), none to use the defaults (not with -tune)" << std::endl;
+        std::cout << "-affinity P - optional, bind every thread to one cpu, none (report where they run), close (fill one numa node after the other) or spread (round robin over the numa nodes)" << std::endl;
+        std::cout << "-replicate R - optional, copy the top R levels of every octree to each numa node the threads run on before the force calculation" << std::endl;
+        std::cout << "-trace F - optional, write a chrome trace of every thread to simulationName.trace.json keeping the last F events per thread (F is optional)" << std::endl;
     }
 
     return 0;
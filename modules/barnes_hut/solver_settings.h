@@ -0,0 +1,13 @@
+#pragma once
+
+#include <cstddef>
+
+// everything needed to reproduce a simulation besides the particle state
+struct SolverSettings
+{
+    double dt = 0.0;                            // seconds
+    double simulationLength = 0.0;              // seconds
+    double theta = 0.5;                         // barnes hut opening angle
+    size_t parallelThresholdForInsert = 1000;
+    size_t maxPointsPerNode = 1;
+};
@@ -0,0 +1,318 @@
+// tests/test_barnes_hut.cpp
+
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch_all.hpp>
+
+// expose internals for testing
+#define private public
+#define protected public
+#include "tuning.h"
+#include "barnes_hut.h"
+#include "checkpoint.h"
+#undef private
+#undef protected
+
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "spread_points.h"
+#include "topology.h"
+
+// nodes of the replica above levels are copies holding the values of the original, the
+// children at depth levels are the original nodes, returns the number of copies
+static size_t checkReplica(Octree::Node* replica, Octree::Node* original, size_t depth, size_t levels)
+{
+    if (depth == levels)
+    {
+        REQUIRE(replica == original);
+        return 0;
+    }
+
+    REQUIRE(replica != original);
+    REQUIRE(replica->boundingBox.center == original->boundingBox.center);
+    REQUIRE(replica->com == original->com);
+    REQUIRE(replica->totalMass == original->totalMass);
+    REQUIRE(replica->points == original->points);
+
+    size_t copies = 1;
+    for (size_t i = 0; i < 8; ++i)
+    {
+        REQUIRE((replica->octants[i] == nullptr) == (original->octants[i] == nullptr));
+
+        if (original->octants[i])
+        {
+            copies += checkReplica(replica->octants[i], original->octants[i], depth + 1, levels);
+        }
+    }
+
+    return copies;
+}
+
+static std::string tuningPath()
+{
+    return (std::filesystem::temp_directory_path() / "b_hut_tuning_test.txt").string();
+}
+
+static void writeTuning(const std::string& content)
+{
+    std::ofstream file(tuningPath());
+    file << content;
+}
+
+TEST_CASE("Tuning round trips through its file and picks the closest row")
+{
+    auto& tuning = Tuning::getInstance();
+    tuning.mRows.clear();
+
+    // no rows, the compiled in defaults
+    auto defaults = tuning.lookup(8);
+    REQUIRE(defaults.threads == 8);
+    REQUIRE(defaults.theta == SolverSettings{}.theta);
+    REQUIRE(defaults.maxPointsPerNode == SolverSettings{}.maxPointsPerNode);
+    REQUIRE(defaults.taskThreshold == THRESHOLD_FOR_TASK_BASED);
+    REQUIRE(defaults.forceChunkSize == BarnesHut::DEFAULT_FORCE_CHUNK_SIZE);
+
+    Tuning::Row few;
+    few.threads = 4;
+    few.taskThreshold = std::numeric_limits<size_t>::max();
+    few.forceChunkSize = 0;
+
+    Tuning::Row many;
+    many.threads = 36;
+    many.parallelThresholdForInsert = 10000;
+    many.taskThreshold = 200000;
+    many.maxPointsPerNode = 8;
+    many.theta = 0.65;
+    many.traversalWorkPerThread = 32;
+    many.forceChunkSize = 64;
+
+    Tuning::Row replaced = many;
+    replaced.threads = 18;
+    replaced.theta = 0.4;
+
+    tuning.setRow(many);
+    tuning.setRow(few);
+    tuning.setRow(replaced);
+    replaced.theta = 0.7;
+    tuning.setRow(replaced);
+
+    REQUIRE(tuning.rows().size() == 3);
+    REQUIRE(tuning.lookup(2).threads == 4);
+    REQUIRE(tuning.lookup(9).threads == 4);
+    REQUIRE(tuning.lookup(18).theta == 0.7);
+    REQUIRE(tuning.lookup(64).threads == 36);
+
+    tuning.save(tuningPath());
+    tuning.mRows.clear();
+    tuning.load(tuningPath());
+
+    REQUIRE(tuning.rows().size() == 3);
+
+    // never and static survive the file
+    auto loaded = tuning.lookup(4);
+    REQUIRE(loaded.taskThreshold == std::numeric_limits<size_t>::max());
+    REQUIRE(loaded.forceChunkSize == 0);
+
+    loaded = tuning.lookup(36);
+    REQUIRE(loaded.parallelThresholdForInsert == 10000);
+    REQUIRE(loaded.taskThreshold == 200000);
+    REQUIRE(loaded.maxPointsPerNode == 8);
+    REQUIRE(loaded.theta == 0.65);
+    REQUIRE(loaded.traversalWorkPerThread == 32);
+    REQUIRE(loaded.forceChunkSize == 64);
+
+    // comments and empty lines are skipped, a later row replaces one with the same threads
+    writeTuning("# threads insert_threshold task_threshold leaf_size theta traversal_work force_chunk\n\n"
+                "9 100 never 2 0.6 4 static\n9 1000 50000 4 0.5 8 16\n");
+    tuning.load(tuningPath());
+    REQUIRE(tuning.rows().size() == 1);
+    REQUIRE(tuning.lookup(9).maxPointsPerNode == 4);
+
+    tuning.mRows.clear();
+}
+
+TEST_CASE("Tuning rejects malformed rows")
+{
+    auto& tuning = Tuning::getInstance();
+
+    const std::string valid = "9 100 never 2 0.6 4 static\n";
+    writeTuning(valid);
+    REQUIRE_NOTHROW(tuning.load(tuningPath()));
+
+    for (const char* line : { "9 100 never 0 0.6 4 static",       // leaf size 0
+                              "9 100 never 2 0 4 static",         // theta 0
+                              "9 100 never 2 -0.5 4 static",      // negative theta
+                              "9 100 never 2 0.6 0 static",       // traversal work 0
+                              "9 100 never 2 0.6 4",              // missing column
+                              "9 100 never 2 0.6 4 static 1",     // extra column
+                              "9 -1 never 2 0.6 4 static",        // negative count
+                              "9 100 always 2 0.6 4 static",      // unknown threshold
+                              "9 100 never 2 0.6x 4 static",      // trailing characters
+                              "9 100 never 2 0.6 4 dynamic" })    // unknown chunk
+    {
+        writeTuning(valid + line + "\n");
+        REQUIRE_THROWS_AS(tuning.load(tuningPath()), std::runtime_error);
+    }
+
+    // a failed load keeps the rows
+    REQUIRE(tuning.rows().size() == 1);
+
+    REQUIRE_THROWS_AS(tuning.load(tuningPath() + ".missing"), std::runtime_error);
+
+    std::filesystem::remove(tuningPath());
+    tuning.mRows.clear();
+}
+
+TEST_CASE("Forces walked from replicated top levels match the original tree")
+{
+    std::vector<Particle*> particles = makeSpreadPoints(3000);
+    std::vector<std::unique_ptr<Particle>> owned(particles.begin(), particles.end());
+
+    SolverSettings settings;
+    settings.dt = 1.0;
+    settings.simulationLength = 1.0;
+    std::string name = "replication_test";
+
+    BarnesHut bh(particles, settings, name, false);
+
+    Octree tree(particles, Octree::BuildStrategy::Task, settings.parallelThresholdForInsert, settings.maxPointsPerNode);
+    bh.calculateCenterOfMass(tree.getLeafNodes());
+
+    auto forces = [&]()
+    {
+        for (auto* particle : particles) particle->mAppliedForce = {0.0, 0.0, 0.0};
+        bh.calculateForce<false>(tree.getLeafNodes(), tree.getRootNode());
+
+        std::vector<std::array<double, 3>> applied;
+        for (auto* particle : particles) applied.emplace_back(particle->mAppliedForce);
+        return applied;
+    };
+
+    const auto reference = forces();
+    const size_t nodes = tree.computeTreeStats().nodes;
+
+    // deeper than the tree copies all of it
+    for (size_t levels : { size_t(1), size_t(3), size_t(64) })
+    {
+        bh.setReplicatedLevels(levels);
+        bh.replicateTopLevels(tree.getRootNode());
+
+        REQUIRE(bh.mReplicaRoots.size() == Topology::getInstance().numNodes());
+
+        // this thread's node always has a thread of the backend
+        Octree::Node* replica = bh.mReplicaRoots[Topology::getInstance().currentNode()];
+        const size_t copies = checkReplica(replica, tree.getRootNode(), 0, levels);
+
+        REQUIRE(copies >= levels);
+        REQUIRE(copies <= nodes);
+        if (levels == 64) REQUIRE(copies == nodes);
+
+        // bit identical, the walk reads the same values in the same order
+        REQUIRE(forces() == reference);
+
+        bh.mReplicaRoots.clear();
+    }
+}
+
+TEST_CASE("Checkpoints read back every particle and setting bit for bit")
+{
+    const auto path = (std::filesystem::temp_directory_path() / "checkpoint_test.ckpt").string();
+    constexpr size_t N = 1001;
+
+    // values whose bits are easy to lose through a text or float conversion
+    ParticleStorage written;
+    written.allocate(N);
+    for (size_t i = 0; i < N; ++i)
+    {
+        Particle& particle = written[i];
+        const double x = static_cast<double>(i);
+
+        particle.mPosition = { x / 3.0, -x * 1e-300, std::nextafter(x, 1e9) };
+        particle.mVelocity = { -0.0, x * 7.1, std::numeric_limits<double>::denorm_min() * x };
+        particle.mAcceleration = { 1.0 / (x + 1.0), -x, x * x };
+        particle.mMass = 10.0 + x / 7.0;
+        particle.mId = N - i;
+    }
+
+    Checkpoint::State state;
+    state.iteration = 42;
+    state.settings.dt = 0.01;
+    state.settings.simulationLength = 1.0 / 3.0;
+    state.settings.theta = 0.65;
+    state.settings.parallelThresholdForInsert = 10000;
+    state.settings.maxPointsPerNode = 8;
+
+    std::vector<Particle*> particles = written.pointers();
+    Checkpoint::write(path, particles, state);
+
+    auto bits = [](double value) { return std::bit_cast<uint64_t>(value); };
+
+    ParticleStorage read;
+    Checkpoint::State readState;
+    Checkpoint::read(path, readState, read);
+
+    REQUIRE(read.size() == N);
+    REQUIRE(readState.iteration == 42);
+    REQUIRE(bits(readState.settings.dt) == bits(state.settings.dt));
+    REQUIRE(bits(readState.settings.simulationLength) == bits(state.settings.simulationLength));
+    REQUIRE(bits(readState.settings.theta) == bits(state.settings.theta));
+    REQUIRE(readState.settings.parallelThresholdForInsert == 10000);
+    REQUIRE(readState.settings.maxPointsPerNode == 8);
+
+    for (size_t i = 0; i < N; ++i)
+    {
+        const Particle& a = written[i];
+        const Particle& b = read[i];
+
+        for (size_t d = 0; d < 3; ++d)
+        {
+            REQUIRE(bits(b.mPosition[d]) == bits(a.mPosition[d]));
+            REQUIRE(bits(b.mVelocity[d]) == bits(a.mVelocity[d]));
+            REQUIRE(bits(b.mAcceleration[d]) == bits(a.mAcceleration[d]));
+        }
+
+        REQUIRE(bits(b.mMass) == bits(a.mMass));
+        REQUIRE(b.mId == a.mId);
+    }
+
+    // damaged files are rejected instead of restarting from garbage
+    auto damaged = [&](auto damage)
+    {
+        Checkpoint::write(path, particles, state);
+        damage();
+
+        ParticleStorage storage;
+        Checkpoint::State ignored;
+        REQUIRE_THROWS_AS(Checkpoint::read(path, ignored, storage), std::runtime_error);
+    };
+
+    damaged([&]() { std::filesystem::resize_file(path, std::filesystem::file_size(path) - sizeof(uint64_t)); });
+
+    damaged([&]()
+    {
+        std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(0);
+        file.write("XBODYCK", 7);
+    });
+
+    damaged([&]()
+    {
+        const uint32_t version = Checkpoint::VERSION + 1;
+        std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+        file.seekp(offsetof(Checkpoint::Header, version));
+        file.write(reinterpret_cast<const char*>(&version), sizeof(version));
+    });
+
+    // a file shorter than the header
+    damaged([&]() { std::filesystem::resize_file(path, sizeof(Checkpoint::Header) / 2); });
+
+    std::filesystem::remove(path);
+}
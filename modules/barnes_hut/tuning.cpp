@@ -0,0 +1,373 @@
+#include "tuning.h"
+#include "build_calibration.h"
+#include "row_file.h"
+#include "threading.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+
+#include <unistd.h>
+
+namespace
+{
+    constexpr size_t NEVER = std::numeric_limits<size_t>::max();
+
+    // every step is measured this often, the fastest run counts
+    constexpr int REPETITIONS = 3;
+
+    // particles whose forces are compared against a direct sum
+    constexpr size_t NUM_PROBES = 128;
+
+    std::string forceChunkName(size_t chunkSize)
+    {
+        return chunkSize == 0 ? "static" : std::to_string(chunkSize);
+    }
+
+    std::string milliseconds(double ms)
+    {
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(3) << ms << " ms";
+        return out.str();
+    }
+
+    void setCalibration(const Tuning::Row& row)
+    {
+        BuildCalibration::Row calibration;
+        calibration.threads = row.threads;
+        calibration.parallelThresholdForInsert = row.parallelThresholdForInsert;
+        calibration.taskThreshold = row.taskThreshold;
+        calibration.traversalWorkPerThread = row.traversalWorkPerThread;
+        BuildCalibration::getInstance().setRow(calibration);
+    }
+
+    // a single iteration so the data store stays small, nothing is simulated
+    SolverSettings runnerSettings()
+    {
+        SolverSettings settings;
+        settings.dt = 1.0;
+        settings.simulationLength = 1.0;
+        return settings;
+    }
+
+    // runs the knobs of row on the sample, the forces of the last run are left in the particles
+    //
+    // one BarnesHut for every candidate, so a perf profiling build opens its sections once
+    class StepRunner
+    {
+    public:
+        explicit StepRunner(std::vector<Particle*>& sample)
+            : mSample(sample)
+            , mSettings(runnerSettings())
+            , mBarnesHut(mSample, mSettings, mName, false)
+        {
+            mBarnesHut.setBuildStrategy(Octree::BuildStrategy::Auto);
+        }
+
+        BarnesHut::StepTimes measure(const Tuning::Row& row)
+        {
+            // the build thresholds reach the octree through its calibration
+            setCalibration(row);
+
+            mBarnesHut.setTreeSettings(row.theta, row.maxPointsPerNode, row.parallelThresholdForInsert);
+            mBarnesHut.setForceChunkSize(row.forceChunkSize);
+
+            BarnesHut::StepTimes best;
+            best.buildMs = best.centerOfMassMs = best.forceMs = std::numeric_limits<double>::max();
+
+            for (int rep = 0; rep < REPETITIONS; ++rep)
+            {
+                for (auto* particle : mSample)
+                {
+                    particle->mAppliedForce = {0.0, 0.0, 0.0};
+                }
+
+                auto times = mBarnesHut.measureStep();
+                best.buildMs = std::min(best.buildMs, times.buildMs);
+                best.centerOfMassMs = std::min(best.centerOfMassMs, times.centerOfMassMs);
+                best.forceMs = std::min(best.forceMs, times.forceMs);
+            }
+
+            return best;
+        }
+
+    private:
+        std::vector<Particle*>& mSample;
+        std::string mName = "tuning";
+        SolverSettings mSettings;
+        BarnesHut mBarnesHut;
+    };
+}
+
+Tuning& Tuning::getInstance()
+{
+    static Tuning instance;
+    return instance;
+}
+
+std::string Tuning::hostFilename()
+{
+    char host[256] = {};
+    if (gethostname(host, sizeof(host) - 1) != 0 || host[0] == '\0')
+    {
+        return "b_hut_tuning.txt";
+    }
+
+    return std::string("b_hut_tuning.") + host + ".txt";
+}
+
+void Tuning::load(const std::string& filename)
+{
+    auto rows = RowFile::read<Row>(filename, "b_hut tuning", [](const std::vector<std::string>& fields)
+    {
+        if (fields.size() != 7)
+        {
+            throw std::invalid_argument("columns");
+        }
+
+        Row row;
+        row.threads = RowFile::parseCount(fields[0]);
+        row.parallelThresholdForInsert = RowFile::parseCount(fields[1]);
+        row.taskThreshold = RowFile::parseThreshold(fields[2]);
+        row.maxPointsPerNode = RowFile::parseCount(fields[3]);
+        row.theta = RowFile::parseReal(fields[4]);
+        row.traversalWorkPerThread = RowFile::parseCount(fields[5]);
+        row.forceChunkSize = fields[6] == "static" ? 0 : RowFile::parseCount(fields[6]);
+
+        if (row.maxPointsPerNode == 0 || row.traversalWorkPerThread == 0 || !(row.theta > 0.0))
+        {
+            throw std::invalid_argument("values");
+        }
+
+        return row;
+    });
+
+    mRows.clear();
+    for (const auto& row : rows)
+    {
+        setRow(row);
+    }
+}
+
+void Tuning::save(const std::string& filename) const
+{
+    RowFile::write(filename, "b_hut tuning",
+                   { "b_hut tuning written by b_hut -tune",
+                     "threads insert_threshold task_threshold leaf_size theta traversal_work force_chunk" },
+                   mRows, [](std::ostream& out, const Row& row)
+    {
+        out << row.threads << " " << row.parallelThresholdForInsert << " " << RowFile::thresholdName(row.taskThreshold)
+            << " " << row.maxPointsPerNode << " " << row.theta << " " << row.traversalWorkPerThread
+            << " " << forceChunkName(row.forceChunkSize);
+    });
+}
+
+void Tuning::setRow(const Row& row)
+{
+    RowFile::setRow(mRows, row);
+}
+
+Tuning::Row Tuning::lookup(size_t threads) const
+{
+    return RowFile::lookup(mRows, threads);
+}
+
+Tuning::Row Tuning::tune(const std::vector<Particle*>& particles, size_t sampleSize)
+{
+    if (particles.empty())
+    {
+        throw std::runtime_error("trying to tune with 0 particles");
+    }
+
+    // copies renumbered for the sample, the input is not touched
+    std::vector<Particle*> picked;
+    std::sample(particles.begin(), particles.end(), std::back_inserter(picked),
+                std::min(sampleSize, particles.size()), std::mt19937_64(587));
+
+    std::vector<std::unique_ptr<Particle>> owned;
+    std::vector<Particle*> sample;
+    for (size_t i = 0; i < picked.size(); ++i)
+    {
+        owned.emplace_back(std::make_unique<Particle>(*picked[i]));
+        owned.back()->mId = i;
+        owned.back()->mAppliedForce = {0.0, 0.0, 0.0};
+        sample.emplace_back(owned.back().get());
+    }
+
+    std::cout << "tuning on " << sample.size() << " of " << particles.size() << " particles with "
+              << Threading::numThreads() << " threads" << std::endl;
+
+    // direct sums for the probes, the reference of the force error
+    const size_t stride = std::max<size_t>(sample.size() / NUM_PROBES, 1);
+    std::vector<size_t> probes;
+    for (size_t i = 0; i < sample.size() && probes.size() < NUM_PROBES; i += stride)
+    {
+        probes.emplace_back(i);
+    }
+
+    std::vector<std::array<double, 3>> direct(probes.size());
+    Threading::parallelFor(0, probes.size(), 1, [&](size_t first, size_t last)
+    {
+        for (size_t k = first; k < last; ++k)
+        {
+            Particle probe(*sample[probes[k]]);
+            probe.mAppliedForce = {0.0, 0.0, 0.0};
+
+            for (auto*& other : sample)
+            {
+                if (other->mId != probe.mId) probe.applyForce(other);
+            }
+
+            direct[k] = probe.mAppliedForce;
+        }
+    });
+
+    // mean relative error of the probes' forces of the last step
+    auto forceError = [&]()
+    {
+        double sum = 0.0;
+        for (size_t k = 0; k < probes.size(); ++k)
+        {
+            const auto& force = sample[probes[k]]->mAppliedForce;
+            const double dx = force[0] - direct[k][0];
+            const double dy = force[1] - direct[k][1];
+            const double dz = force[2] - direct[k][2];
+            const double reference = std::sqrt(direct[k][0] * direct[k][0] + direct[k][1] * direct[k][1] + direct[k][2] * direct[k][2]);
+
+            sum += reference > 0.0 ? std::sqrt(dx * dx + dy * dy + dz * dz) / reference : 0.0;
+        }
+
+        return sum / static_cast<double>(probes.size());
+    };
+
+    StepRunner runner(sample);
+
+    Row best;
+    best.threads = Threading::numThreads();
+
+    auto stepMs = [](const BarnesHut::StepTimes& times)
+    {
+        return times.buildMs + times.centerOfMassMs + times.forceMs;
+    };
+
+    // theta and leaf size change the result, no faster pair may be less accurate than the defaults
+    {
+        runner.measure(best);
+        const double budget = forceError();
+        double bestMs = std::numeric_limits<double>::max();
+
+        std::cout << "theta and leaf size (force error budget " << budget << ")" << std::endl;
+
+        for (double theta : { 0.4, 0.5, 0.6, 0.7, 0.8 })
+        {
+            for (size_t leafSize : { 1, 2, 4, 8, 16 })
+            {
+                Row row = best;
+                row.theta = theta;
+                row.maxPointsPerNode = leafSize;
+
+                const double ms = stepMs(runner.measure(row));
+                const double error = forceError();
+                const bool accurate = error <= budget;
+
+                std::cout << "    theta " << theta << " leaf " << std::setw(2) << leafSize << ": " << milliseconds(ms)
+                          << ", error " << error << (accurate ? "" : " (over budget)") << std::endl;
+
+                if (accurate && ms < bestMs)
+                {
+                    bestMs = ms;
+                    best = row;
+                }
+            }
+        }
+    }
+
+    std::cout << "insert and task threshold" << std::endl;
+    {
+        Row current = best;
+        double bestMs = std::numeric_limits<double>::max();
+
+        for (size_t insertThreshold : { 10, 100, 1000, 10000 })
+        {
+            // partitioning everything above the serial inserts is the first candidate
+            std::vector<size_t> candidates = { insertThreshold };
+            for (size_t taskThreshold : { size_t(10000), size_t(50000), size_t(200000), NEVER })
+            {
+                if (taskThreshold > insertThreshold) candidates.emplace_back(taskThreshold);
+            }
+
+            for (size_t taskThreshold : candidates)
+            {
+                Row row = current;
+                row.parallelThresholdForInsert = insertThreshold;
+                row.taskThreshold = taskThreshold;
+
+                const double ms = runner.measure(row).buildMs;
+
+                std::cout << "    insert " << std::setw(5) << insertThreshold << " task " << std::setw(6) << RowFile::thresholdName(taskThreshold)
+                          << ": " << milliseconds(ms) << std::endl;
+
+                if (ms < bestMs)
+                {
+                    bestMs = ms;
+                    best = row;
+                }
+            }
+        }
+    }
+
+    std::cout << "traversal work per thread" << std::endl;
+    {
+        Row current = best;
+        double bestMs = std::numeric_limits<double>::max();
+
+        for (size_t traversalWork : { 1, 2, 4, 8, 16, 32 })
+        {
+            Row row = current;
+            row.traversalWorkPerThread = traversalWork;
+
+            const double ms = runner.measure(row).buildMs;
+
+            std::cout << "    " << std::setw(2) << traversalWork << ": " << milliseconds(ms) << std::endl;
+
+            if (ms < bestMs)
+            {
+                bestMs = ms;
+                best = row;
+            }
+        }
+    }
+
+    std::cout << "force chunk size" << std::endl;
+    {
+        Row current = best;
+        double bestMs = std::numeric_limits<double>::max();
+
+        for (size_t chunkSize : { 0, 1, 4, 16, 64, 256 })
+        {
+            Row row = current;
+            row.forceChunkSize = chunkSize;
+
+            const double ms = runner.measure(row).forceMs;
+
+            std::cout << "    " << std::setw(6) << forceChunkName(chunkSize) << ": " << milliseconds(ms) << std::endl;
+
+            if (ms < bestMs)
+            {
+                bestMs = ms;
+                best = row;
+            }
+        }
+    }
+
+    // the sweeps leave their last candidate in the calibration
+    setCalibration(best);
+
+    return best;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "octree.h"
+#include "particle.h"
+#include "solver_settings.h"
+#include "barnes_hut.h"
+
+// performance knobs of b_hut measured on one host by b_hut -tune, one row per thread count,
+// later runs on the host load the row closest to their thread count
+//
+// the file is plain text, a row per line after # comments:
+//     threads insert_threshold task_threshold leaf_size theta traversal_work force_chunk
+// task_threshold is "never" if partitioning never paid off, force_chunk "static" for one
+// chunk per thread
+class Tuning
+{
+public:
+    // particles b_hut -tune measures on unless given a sample size
+    static constexpr size_t DEFAULT_SAMPLE_SIZE = 200000;
+
+    struct Row
+    {
+        size_t threads = 0;
+
+        // SolverSettings, stored in checkpoints
+        size_t parallelThresholdForInsert = SolverSettings{}.parallelThresholdForInsert;
+        size_t maxPointsPerNode = SolverSettings{}.maxPointsPerNode;
+        double theta = SolverSettings{}.theta;
+
+        // only change how fast a step is computed (BuildCalibration and BarnesHut)
+        size_t taskThreshold = THRESHOLD_FOR_TASK_BASED;
+        size_t traversalWorkPerThread = TRAVERSAL_WORK_PER_THREAD;
+        size_t forceChunkSize = BarnesHut::DEFAULT_FORCE_CHUNK_SIZE;
+    };
+
+    static Tuning& getInstance();
+
+    // b_hut_tuning.<host name>.txt
+    static std::string hostFilename();
+
+    // replaces the rows, throws if the file can not be read or a line is malformed
+    void load(const std::string& filename);
+
+    void save(const std::string& filename) const;
+
+    // adds the row or replaces the one with the same thread count
+    void setRow(const Row& row);
+
+    // the row with the most threads not above threads (the one with the fewest if all are
+    // above), the defaults if there is none
+    Row lookup(size_t threads) const;
+
+    inline const std::vector<Row>& rows() const
+    {
+        return mRows;
+    }
+
+    // short sweeps of every knob on a random sample of at most sampleSize particles, one
+    // knob after the other with the best of the previous ones:
+    //  - theta and leaf size, the fastest step whose force error on probe particles is not
+    //    above the error of the defaults
+    //  - insert and task threshold, the fastest octree build (BuildStrategy::Auto)
+    //  - traversal work, the fastest octree build
+    //  - force chunk size, the fastest force calculation
+    static Row tune(const std::vector<Particle*>& particles, size_t sampleSize);
+
+private:
+    Tuning() = default;
+
+    std::vector<Row> mRows;     // ascending threads
+};
@@ -0,0 +1,62 @@
+#include "build_calibration.h"
+#include "row_file.h"
+
+#include <stdexcept>
+
+BuildCalibration& BuildCalibration::getInstance()
+{
+    static BuildCalibration instance;
+    return instance;
+}
+
+void BuildCalibration::load(const std::string& filename)
+{
+    auto rows = RowFile::read<Row>(filename, "octree calibration", [](const std::vector<std::string>& fields)
+    {
+        // files written before the traversal was calibrated have three columns
+        if (fields.size() != 3 && fields.size() != 4)
+        {
+            throw std::invalid_argument("columns");
+        }
+
+        Row row;
+        row.threads = RowFile::parseCount(fields[0]);
+        row.parallelThresholdForInsert = RowFile::parseCount(fields[1]);
+        row.taskThreshold = RowFile::parseThreshold(fields[2]);
+
+        if (fields.size() == 4)
+        {
+            row.traversalWorkPerThread = RowFile::parseCount(fields[3]);
+        }
+
+        return row;
+    });
+
+    mRows.clear();
+    for (const auto& row : rows)
+    {
+        setRow(row);
+    }
+}
+
+void BuildCalibration::save(const std::string& filename) const
+{
+    RowFile::write(filename, "octree calibration",
+                   { "octree build calibration written by benchmark_octree",
+                     "threads insert_threshold task_threshold traversal_work" },
+                   mRows, [](std::ostream& out, const Row& row)
+    {
+        out << row.threads << " " << row.parallelThresholdForInsert << " " << RowFile::thresholdName(row.taskThreshold)
+            << " " << row.traversalWorkPerThread;
+    });
+}
+
+void BuildCalibration::setRow(const Row& row)
+{
+    RowFile::setRow(mRows, row);
+}
+
+BuildCalibration::Row BuildCalibration::lookup(size_t threads) const
+{
+    return RowFile::lookup(mRows, threads);
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "octree.h"
+
+// crossover points between the octree insert strategies measured on one machine by
+// benchmark_octree, one row per thread count, BuildStrategy::Auto builds with the row
+// measured closest to the number of threads it runs with
+//
+// the file is plain text, a row per line after # comments:
+//     threads insert_threshold task_threshold [traversal_work]
+// task_threshold is "never" if partitioning never paid off
+class BuildCalibration
+{
+public:
+    static constexpr const char* DEFAULT_FILENAME = "octree_calibration.txt";
+
+    struct Row
+    {
+        size_t threads = 0;
+
+        // nodes with at most this many points are inserted serially
+        size_t parallelThresholdForInsert = PARALLEL_THRESHOLD_FOR_INSERT;
+
+        // nodes with more points are partitioned by all threads, the rest is inserted by
+        // insertParallel tasks
+        size_t taskThreshold = THRESHOLD_FOR_TASK_BASED;
+
+        // subtrees per thread the leaf list search is split into
+        size_t traversalWorkPerThread = TRAVERSAL_WORK_PER_THREAD;
+    };
+
+    static BuildCalibration& getInstance();
+
+    // replaces the rows, throws if the file can not be read or a line is malformed
+    void load(const std::string& filename);
+
+    void save(const std::string& filename) const;
+
+    // adds the row or replaces the one with the same thread count
+    void setRow(const Row& row);
+
+    // the row with the most threads not above threads (the one with the fewest if all are
+    // above), the defaults if there is none
+    Row lookup(size_t threads) const;
+
+    inline const std::vector<Row>& rows() const
+    {
+        return mRows;
+    }
+
+private:
+    BuildCalibration() = default;
+
+    std::vector<Row> mRows;     // ascending threads
+};
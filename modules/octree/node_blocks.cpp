@@ -0,0 +1,63 @@
+#include "node_blocks.h"
+#include "topology.h"
+
+#include <new>
+
+#include <sys/mman.h>
+
+NodeBlocks& NodeBlocks::getInstance()
+{
+    static NodeBlocks instance;
+    return instance;
+}
+
+NodeBlocks::NodeBlocks()
+{
+    for (size_t node = 0; node < Topology::getInstance().numNodes(); ++node)
+    {
+        mFree.emplace_back(std::make_unique<FreeList>());
+    }
+}
+
+NodeBlocks::Block* NodeBlocks::acquire()
+{
+    const size_t node = Topology::getInstance().currentNode() % mFree.size();
+
+    {
+        auto& free = *mFree[node];
+        std::lock_guard<std::mutex> lock(free.mutex);
+
+        if (!free.blocks.empty())
+        {
+            Block* block = free.blocks.back();
+            free.blocks.pop_back();
+            return block;
+        }
+    }
+
+    // fresh pages, malloc could hand out memory another node touched first
+    void* memory = mmap(nullptr, BLOCK_BYTES, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED)
+    {
+        throw std::bad_alloc();
+    }
+
+    mNumBlocks.fetch_add(1, std::memory_order_relaxed);
+
+    Block* block = new (memory) Block();
+    block->numaNode = node;
+
+    return block;
+}
+
+void NodeBlocks::release(const std::vector<Block*>& blocks)
+{
+    for (auto* block : blocks)
+    {
+        block->used = 0;
+
+        auto& free = *mFree[block->numaNode];
+        std::lock_guard<std::mutex> lock(free.mutex);
+        free.blocks.emplace_back(block);
+    }
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// memory for octree nodes in fixed size blocks, a block is mapped and first touched by
+// the thread that needs it and is only handed out again on the same numa node, so the
+// nodes a thread creates stay on its socket from one tree to the next
+class NodeBlocks
+{
+public:
+    static constexpr size_t BLOCK_BYTES = 256 * 1024;
+
+    // the objects of a block start a cache line after the header
+    static constexpr size_t PAYLOAD_OFFSET = 64;
+
+    struct Block
+    {
+        size_t numaNode = 0;
+        size_t used = 0;        // objects handed out, only written by the thread filling the block
+    };
+
+    static NodeBlocks& getInstance();
+
+    static inline void* payload(Block* block)
+    {
+        return reinterpret_cast<char*>(block) + PAYLOAD_OFFSET;
+    }
+
+    // an empty block placed on the calling thread's numa node
+    Block* acquire();
+
+    // the blocks go back to the nodes they were placed on
+    void release(const std::vector<Block*>& blocks);
+
+    // a new id for every owner of blocks (a tree), so a thread can tell the block it is
+    // filling for the current owner from one it filled for a previous one
+    inline uint64_t nextOwnerId()
+    {
+        return mNextOwnerId.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // mapped so far, blocks are kept for reuse and never unmapped
+    inline size_t numBlocks() const
+    {
+        return mNumBlocks.load(std::memory_order_relaxed);
+    }
+
+private:
+    NodeBlocks();
+
+    struct FreeList
+    {
+        std::mutex mutex;
+        std::vector<Block*> blocks;
+    };
+
+    std::vector<std::unique_ptr<FreeList>> mFree;     // [numa node]
+    std::atomic<size_t> mNumBlocks{0};
+    std::atomic<uint64_t> mNextOwnerId{1};
+};
@@ -2,36 +2,55 @@
 
 #include <stdexcept>
 #include <limits> 
+#include <algorithm>
 #include <omp.h>
-#include <chrono>
 #include <cstring>
+#include <cstdint>
 #include <atomic>
+#include <new>
+#include <thread>
+
+#include "build_calibration.h"
+#include "profiler.h"
+#include "threading.h"
 
 namespace
 {
-class ScopedTimer
-{
-public:
-    ScopedTimer(double& out)
-        : mStart(std::chrono::steady_clock::now())
-        , mOut(out)
-    {}
+#ifdef PERF_PROFILE
+    // deferred trees do not record perf sections
+    std::unique_ptr<PerfSection> noSection;
+#endif
+
+    // while a tree is built lock free a child slot is empty, an interior node, a leaf
+    // (tagged in the low bit, nodes are at least 8 byte aligned) or claimed by a thread
+    // that is appending to or splitting the leaf that was in it
+    Octree::Node* const SLOT_IN_PROGRESS = reinterpret_cast<Octree::Node*>(uintptr_t(2));
 
-    ~ScopedTimer()
+    inline bool isTaggedLeaf(Octree::Node* slot)
     {
-        auto end = std::chrono::steady_clock::now();
+        return reinterpret_cast<uintptr_t>(slot) & uintptr_t(1);
+    }
 
-        std::chrono::duration<double, std::milli> elapsed_ms = end - mStart;
+    inline Octree::Node* tagLeaf(Octree::Node* leaf)
+    {
+        return reinterpret_cast<Octree::Node*>(reinterpret_cast<uintptr_t>(leaf) | uintptr_t(1));
+    }
 
-        mOut = elapsed_ms.count();
+    inline Octree::Node* untagLeaf(Octree::Node* slot)
+    {
+        return reinterpret_cast<Octree::Node*>(reinterpret_cast<uintptr_t>(slot) & ~uintptr_t(1));
     }
 
-private:
-    ScopedTimer() = default;
+    constexpr size_t NODES_PER_BLOCK = (NodeBlocks::BLOCK_BYTES - NodeBlocks::PAYLOAD_OFFSET) / sizeof(Octree::Node);
 
-    std::chrono::steady_clock::time_point mStart;
-    double& mOut;
-};
+    // the block a thread is filling and the tree it belongs to
+    struct BlockCursor
+    {
+        uint64_t ownerId = 0;
+        NodeBlocks::Block* block = nullptr;
+    };
+
+    thread_local BlockCursor blockCursor;
 }
 
 #ifdef PERF_PROFILE
@@ -41,7 +60,19 @@ Octree::Octree(std::vector<Particle*>& points,
                std::unique_ptr<PerfSection>& leaf,
                bool supportMultithread,
                size_t parallelThresholdForInsert, size_t maxPointsPerNode)
-    : mSupportMultithread(supportMultithread)
+    : Octree(points, bbox, insrt, leaf,
+             supportMultithread ? BuildStrategy::Task : BuildStrategy::Serial,
+             parallelThresholdForInsert, maxPointsPerNode)
+{
+}
+
+Octree::Octree(std::vector<Particle*>& points,
+               std::unique_ptr<PerfSection>& bbox,
+               std::unique_ptr<PerfSection>& insrt,
+               std::unique_ptr<PerfSection>& leaf,
+               BuildStrategy strategy,
+               size_t parallelThresholdForInsert, size_t maxPointsPerNode)
+    : mStrategy(strategy)
     , mMaxPointsPerNode(maxPointsPerNode)
     , mParallelThresholdForInsert(parallelThresholdForInsert)
     , mBbox(bbox)
@@ -50,7 +81,14 @@ Octree::Octree(std::vector<Particle*>& points,
 #else
 Octree::Octree(std::vector<Particle*>& points, bool supportMultithread, 
                size_t parallelThresholdForInsert, size_t maxPointsPerNode) 
-    : mSupportMultithread(supportMultithread)
+    : Octree(points, supportMultithread ? BuildStrategy::Task : BuildStrategy::Serial,
+             parallelThresholdForInsert, maxPointsPerNode)
+{
+}
+
+Octree::Octree(std::vector<Particle*>& points, BuildStrategy strategy,
+               size_t parallelThresholdForInsert, size_t maxPointsPerNode)
+    : mStrategy(strategy)
     , mMaxPointsPerNode(maxPointsPerNode)
     , mParallelThresholdForInsert(parallelThresholdForInsert)
 #endif
@@ -59,12 +97,28 @@ Octree::Octree(std::vector<Particle*>& points, bool supportMultithread,
     {
         throw std::runtime_error("trying to init octree with 0 points");
     }
+
+    // without a calibration auto is hybrid with the caller's insert threshold
+    if (mStrategy == BuildStrategy::Auto && !BuildCalibration::getInstance().rows().empty())
+    {
+        const auto row = BuildCalibration::getInstance().lookup(Threading::numThreads());
+        mParallelThresholdForInsert = row.parallelThresholdForInsert;
+        mTaskThreshold = row.taskThreshold;
+        mTraversalWorkPerThread = std::max<size_t>(row.traversalWorkPerThread, 1);
+    }
+    else if (mStrategy == BuildStrategy::Partition)
+    {
+        mTaskThreshold = mParallelThresholdForInsert;
+    }
+
+    // a node partitioned by all threads is always above the serial insert threshold
+    mTaskThreshold = std::max(mTaskThreshold, mParallelThresholdForInsert);
     
     {
 #ifdef PERF_PROFILE
         mBbox->start();
 #endif
-        ScopedTimer timer(mProfileData[0]);
+        PROFILE_REGION("compute bounding box");
         mRoot->boundingBox = computeBoundingBox(points);
 #ifdef PERF_PROFILE
       mBbox->stop();  
@@ -75,24 +129,31 @@ Octree::Octree(std::vector<Particle*>& points, bool supportMultithread,
 #ifdef PERF_PROFILE
         mInsert->start();
 #endif
-        ScopedTimer timer(mProfileData[1]);
-        if (mSupportMultithread)
+        PROFILE_REGION("insert points");
+        switch (mStrategy)
         {
-            mRoot->points.insert(mRoot->points.end(), points.begin(), points.end());
-            #pragma omp parallel
-            {
-                #pragma omp single
+            case BuildStrategy::Serial:
+                for (auto& point : points)
                 {
-                    insertParallel(mRoot);
+                    insert(mRoot, point);
                 }
-            }
-        }
-        else
-        {
-            for (auto& point : points)
-            {
-                insert(mRoot, point);
-            }
+                break;
+
+            case BuildStrategy::Task:
+                mRoot->points.insert(mRoot->points.end(), points.begin(), points.end());
+                Threading::runTasks([this]() { insertParallel(mRoot); });
+                break;
+
+            case BuildStrategy::Partition:
+            case BuildStrategy::Hybrid:
+            case BuildStrategy::Auto:
+                mRoot->points.insert(mRoot->points.end(), points.begin(), points.end());
+                hybridParallelInsert(mRoot);
+                break;
+
+            case BuildStrategy::LockFree:
+                buildLockFree(points);
+                break;
         }
 #ifdef PERF_PROFILE
       mInsert->stop();  
@@ -103,7 +164,7 @@ Octree::Octree(std::vector<Particle*>& points, bool supportMultithread,
 #ifdef PERF_PROFILE
         mLeaf->start();  
 #endif
-        ScopedTimer timer(mProfileData[2]);
+        PROFILE_REGION("generate leaf nodes");
         generateLeafNodeList(mRoot);
 #ifdef PERF_PROFILE
       mLeaf->stop();  
@@ -111,9 +172,150 @@ Octree::Octree(std::vector<Particle*>& points, bool supportMultithread,
     }
 }
 
+Octree::Octree(Deferred, const std::vector<Particle*>& points, size_t parallelThresholdForInsert, size_t maxPointsPerNode)
+    : mStrategy(BuildStrategy::Task)
+    , mMaxPointsPerNode(maxPointsPerNode)
+    , mParallelThresholdForInsert(parallelThresholdForInsert)
+#ifdef PERF_PROFILE
+    , mBbox(noSection)
+    , mInsert(noSection)
+    , mLeaf(noSection)
+#endif
+{
+    if (points.size() == 0)
+    {
+        throw std::runtime_error("trying to init octree with 0 points");
+    }
+}
+
+void Octree::buildInTeam(std::vector<Particle*>& points)
+{
+    const size_t tid = omp_get_thread_num();
+
+    #pragma omp single
+    {
+        mTeamBounds.resize(omp_get_num_threads());
+        mTeamLeafs.resize(omp_get_num_threads());
+    }
+
+    {
+        PROFILE_REGION("compute bounding box");
+
+        std::array<double, 6> bounds = { std::numeric_limits<double>::infinity(),
+                                         std::numeric_limits<double>::infinity(),
+                                         std::numeric_limits<double>::infinity(),
+                                         -std::numeric_limits<double>::infinity(),
+                                         -std::numeric_limits<double>::infinity(),
+                                         -std::numeric_limits<double>::infinity() };
+
+        {
+            TRACE_SCOPE("compute bounding box");
+
+            #pragma omp for nowait
+            for (size_t i = 0; i < points.size(); ++i)
+            {
+                const auto* pos = points[i]->mPosition.data();
+
+                for (size_t axis = 0; axis < 3; ++axis)
+                {
+                    bounds[axis] = std::min(bounds[axis], pos[axis]);
+                    bounds[axis + 3] = std::max(bounds[axis + 3], pos[axis]);
+                }
+            }
+        }
+
+        mTeamBounds[tid] = bounds;
+
+        #pragma omp barrier
+    }
+
+    // the tasks spawned by the single thread are run by the rest of the team waiting at its barrier
+    {
+        PROFILE_REGION("insert points");
+
+        #pragma omp single
+        {
+            std::array<double, 6> bounds = mTeamBounds[0];
+            for (const auto& local : mTeamBounds)
+            {
+                for (size_t axis = 0; axis < 3; ++axis)
+                {
+                    bounds[axis] = std::min(bounds[axis], local[axis]);
+                    bounds[axis + 3] = std::max(bounds[axis + 3], local[axis + 3]);
+                }
+            }
+
+            double sideLength = std::max(bounds[3] - bounds[0], std::max(bounds[4] - bounds[1], bounds[5] - bounds[2]));
+
+            // same box as computeBoundingBox
+            BoundingBox& box = mRoot->boundingBox;
+            box.halfOfSideLength = sideLength / 2.0;
+            box.center[0] = box.halfOfSideLength + bounds[0];
+            box.center[1] = box.halfOfSideLength + bounds[1];
+            box.center[2] = box.halfOfSideLength + bounds[2];
+            box.halfOfSideLength += std::max(1e-9, 0.001 * 0.5 * sideLength);
+
+            mRoot->points.insert(mRoot->points.end(), points.begin(), points.end());
+            insertParallel(mRoot);
+
+            generateWorkForTreeTraversal(mTeamBfs);
+        }
+    }
+
+    {
+        PROFILE_REGION("generate leaf nodes");
+
+        #pragma omp for schedule(dynamic) nowait
+        for (size_t i = 0; i < mTeamBfs.size(); ++i)
+        {
+            TRACE_SCOPE("leaf search subtree");
+            dfsLeafNodeSearch(mTeamBfs[i], mTeamLeafs[tid]);
+        }
+
+        #pragma omp barrier
+
+        #pragma omp single
+        {
+            for (auto& local : mTeamLeafs)
+            {
+                mLeafNodes.insert(mLeafNodes.end(), local.begin(), local.end());
+                local.clear();
+            }
+        }
+    }
+}
+
 Octree::~Octree()
 {
     freeNode(mRoot);
+
+    for (auto* block : mBlocks)
+    {
+        Node* nodes = static_cast<Node*>(NodeBlocks::payload(block));
+        for (size_t i = 0; i < block->used; ++i)
+        {
+            nodes[i].~Node();
+        }
+    }
+
+    NodeBlocks::getInstance().release(mBlocks);
+}
+
+Octree::Node* Octree::createNode()
+{
+    auto& cursor = blockCursor;
+
+    if (cursor.ownerId != mBlocksOwnerId || cursor.block->used == NODES_PER_BLOCK)
+    {
+        cursor.block = NodeBlocks::getInstance().acquire();
+        cursor.ownerId = mBlocksOwnerId;
+
+        std::lock_guard<std::mutex> lock(mBlocksMutex);
+        mBlocks.emplace_back(cursor.block);
+    }
+
+    Node* nodes = static_cast<Node*>(NodeBlocks::payload(cursor.block));
+    return new (nodes + cursor.block->used++) Node();
 }
 
 void Octree::freeNode(Node*& node)
@@ -127,7 +329,6 @@ void Octree::freeNode(Node*& node)
         {
             isLeaf = false;
             freeNode(octant);
-            delete octant;
         }
     }
 
@@ -142,27 +343,49 @@ void Octree::freeNode(Node*& node)
 
 Octree::BoundingBox Octree::computeBoundingBox(std::vector<Particle*>& points)
 { 
-    double minX = std::numeric_limits<double>::infinity();
-    double minY = std::numeric_limits<double>::infinity();
-    double minZ = std::numeric_limits<double>::infinity();
+    // min x/y/z, max x/y/z
+    using Bounds = std::array<double, 6>;
 
-    double maxX = -std::numeric_limits<double>::infinity();
-    double maxY = -std::numeric_limits<double>::infinity();
-    double maxZ = -std::numeric_limits<double>::infinity();
+    const Bounds empty = { std::numeric_limits<double>::infinity(),
+                           std::numeric_limits<double>::infinity(),
+                           std::numeric_limits<double>::infinity(),
+                           -std::numeric_limits<double>::infinity(),
+                           -std::numeric_limits<double>::infinity(),
+                           -std::numeric_limits<double>::infinity() };
 
-    #pragma omp parallel for reduction(min:minX, minY, minZ) reduction(max:maxX, maxY, maxZ)
-    for (size_t i = 0; i < points.size(); ++i)
-    {
-        const auto* pos = points[i]->mPosition.data();
+    ParallelLoop loop("compute bounding box");
+
+    Bounds bounds = Threading::parallelReduce(size_t(0), points.size(), Threading::evenGrain(points.size()), empty,
+        [&](size_t first, size_t last)
+        {
+            ThreadBusy busy(loop);
 
-        minX = std::min(minX, pos[0]);
-        minY = std::min(minY, pos[1]);
-        minZ = std::min(minZ, pos[2]);
+            double minX = empty[0], minY = empty[1], minZ = empty[2];
+            double maxX = empty[3], maxY = empty[4], maxZ = empty[5];
 
-        maxX = std::max(maxX, pos[0]);
-        maxY = std::max(maxY, pos[1]);
-        maxZ = std::max(maxZ, pos[2]);
-    }
+            for (size_t i = first; i < last; ++i)
+            {
+                const auto* pos = points[i]->mPosition.data();
+
+                minX = std::min(minX, pos[0]);
+                minY = std::min(minY, pos[1]);
+                minZ = std::min(minZ, pos[2]);
+
+                maxX = std::max(maxX, pos[0]);
+                maxY = std::max(maxY, pos[1]);
+                maxZ = std::max(maxZ, pos[2]);
+            }
+
+            return Bounds{ minX, minY, minZ, maxX, maxY, maxZ };
+        },
+        [](const Bounds& a, const Bounds& b)
+        {
+            return Bounds{ std::min(a[0], b[0]), std::min(a[1], b[1]), std::min(a[2], b[2]),
+                           std::max(a[3], b[3]), std::max(a[4], b[4]), std::max(a[5], b[5]) };
+        });
+
+    const double minX = bounds[0], minY = bounds[1], minZ = bounds[2];
+    const double maxX = bounds[3], maxY = bounds[4], maxZ = bounds[5];
 
     double sideLength = std::max(maxX - minX, std::max(maxY - minY, maxZ - minZ));
 
@@ -229,19 +452,21 @@ void Octree::insertParallel(Node*& node, bool benchmarkSingleIteration)
 
         if (benchmarkSingleIteration) return;
 
+        TaskGroup group;
         for (size_t octantId = 0; octantId < 8; ++octantId)
         {
             if (node->octants[octantId] &&
                 node->octants[octantId]->points.size() > mMaxPointsPerNode)
             {
-                #pragma omp task firstprivate(octantId) shared(node)
+                group.spawn([this, node, octantId]()
                 {
+                    TRACE_SCOPE("insert task");
                     insertParallel(node->octants[octantId]);
-                }
+                });
             }
         }
 
-        #pragma omp taskwait
+        group.sync();
     }
 }
 
@@ -266,120 +491,370 @@ void Octree::partitionPointsInNode(Node*& node)
         return;
     }
 
-    // count how many points go in each octant
-    size_t a = 0, b = 0, c = 0, d = 0, e = 0, f = 0, g = 0, h = 0;
-    #pragma omp parallel for reduction(+: a, b, c, d, e, f, g, h)
-    for (size_t i = 0; i < numPoints; ++i)
+    // one chunk per thread, each with its own histogram (a cache line of counts)
+    struct alignas(64) Histogram
     {
-        size_t octantId = toOctantId(node->points[i], node->boundingBox);
-        switch (octantId)
-        {
-            case 0: ++a; break;
-            case 1: ++b; break;
-            case 2: ++c; break;
-            case 3: ++d; break;
-            case 4: ++e; break;
-            case 5: ++f; break;
-            case 6: ++g; break;
-            case 7: ++h; break;
-        }
-    }
-    size_t elementsPerOctant[8] = { a, b, c, d, e, f, g, h };
+        std::array<size_t, 8> counts{};
+    };
+
+    const size_t grain = Threading::evenGrain(numPoints);
+    const size_t numChunks = (numPoints + grain - 1) / grain;
 
-    size_t offset[8];
-    offset[0] = 0;
-    for (size_t i = 1; i < 8; ++i)
+    std::vector<uint8_t> octantIds(numPoints);
+    std::vector<Histogram> histograms(numChunks);
+
+    // classify every point once, the scatter reuses the ids
+    Threading::parallelFor(0, numPoints, grain, [&](size_t first, size_t last)
     {
-        offset[i] = offset[i - 1] + elementsPerOctant[i - 1];
-    }
+        const BoundingBox box = node->boundingBox;
+        auto& counts = histograms[first / grain].counts;
+
+        for (size_t i = first; i < last; ++i)
+        {
+            const size_t octantId = toOctantId(node->points[i], box);
 
-    std::vector<Particle*> temp(numPoints);
+            octantIds[i] = static_cast<uint8_t>(octantId);
+            ++counts[octantId];
+        }
+    });
 
-    std::atomic<size_t> writePosition[8] = { offset[0], offset[1], offset[2], offset[3],
-                                             offset[4], offset[5], offset[6], offset[7] };
+    // exclusive scan, octant by octant and within an octant chunk by chunk, gives every
+    // chunk its own range of every octant
+    std::array<size_t, 8> elementsPerOctant{};
+    std::vector<Histogram> writeOffsets(numChunks);
 
-    #pragma omp parallel for
-    for (size_t i = 0; i < numPoints; ++i)
+    for (size_t octantId = 0; octantId < 8; ++octantId)
     {
-        auto*& point = node->points[i];
-        size_t octantId = toOctantId(point, node->boundingBox);
-        size_t index = writePosition[octantId].fetch_add(1);
-
-        temp[index] = point;
+        for (size_t chunk = 0; chunk < numChunks; ++chunk)
+        {
+            writeOffsets[chunk].counts[octantId] = elementsPerOctant[octantId];
+            elementsPerOctant[octantId] += histograms[chunk].counts[octantId];
+        }
     }
 
-    #pragma omp parallel for
-    for (size_t i = 0; i < 8; ++i)
+    Threading::parallelFor(0, 8, 1, [&](size_t i, size_t)
     {
         if (elementsPerOctant[i] > 0)
         {
-            Node* octant = new Node();
+            Node* octant = createNode();
             node->octants[i] = octant;
 
             octant->boundingBox = createChildBox(i, node->boundingBox);
             octant->parentNode = node;
+            octant->points.resize(elementsPerOctant[i]);
+        }
+        else
+        {
+            node->octants[i] = nullptr;
+        }
+    });
 
-            size_t start = offset[i];
-            size_t count = elementsPerOctant[i];
-            
-            octant->points.reserve(count);
-            for (size_t j = 0; j < count; ++j)
+    // every chunk writes its points in order to its own ranges, no atomics and the points
+    // of an octant keep the order they had in the node
+    Threading::parallelFor(0, numPoints, grain, [&](size_t first, size_t last)
+    {
+        std::array<Particle**, 8> out{};
+        const auto& offsets = writeOffsets[first / grain].counts;
+
+        for (size_t octantId = 0; octantId < 8; ++octantId)
+        {
+            if (node->octants[octantId])
             {
-                octant->points.emplace_back(temp[start + j]);
+                out[octantId] = node->octants[octantId]->points.data() + offsets[octantId];
             }
         }
+
+        for (size_t i = first; i < last; ++i)
+        {
+            *out[octantIds[i]]++ = node->points[i];
+        }
+    });
+
+    node->points.clear();
+}
+
+void Octree::buildLockFree(std::vector<Particle*>& points)
+{
+    // a root that never has to split is a leaf, same as for the other strategies
+    if (points.size() <= mMaxPointsPerNode)
+    {
+        mRoot->points.insert(mRoot->points.end(), points.begin(), points.end());
+        return;
+    }
+
+    ParallelLoop loop("insert points");
+
+    Threading::parallelFor(0, points.size(), Threading::evenGrain(points.size()), [&](size_t first, size_t last)
+    {
+        ThreadBusy busy(loop);
+        TRACE_SCOPE("lock free insert");
+
+        for (size_t i = first; i < last; ++i)
+        {
+            insertLockFree(mRoot, points[i]);
+        }
+    });
+
+    // the subtrees of the root are disjoint, one chunk each
+    Threading::parallelFor(0, 8, 1, [&](size_t octantId, size_t)
+    {
+        finishLockFreeSlot(mRoot->octants[octantId]);
+    });
+}
+
+// descends through interior nodes without synchronizing, an empty slot is claimed by
+// publishing a new leaf with compare and swap, a leaf is claimed by swapping in
+// SLOT_IN_PROGRESS which makes it private to the claiming thread until the leaf (with the
+// point appended or split into a subtree) is published again, threads that find a claimed
+// slot retry once it is released
+void Octree::insertLockFree(Node* node, Particle* point)
+{
+    while (true)
+    {
+        const size_t octantId = toOctantId(point, node->boundingBox);
+        std::atomic_ref<Node*> slot(node->octants[octantId]);
+
+        Node* child = slot.load(std::memory_order_acquire);
+
+        if (child == nullptr)
+        {
+            Node* leaf = createNode();
+            leaf->boundingBox = createChildBox(octantId, node->boundingBox);
+            leaf->parentNode = node;
+            leaf->points.emplace_back(point);
+
+            if (slot.compare_exchange_strong(child, tagLeaf(leaf), std::memory_order_release, std::memory_order_relaxed))
+            {
+                return;
+            }
+
+            // another thread published a leaf first, the unused one stays in its block as
+            // wasted space until the tree is destroyed
+            leaf->points.clear();
+        }
+        else if (child == SLOT_IN_PROGRESS)
+        {
+            std::this_thread::yield();
+        }
+        else if (isTaggedLeaf(child))
+        {
+            if (!slot.compare_exchange_strong(child, SLOT_IN_PROGRESS, std::memory_order_acquire, std::memory_order_relaxed))
+            {
+                continue;
+            }
+
+            Node* leaf = untagLeaf(child);
+
+            if (leaf->points.size() < mMaxPointsPerNode)
+            {
+                leaf->points.emplace_back(point);
+                slot.store(child, std::memory_order_release);
+                return;
+            }
+
+            // nobody else can reach the leaf, it is split by inserting into it as an interior
+            // node and published untagged
+            std::vector<Particle*> temp;
+            temp.swap(leaf->points);
+            temp.emplace_back(point);
+
+            for (auto* splitPoint : temp)
+            {
+                insertLockFree(leaf, splitPoint);
+            }
+
+            slot.store(leaf, std::memory_order_release);
+            return;
+        }
         else
         {
-            node->octants[i] = nullptr;
+            node = child;
         }
     }
+}
 
-    node->points.clear();
+// clears the leaf tags and sorts the points of every leaf by id, the order they were
+// appended in depends on the thread timing and would change the force sums from run to run
+void Octree::finishLockFreeSlot(Node*& slot)
+{
+    if (isTaggedLeaf(slot))
+    {
+        slot = untagLeaf(slot);
+        std::stable_sort(slot->points.begin(), slot->points.end(),
+                         [](const Particle* a, const Particle* b) { return a->mId < b->mId; });
+    }
+    else if (slot)
+    {
+        for (auto*& octant : slot->octants)
+        {
+            finishLockFreeSlot(octant);
+        }
+    }
 }
 
 void Octree::hybridParallelInsert(Node*& node)
 {
-    static constexpr size_t THRESHOLD_FOR_TASK_BASED = 50000;
     if (node == nullptr) return;
 
-    const size_t numPoints = node->points.size();
+    // partitionPointsInNode is a parallel loop of its own, the nodes big enough for it are
+    // split one after the other outside of any task
+    std::vector<Node*> level = { node };
+    std::vector<Node*> remaining;
 
-    if (numPoints == 0) return;
-    if (numPoints <= mMaxPointsPerNode) return;
-
-    if (numPoints <= mParallelThresholdForInsert)
+    while (!level.empty())
     {
-        std::vector<Particle*> temp;
-        temp.swap(node->points);
+        std::vector<Node*> nextLevel;
 
-        for (auto& point : temp)
+        for (auto* current : level)
         {
-            insert(node, point);
+            if (current->points.size() <= mTaskThreshold)
+            {
+                remaining.emplace_back(current);
+                continue;
+            }
+
+            TRACE_SCOPE("partition node");
+            partitionPointsInNode(current);
+
+            for (auto* octant : current->octants)
+            {
+                if (octant) nextLevel.emplace_back(octant);
+            }
         }
-        return;
+
+        level.swap(nextLevel);
     }
-    else if (numPoints <= THRESHOLD_FOR_TASK_BASED)
+
+    Threading::runTasks([&]()
     {
-        insertParallel(node);
+        TaskGroup group;
+        for (auto* current : remaining)
+        {
+            if (current->points.size() <= mMaxPointsPerNode) continue;
+
+            group.spawn([this, current]() mutable
+            {
+                TRACE_SCOPE("hybrid insert task");
+                insertParallel(current);
+            });
+        }
+
+        group.sync();
+    });
+}
+
+Octree::BuildStrategy Octree::buildStrategyFromString(const std::string& name)
+{
+    if (name == "serial")       return BuildStrategy::Serial;
+    if (name == "task")         return BuildStrategy::Task;
+    if (name == "partition")    return BuildStrategy::Partition;
+    if (name == "hybrid")       return BuildStrategy::Hybrid;
+    if (name == "lockfree")     return BuildStrategy::LockFree;
+    if (name == "auto")         return BuildStrategy::Auto;
+
+    throw std::runtime_error("unknown octree build strategy: " + name);
+}
+
+const char* Octree::buildStrategyName(BuildStrategy strategy)
+{
+    switch (strategy)
+    {
+    case BuildStrategy::Serial:     return "serial";
+    case BuildStrategy::Task:       return "task";
+    case BuildStrategy::Partition:  return "partition";
+    case BuildStrategy::Hybrid:     return "hybrid";
+    case BuildStrategy::LockFree:   return "lockfree";
+    case BuildStrategy::Auto:       return "auto";
     }
-    else
+
+    return "";
+}
+
+Octree::TreeStats Octree::computeTreeStats() const
+{
+    // interior nodes own one center of mass particle per child
+    auto nodeBytes = [](const Node* node)
+    {
+        size_t bytes = sizeof(Node) + node->points.capacity() * sizeof(Particle*);
+        if (!node->isLeafNode())
+        {
+            bytes += node->points.size() * sizeof(Particle);
+        }
+        return bytes;
+    };
+
+    auto firstChild = [](const Node* node)
+    {
+        for (const Node* octant : node->octants)
+        {
+            if (octant) return octant;
+        }
+        return static_cast<const Node*>(nullptr);
+    };
+
+    struct Partial
     {
-        partitionPointsInNode(node);
+        TreeStats stats;
+        size_t depthSum = 0;
+    };
 
-        for (size_t i = 0; i < 8; ++i)
+    Partial total = Threading::parallelReduce(size_t(0), mLeafNodes.size(), Threading::evenGrain(mLeafNodes.size()), Partial{},
+        [&](size_t first, size_t last)
         {
-            auto*& octant = node->octants[i];
-            if (octant)
+            Partial partial;
+            TreeStats& local = partial.stats;
+
+            for (size_t i = first; i < last; ++i)
             {
-                #pragma omp task default(none) firstprivate(octant)
+                const Node* leaf = mLeafNodes[i];
+
+                ++local.nodes;
+                local.bytes += nodeBytes(leaf);
+                ++local.leafOccupancy[std::min(leaf->points.size(), TreeStats::OCCUPANCY_BINS - 1)];
+
+                // an interior node is counted by the leaf reached through its first children
+                // only, so every node is counted exactly once without a shared visited set
+                size_t depth = 0;
+                bool counting = true;
+                for (const Node* node = leaf; node->parentNode; node = node->parentNode)
                 {
-                    hybridParallelInsert(octant);
+                    ++depth;
+
+                    counting = counting && firstChild(node->parentNode) == node;
+                    if (counting)
+                    {
+                        ++local.nodes;
+                        local.bytes += nodeBytes(node->parentNode);
+                    }
                 }
+
+                local.maxDepth = std::max(local.maxDepth, depth);
+                partial.depthSum += depth;
             }
-        }
 
-        #pragma omp taskwait
-    }
+            return partial;
+        },
+        [](Partial a, const Partial& b)
+        {
+            a.stats.nodes += b.stats.nodes;
+            a.stats.bytes += b.stats.bytes;
+            a.stats.maxDepth = std::max(a.stats.maxDepth, b.stats.maxDepth);
+            a.depthSum += b.depthSum;
+
+            for (size_t bin = 0; bin < TreeStats::OCCUPANCY_BINS; ++bin)
+            {
+                a.stats.leafOccupancy[bin] += b.stats.leafOccupancy[bin];
+            }
+
+            return a;
+        });
+
+    TreeStats stats = total.stats;
+    stats.leaves = mLeafNodes.size();
+    stats.bytes += mLeafNodes.capacity() * sizeof(Node*);
+    stats.meanDepth = stats.leaves == 0 ? 0.0 : static_cast<double>(total.depthSum) / static_cast<double>(stats.leaves);
+
+    return stats;
 }
 
 Octree::BoundingBox Octree::createChildBox(size_t index, const BoundingBox& parent)
@@ -403,17 +878,24 @@ void Octree::generateLeafNodeList(Node*& node)
     std::vector<Node*> bfs;
     generateWorkForTreeTraversal(bfs);
 
-    auto numThreads = omp_get_max_threads();
-    std::vector<std::vector<Node*>> localLeafs(numThreads);
+    // one list per subtree appended in bfs order, the leafs stay in morton order whatever
+    // thread searched which subtree
+    std::vector<std::vector<Node*>> subtreeLeafs(bfs.size());
+
+    ParallelLoop loop("generate leaf nodes");
 
-    #pragma omp parallel for schedule(dynamic)
-    for (size_t i = 0; i < bfs.size(); ++i)
+    // every subtree is a chunk (and a span in the trace)
+    Threading::parallelFor(0, bfs.size(), 1, [&](size_t first, size_t last)
     {
-        auto tid = omp_get_thread_num();
-        dfsLeafNodeSearch(bfs[i], localLeafs[tid]);
-    }
+        ThreadBusy busy(loop);
+
+        for (size_t i = first; i < last; ++i)
+        {
+            dfsLeafNodeSearch(bfs[i], subtreeLeafs[i]);
+        }
+    });
 
-    for (auto& local : localLeafs)
+    for (auto& local : subtreeLeafs)
     {
         mLeafNodes.insert(mLeafNodes.end(), local.begin(), local.end());
     }
@@ -421,7 +903,7 @@ void Octree::generateLeafNodeList(Node*& node)
 
 void Octree::generateWorkForTreeTraversal(std::vector<Node*>& bfs)
 {
-    const size_t targetBfsSize = 8 * omp_get_max_threads();
+    const size_t targetBfsSize = mTraversalWorkPerThread * Threading::numThreads();
 
     bfs.emplace_back(mRoot);
 
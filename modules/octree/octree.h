@@ -3,8 +3,12 @@
 #include <vector>
 #include <array>
 #include <cmath> 
+#include <cstdint>
+#include <mutex>
+#include <string>
 
 #include "particle.h"
+#include "node_blocks.h"
 
 #ifdef PERF_PROFILE
 #include "perf_profiler.h"
@@ -13,12 +17,32 @@
 static constexpr size_t DEFAULT_MAX_POINTS_PER_NODE = 1;
 // when node contains <= number of points switch to serial insert algorithm
 static constexpr size_t PARALLEL_THRESHOLD_FOR_INSERT = 10;
+// nodes with more points are partitioned by all threads before tasks take over (hybrid)
+static constexpr size_t THRESHOLD_FOR_TASK_BASED = 50000;
+// subtrees per thread the leaf list search is split into
+static constexpr size_t TRAVERSAL_WORK_PER_THREAD = 8;
 
 // valgrind will report possiblly lost memory for all these function calls
 // because they are raw pointers... but look at assumption above constructor
 class Octree
 {
 public:
+    // how the constructor inserts the points
+    enum class BuildStrategy
+    {
+        Serial,         // insert one point after the other
+        Task,           // insertParallel, a task per octant holding enough points
+        Partition,      // partitionPointsInNode level by level down to the insert threshold
+        Hybrid,         // partition nodes above THRESHOLD_FOR_TASK_BASED, insertParallel below
+        LockFree,       // every thread inserts its share of the points into the shared tree
+        Auto            // hybrid with the thresholds of the BuildCalibration row for the thread count (if loaded)
+    };
+
+    // serial, task, partition, hybrid, lockfree or auto, throws for anything else
+    static BuildStrategy buildStrategyFromString(const std::string& name);
+
+    static const char* buildStrategyName(BuildStrategy strategy);
+
     // assume that pointers are valid for as long as tree is used
 #ifdef PERF_PROFILE
     Octree(std::vector<Particle*>& points,
@@ -28,12 +52,35 @@ public:
            bool supportMultithread = false,
            size_t parallelThresholdForInsert = PARALLEL_THRESHOLD_FOR_INSERT,
            size_t maxPointsPerNode = DEFAULT_MAX_POINTS_PER_NODE);    
+
+    Octree(std::vector<Particle*>& points,
+           std::unique_ptr<PerfSection>& bbox,
+           std::unique_ptr<PerfSection>& insrt,
+           std::unique_ptr<PerfSection>& leaf,
+           BuildStrategy strategy,
+           size_t parallelThresholdForInsert = PARALLEL_THRESHOLD_FOR_INSERT,
+           size_t maxPointsPerNode = DEFAULT_MAX_POINTS_PER_NODE);
 #else
     Octree(std::vector<Particle*>& points,
            bool supportMultithread = false,
            size_t parallelThresholdForInsert = PARALLEL_THRESHOLD_FOR_INSERT,
            size_t maxPointsPerNode = DEFAULT_MAX_POINTS_PER_NODE);
+
+    Octree(std::vector<Particle*>& points,
+           BuildStrategy strategy,
+           size_t parallelThresholdForInsert = PARALLEL_THRESHOLD_FOR_INSERT,
+           size_t maxPointsPerNode = DEFAULT_MAX_POINTS_PER_NODE);
 #endif
+
+    // tag for a tree that is built later with buildInTeam
+    struct Deferred {};
+
+    // nothing is built, perf sections are not recorded for a deferred tree
+    Octree(Deferred,
+           const std::vector<Particle*>& points,
+           size_t parallelThresholdForInsert = PARALLEL_THRESHOLD_FOR_INSERT,
+           size_t maxPointsPerNode = DEFAULT_MAX_POINTS_PER_NODE);
+
     ~Octree();
 
     struct BoundingBox
@@ -76,28 +123,38 @@ public:
         }
     };
 
+    // shape of a built tree, used to tell a degenerate tree from a slow machine
+    struct TreeStats
+    {
+        // leafs holding OCCUPANCY_BINS - 1 or more points share the last bin
+        static constexpr size_t OCCUPANCY_BINS = 10;
+
+        size_t nodes = 0;
+        size_t leaves = 0;
+        size_t maxDepth = 0;        // root is depth 0
+        double meanDepth = 0.0;     // of the leafs
+        size_t bytes = 0;           // nodes, point lists and the center of mass particles
+        std::array<size_t, OCCUPANCY_BINS> leafOccupancy{};
+    };
+
     static inline size_t toOctantId(Particle*& point, const BoundingBox& box)
     {
         auto& p = point->mPosition;
 
-        // decide if point is in upper or lower quadrant
-        size_t id = (p[2] >= box.center[2]) ? 0 : 4;
+        // upper or lower half
+        const size_t below = p[2] < box.center[2];
 
         // use quadrant rules to place point
         // (+,+) - quandrant 0
         // (-,+) - quandrant 1
         // (-,-) - quandrant 2
         // (+,-) - quandrant 3
-        if (p[0] >= box.center[0]) // (+,?)
-        {
-            id += (p[1] >= box.center[1]) ? 0 : 3;
-        }
-        else // (-,?)
-        {
-            id += (p[1] >= box.center[1]) ? 1 : 2;
-        }
-        
-        return id;
+        // without branches (2 * (y < 0) + ((x < 0) xor (y < 0))), the octant of the next
+        // point is as good as random and mispredicts about half the time otherwise
+        const size_t left = p[0] < box.center[0];
+        const size_t back = p[1] < box.center[1];
+
+        return 4 * below + 2 * back + (left ^ back);
     }
 
     inline std::vector<Node*>& getLeafNodes()
@@ -110,11 +167,6 @@ public:
         return mRoot;
     }
 
-    inline std::array<double, 3>& getProfileData()
-    {
-        return mProfileData;
-    }
-
     void insert(Node*& node, Particle*& point);
 
     void insertParallel(Node*& node, bool benchmarkSingleIteration = false);
@@ -123,13 +175,37 @@ public:
 
     static BoundingBox computeBoundingBox(std::vector<Particle*>& points);
 
+    // builds a deferred tree, has to be called by every thread of the enclosing parallel
+    // region (orphaned worksharing, no parallel region of its own), the tree is complete
+    // for every thread when it returns, openmp threading backend only
+    void buildInTeam(std::vector<Particle*>& points);
+
+    // walks up from every leaf in parallel with per thread counters
+    TreeStats computeTreeStats() const;
+
 private: 
     Octree() = default;
 
+    // frees the center of mass particles, the nodes go with their blocks
     void freeNode(Node*& node);
 
+    // value initialized like new Node() in a block of the calling thread's numa node
+    Node* createNode();
+
+    // partitions the nodes above mTaskThreshold one after the other with all threads, level
+    // by level, then inserts the rest with insertParallel tasks
     void hybridParallelInsert(Node*& node);
 
+    // every thread inserts a chunk of points with insertLockFree, then the leaf tags are
+    // cleared so the tree is an ordinary one
+    void buildLockFree(std::vector<Particle*>& points);
+
+    // node has to be an interior node (or the empty root) of a tree being built lock free,
+    // any number of threads can insert at once
+    void insertLockFree(Node* node, Particle* point);
+
+    void finishLockFreeSlot(Node*& slot);
+
     BoundingBox createChildBox(size_t index, const BoundingBox& parent);
 
     // assumes that a reader/writer lock is already held
@@ -141,7 +217,7 @@ private:
         // create new leaf node if needed
         if (node->octants[octandId] == nullptr)
         {   
-            node->octants[octandId] = new Node();
+            node->octants[octandId] = createNode();
             node->octants[octandId]->boundingBox = createChildBox(octandId, node->boundingBox);
             node->octants[octandId]->parentNode = node;
         }
@@ -159,12 +235,22 @@ private:
     static constexpr std::array<size_t, 8> MORTON_ORDER = {6, 7, 5, 4, 2, 3, 1, 0};
 
     Node* mRoot = new Node();
+    // every node but the root
+    std::vector<NodeBlocks::Block*> mBlocks;
+    std::mutex mBlocksMutex;
+    const uint64_t mBlocksOwnerId = NodeBlocks::getInstance().nextOwnerId();
     std::vector<Node*> mLeafNodes;
-    bool mSupportMultithread;
+    BuildStrategy mStrategy;
     size_t mMaxPointsPerNode;
     size_t mParallelThresholdForInsert;
+    size_t mTaskThreshold = THRESHOLD_FOR_TASK_BASED;
+    size_t mTraversalWorkPerThread = TRAVERSAL_WORK_PER_THREAD;
     std::vector<Particle*> mRawParticles;
-    std::array<double, 3> mProfileData;
+
+    // shared by the team in buildInTeam
+    std::vector<std::array<double, 6>> mTeamBounds;     // [thread] min x/y/z, max x/y/z
+    std::vector<Node*> mTeamBfs;
+    std::vector<std::vector<Node*>> mTeamLeafs;         // [thread]
 #ifdef PERF_PROFILE
     std::unique_ptr<PerfSection>& mBbox;
     std::unique_ptr<PerfSection>& mInsert;
@@ -27,6 +27,10 @@ struct Particle
         
     ~Particle() = default;
 
+    // floating point work of one applyForce: 3 sub, 3 mul + 2 add, sqrt, add (epsilon),
+    // 3 mul + div for the force and 3 mul + 3 add to accumulate, sqrt and div count as one
+    static constexpr double APPLY_FORCE_FLOPS = 20.0;
+
     void applyForce(Particle*& particle)
     {
         applyForce(particle->mPosition, particle->mMass);
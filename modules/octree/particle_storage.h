@@ -0,0 +1,104 @@
+#pragma once
+
+#include <new>
+#include <string>
+#include <vector>
+
+#include "particle.h"
+#include "particle_config.hpp"
+#include "threading.h"
+
+// every particle of a simulation in one contiguous allocation
+//
+// pages are first touched by the threads of the backend with the chunks the per particle
+// loops of the simulation use (Threading::evenGrain), so on a numa system with bound
+// threads (b_hut -affinity) each thread's particles live on its node
+class ParticleStorage
+{
+public:
+    ParticleStorage() = default;
+
+    ~ParticleStorage()
+    {
+        release();
+    }
+
+    ParticleStorage(const ParticleStorage&) = delete;
+    ParticleStorage& operator=(const ParticleStorage&) = delete;
+
+    // previous contents are discarded
+    void allocate(size_t numParticles)
+    {
+        release();
+
+        if (numParticles == 0) return;
+
+        mData = static_cast<Particle*>(::operator new(numParticles * sizeof(Particle), std::align_val_t(ALIGNMENT)));
+        mSize = numParticles;
+
+        Threading::parallelFor(0, mSize, Threading::evenGrain(mSize), [this](size_t first, size_t last)
+        {
+            for (size_t i = first; i < last; ++i)
+            {
+                new (mData + i) Particle(0.0, 0.0, 0.0, 0.0);
+            }
+        });
+    }
+
+    // parses straight into the storage, the particle set is never copied
+    void load(const std::string& fileName)
+    {
+        mSize = ParticleConfig::parse(fileName,
+                                      [this](size_t count) { allocate(count); },
+                                      [this](size_t i, const ParticleConfig::Particle& particle) { mData[i] = Particle(particle); });
+    }
+
+    // same as load but goes through the parsed input cache (see ParticleConfig::parseCached)
+    ParticleConfig::CacheResult loadCached(const std::string& fileName, const std::string& cacheDirectory)
+    {
+        ParticleConfig::CacheResult result;
+        mSize = ParticleConfig::parseCached(fileName, cacheDirectory,
+                                            [this](size_t count) { allocate(count); },
+                                            [this](size_t i, const ParticleConfig::Particle& particle) { mData[i] = Particle(particle); },
+                                            result);
+        return result;
+    }
+
+    // the simulation works on particle pointers, they stay valid for the lifetime of the storage
+    std::vector<Particle*> pointers()
+    {
+        std::vector<Particle*> particles(mSize);
+
+        Threading::parallelFor(0, mSize, Threading::evenGrain(mSize), [&](size_t first, size_t last)
+        {
+            for (size_t i = first; i < last; ++i)
+            {
+                particles[i] = mData + i;
+            }
+        });
+
+        return particles;
+    }
+
+    Particle& operator[](size_t i) { return mData[i]; }
+    const Particle& operator[](size_t i) const { return mData[i]; }
+
+    size_t size() const { return mSize; }
+
+private:
+    static constexpr size_t ALIGNMENT = 64;
+
+    void release()
+    {
+        if (mData)
+        {
+            ::operator delete(mData, std::align_val_t(ALIGNMENT));
+        }
+
+        mData = nullptr;
+        mSize = 0;
+    }
+
+    Particle* mData = nullptr;
+    size_t mSize = 0;
+};
@@ -0,0 +1,50 @@
+#include "row_file.h"
+
+#include <limits>
+
+namespace
+{
+    constexpr size_t NEVER = std::numeric_limits<size_t>::max();
+}
+
+size_t RowFile::parseCount(const std::string& value)
+{
+    // stoull would take "-1" and wrap it
+    if (value.empty() || value[0] == '-' || value[0] == '+')
+    {
+        throw std::invalid_argument(value);
+    }
+
+    size_t end = 0;
+    size_t parsed = std::stoull(value, &end);
+
+    if (end != value.size())
+    {
+        throw std::invalid_argument(value);
+    }
+
+    return parsed;
+}
+
+double RowFile::parseReal(const std::string& value)
+{
+    size_t end = 0;
+    double parsed = std::stod(value, &end);
+
+    if (end != value.size())
+    {
+        throw std::invalid_argument(value);
+    }
+
+    return parsed;
+}
+
+size_t RowFile::parseThreshold(const std::string& value)
+{
+    return value == "never" ? NEVER : parseCount(value);
+}
+
+std::string RowFile::thresholdName(size_t threshold)
+{
+    return threshold == NEVER ? "never" : std::to_string(threshold);
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// plain text files of settings measured per thread count (BuildCalibration, Tuning), a row
+// per line after # comments, the first column is the thread count, rows are kept in
+// ascending thread order
+namespace RowFile
+{
+    // a whole field as an unsigned count, throws std::invalid_argument otherwise
+    size_t parseCount(const std::string& value);
+
+    // a whole field as a real number, throws std::invalid_argument otherwise
+    double parseReal(const std::string& value);
+
+    // a count or "never" (SIZE_MAX)
+    size_t parseThreshold(const std::string& value);
+
+    std::string thresholdName(size_t threshold);
+
+    // parse(fields) turns the fields of one line into a row and throws any exception for a
+    // malformed one, throws std::runtime_error naming what and the line
+    template <class Row, class Parse>
+    std::vector<Row> read(const std::string& filename, const std::string& what, const Parse& parse)
+    {
+        std::ifstream file(filename);
+        if (!file.is_open())
+        {
+            throw std::runtime_error("unable to open: " + filename);
+        }
+
+        std::vector<Row> rows;
+        std::string line;
+        size_t lineNumber = 0;
+
+        while (std::getline(file, line))
+        {
+            ++lineNumber;
+
+            if (line.empty() || line[0] == '#') continue;
+
+            std::istringstream stream(line);
+            std::vector<std::string> fields;
+            for (std::string field; stream >> field; )
+            {
+                fields.emplace_back(field);
+            }
+
+            try
+            {
+                rows.emplace_back(parse(fields));
+            }
+            catch (const std::exception&)
+            {
+                throw std::runtime_error("not a valid " + what + ": " + filename + " line " + std::to_string(lineNumber));
+            }
+        }
+
+        return rows;
+    }
+
+    // the header lines (without #) followed by writeRow(out, row) for every row
+    template <class Row, class WriteRow>
+    void write(const std::string& filename, const std::string& what, const std::vector<std::string>& header,
+               const std::vector<Row>& rows, const WriteRow& writeRow)
+    {
+        std::ofstream file(filename);
+        if (!file.is_open())
+        {
+            throw std::runtime_error("unable to open: " + filename + " to write the " + what);
+        }
+
+        for (const auto& line : header)
+        {
+            file << "# " << line << "\n";
+        }
+
+        for (const auto& row : rows)
+        {
+            writeRow(file, row);
+            file << "\n";
+        }
+
+        if (!file)
+        {
+            throw std::runtime_error("failed writing " + what + ": " + filename);
+        }
+    }
+
+    // adds the row or replaces the one with the same thread count
+    template <class Row>
+    void setRow(std::vector<Row>& rows, const Row& row)
+    {
+        auto it = std::lower_bound(rows.begin(), rows.end(), row.threads,
+                                   [](const Row& a, size_t threads) { return a.threads < threads; });
+
+        if (it != rows.end() && it->threads == row.threads)
+        {
+            *it = row;
+        }
+        else
+        {
+            rows.insert(it, row);
+        }
+    }
+
+    // the row with the most threads not above threads (the one with the fewest if all are
+    // above), a default row for threads if there is none
+    template <class Row>
+    Row lookup(const std::vector<Row>& rows, size_t threads)
+    {
+        if (rows.empty())
+        {
+            Row defaults;
+            defaults.threads = threads;
+            return defaults;
+        }
+
+        auto it = std::upper_bound(rows.begin(), rows.end(), threads,
+                                   [](size_t threads, const Row& a) { return threads < a.threads; });
+
+        return it == rows.begin() ? *it : *(it - 1);
+    }
+}
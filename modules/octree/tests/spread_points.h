@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cmath>
+#include <vector>
+
+#include "particle.h"
+
+// deterministic but uneven spread of n points with masses and ids in input order, shared
+// by the octree and barnes hut tests, the caller owns the points
+inline std::vector<Particle*> makeSpreadPoints(int n)
+{
+    std::vector<Particle*> pts;
+    for (int i = 0; i < n; ++i)
+    {
+        double x = std::sin(i * 12.9898) * 100.0;
+        double y = std::sin(i * 78.233) * 100.0;
+        double z = std::sin(i * 37.719) * std::sin(i * 3.1) * 100.0;
+        pts.push_back(new Particle(x, y, z, 10.0 + i % 7));
+        pts.back()->mId = i;
+    }
+
+    return pts;
+}
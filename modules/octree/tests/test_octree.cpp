@@ -7,15 +7,21 @@
 #define private public
 #define protected public
 #include "octree.h"
+#include "build_calibration.h"
 #undef private
 #undef protected
 
+#include <algorithm>
 #include <memory>
 #include <vector>
 #include <cmath>
 #include <filesystem>
+#include <fstream>
+#include <limits>
 
 #include "particle_config.hpp"
+#include "particle_storage.h"
+#include "spread_points.h"
 
 static std::filesystem::path base()
 {
@@ -466,6 +472,38 @@ TEST_CASE("partitionPointsInNode builds a structurally valid first-level octree
     REQUIRE(computeMaxDepth(root) == 2);
 }
 
+TEST_CASE("partitionPointsInNode keeps the order of the points within every octant")
+{
+    constexpr size_t numPoints = 20000;
+
+    Octree tree;
+    tree.mParallelThresholdForInsert = 1;
+    tree.mMaxPointsPerNode = 1;
+
+    Octree::Node* root = new Octree::Node();
+
+    root->boundingBox.center = {0.0, 0.0, 0.0};
+    root->boundingBox.halfOfSideLength = 1.0;
+
+    std::mt19937_64 rng(587);
+    std::uniform_real_distribution<double> dist(-1.0, 1.0);
+
+    std::array<std::vector<Particle*>, 8> expected;
+    for (size_t i = 0; i < numPoints; ++i)
+    {
+        root->points.push_back(makePoint(dist(rng), dist(rng), dist(rng)));
+        expected[Octree::toOctantId(root->points.back(), root->boundingBox)].push_back(root->points.back());
+    }
+
+    tree.partitionPointsInNode(root);
+
+    for (size_t i = 0; i < 8; ++i)
+    {
+        REQUIRE(root->octants[i] != nullptr);
+        REQUIRE(root->octants[i]->points == expected[i]);
+    }
+}
+
 TEST_CASE("Parallel Octree generation with large input size")
 {
     std::filesystem::path file = base() / "inputs" / "test_particle_config_parallel_tree.txt";
@@ -492,4 +530,318 @@ TEST_CASE("Parallel Octree generation with large input size")
     {
         REQUIRE(root->boundingBox.isPointInBox(p));
     }
-}
\ No newline at end of file
+}
+
+TEST_CASE("ParticleStorage loads text and binary particle configs in place")
+{
+    ParticleConfig::Limits limits;
+    limits.boundingBox         = {{ { -10.0, -10.0, -10.0 }, { 10.0, 10.0, 10.0 } }};
+    limits.massLimits          = { 1.0, 5.0 };
+    limits.velocityLimits      = { -2.0, 2.0 };
+    limits.accelerationLimits  = { -0.5, 0.5 };
+
+    auto expected = ParticleConfig::generate(5000, limits, 587);
+
+    for (auto format : { ParticleConfig::Format::Text, ParticleConfig::Format::Binary })
+    {
+        std::string filename = (std::filesystem::temp_directory_path() / "test_particle_storage.cfg").string();
+        ParticleConfig::write(expected, filename, format);
+
+        // text is rounded to 6 significant digits, compare against what the parser returns
+        auto parsed = ParticleConfig::parse(filename);
+
+        ParticleStorage storage;
+        storage.load(filename);
+        auto pts = storage.pointers();
+
+        REQUIRE(storage.size() == expected.size());
+        REQUIRE(pts.size() == expected.size());
+
+        for (size_t i = 0; i < pts.size(); ++i)
+        {
+            REQUIRE(pts[i] == &storage[i]);
+            REQUIRE(pts[i]->mId == parsed[i].id);
+            REQUIRE(pts[i]->mPosition == parsed[i].position);
+            REQUIRE(pts[i]->mVelocity == parsed[i].velocity);
+            REQUIRE(pts[i]->mAcceleration == parsed[i].acceleration);
+            REQUIRE(pts[i]->mMass == parsed[i].mass);
+            REQUIRE(pts[i]->mAppliedForce == std::array<double, 3>{ 0.0, 0.0, 0.0 });
+        }
+
+        std::filesystem::remove(filename);
+    }
+}
+
+static void countNodes(Octree::Node* node, size_t depth, size_t& nodes, size_t& maxDepth)
+{
+    ++nodes;
+    maxDepth = std::max(maxDepth, depth);
+
+    for (auto* octant : node->octants)
+    {
+        if (octant) countNodes(octant, depth + 1, nodes, maxDepth);
+    }
+}
+
+TEST_CASE("Tree stats match a recursive walk of the tree")
+{
+    std::vector<Particle*> pts = makeSpreadPoints(2000);
+
+    const size_t maxPointsPerNode = 4;
+    Octree tree(pts, true, PARALLEL_THRESHOLD_FOR_INSERT, maxPointsPerNode);
+
+    auto stats = tree.computeTreeStats();
+
+    size_t nodes = 0;
+    size_t maxDepth = 0;
+    countNodes(tree.mRoot, 0, nodes, maxDepth);
+
+    REQUIRE(stats.nodes == nodes);
+    REQUIRE(stats.leaves == tree.mLeafNodes.size());
+    REQUIRE(stats.maxDepth == maxDepth);
+    REQUIRE(stats.meanDepth > 0.0);
+    REQUIRE(stats.meanDepth <= static_cast<double>(maxDepth));
+    REQUIRE(stats.bytes >= nodes * sizeof(Octree::Node));
+
+    size_t leaves = 0;
+    size_t points = 0;
+    for (size_t bin = 0; bin < Octree::TreeStats::OCCUPANCY_BINS; ++bin)
+    {
+        leaves += stats.leafOccupancy[bin];
+        points += bin * stats.leafOccupancy[bin];
+    }
+
+    REQUIRE(leaves == stats.leaves);
+    REQUIRE(points == pts.size());
+    REQUIRE(stats.leafOccupancy[0] == 0);
+
+    for (auto* p : pts) delete p;
+}
+
+TEST_CASE("Octree built by a team matches the one built by the constructor")
+{
+    std::vector<Particle*> pts = makeSpreadPoints(2000);
+
+    const size_t maxPointsPerNode = 4;
+    Octree reference(pts, true, PARALLEL_THRESHOLD_FOR_INSERT, maxPointsPerNode);
+    Octree deferred(Octree::Deferred{}, pts, PARALLEL_THRESHOLD_FOR_INSERT, maxPointsPerNode);
+
+    REQUIRE(deferred.mLeafNodes.empty());
+
+    #pragma omp parallel num_threads(3)
+    {
+        deferred.buildInTeam(pts);
+    }
+
+    REQUIRE(deferred.mRoot->boundingBox.center == reference.mRoot->boundingBox.center);
+    REQUIRE(deferred.mRoot->boundingBox.halfOfSideLength == reference.mRoot->boundingBox.halfOfSideLength);
+
+    size_t referenceNodes = 0, referenceDepth = 0;
+    size_t deferredNodes = 0, deferredDepth = 0;
+    countNodes(reference.mRoot, 0, referenceNodes, referenceDepth);
+    countNodes(deferred.mRoot, 0, deferredNodes, deferredDepth);
+
+    REQUIRE(deferredNodes == referenceNodes);
+    REQUIRE(deferredDepth == referenceDepth);
+    REQUIRE(deferred.mLeafNodes.size() == reference.mLeafNodes.size());
+
+    // same leafs holding the same points, the order of the leaf list depends on scheduling
+    auto leafPoints = [](const std::vector<Octree::Node*>& leafs)
+    {
+        std::vector<std::vector<Particle*>> points;
+        for (auto* leaf : leafs)
+        {
+            REQUIRE(leaf->isLeafNode());
+            points.push_back(leaf->points);
+            std::sort(points.back().begin(), points.back().end());
+        }
+        std::sort(points.begin(), points.end());
+        return points;
+    };
+
+    REQUIRE(leafPoints(deferred.mLeafNodes) == leafPoints(reference.mLeafNodes));
+
+    for (auto* p : pts) delete p;
+}
+
+TEST_CASE("Lock free octree build matches the task based build")
+{
+    // the lock free build sorts the points of a leaf by id and the task build keeps the
+    // input order, so the two only match for input in id order
+    std::vector<Particle*> pts = makeSpreadPoints(5000);
+
+    for (size_t maxPointsPerNode : { size_t(1), size_t(4) })
+    {
+        Octree reference(pts, Octree::BuildStrategy::Task, PARALLEL_THRESHOLD_FOR_INSERT, maxPointsPerNode);
+        Octree lockFree(pts, Octree::BuildStrategy::LockFree, PARALLEL_THRESHOLD_FOR_INSERT, maxPointsPerNode);
+
+        validateNodeRecursive(lockFree.mRoot, maxPointsPerNode);
+        REQUIRE(countPointsInTree(lockFree.mRoot) == pts.size());
+
+        size_t referenceNodes = 0, referenceDepth = 0;
+        size_t lockFreeNodes = 0, lockFreeDepth = 0;
+        countNodes(reference.mRoot, 0, referenceNodes, referenceDepth);
+        countNodes(lockFree.mRoot, 0, lockFreeNodes, lockFreeDepth);
+
+        REQUIRE(lockFreeNodes == referenceNodes);
+        REQUIRE(lockFreeDepth == referenceDepth);
+
+        // same leafs in the same order holding the same points in id order
+        REQUIRE(lockFree.mLeafNodes.size() == reference.mLeafNodes.size());
+        for (size_t i = 0; i < reference.mLeafNodes.size(); ++i)
+        {
+            REQUIRE(lockFree.mLeafNodes[i]->boundingBox.center == reference.mLeafNodes[i]->boundingBox.center);
+            REQUIRE(lockFree.mLeafNodes[i]->points == reference.mLeafNodes[i]->points);
+        }
+    }
+
+    // too few points to split, the root stays a leaf
+    std::vector<Particle*> few(pts.begin(), pts.begin() + 3);
+    Octree small(few, Octree::BuildStrategy::LockFree, PARALLEL_THRESHOLD_FOR_INSERT, 4);
+    REQUIRE(small.mRoot->isLeafNode());
+    REQUIRE(small.mRoot->points == few);
+
+    for (auto* p : pts) delete p;
+}
+
+TEST_CASE("Partition, hybrid and auto builds match the task based build")
+{
+    std::vector<Particle*> pts = makeSpreadPoints(20000);
+
+    // thresholds small enough for a few partitioned levels above the tasks
+    static constexpr size_t INSERT_THRESHOLD = 100;
+
+    // the row must not reach later tests, even if a check fails
+    struct ClearCalibration
+    {
+        ~ClearCalibration() { BuildCalibration::getInstance().mRows.clear(); }
+    } clearCalibration;
+
+    BuildCalibration::Row row;
+    row.threads = 1;
+    row.parallelThresholdForInsert = INSERT_THRESHOLD;
+    row.taskThreshold = 2000;
+    BuildCalibration::getInstance().setRow(row);
+
+    Octree reference(pts, Octree::BuildStrategy::Task, INSERT_THRESHOLD, 1);
+
+    for (auto strategy : { Octree::BuildStrategy::Partition, Octree::BuildStrategy::Hybrid, Octree::BuildStrategy::Auto })
+    {
+        Octree tree(pts, strategy, INSERT_THRESHOLD, 1);
+
+        validateNodeRecursive(tree.mRoot, 1);
+        REQUIRE(countPointsInTree(tree.mRoot) == pts.size());
+
+        REQUIRE(tree.mLeafNodes.size() == reference.mLeafNodes.size());
+        for (size_t i = 0; i < reference.mLeafNodes.size(); ++i)
+        {
+            REQUIRE(tree.mLeafNodes[i]->boundingBox.center == reference.mLeafNodes[i]->boundingBox.center);
+            REQUIRE(tree.mLeafNodes[i]->points == reference.mLeafNodes[i]->points);
+        }
+    }
+
+    Octree autoTree(pts, Octree::BuildStrategy::Auto, PARALLEL_THRESHOLD_FOR_INSERT, 1);
+    REQUIRE(autoTree.mParallelThresholdForInsert == INSERT_THRESHOLD);
+    REQUIRE(autoTree.mTaskThreshold == 2000);
+
+    // partition never hands a node to the tasks
+    Octree partition(pts, Octree::BuildStrategy::Partition, INSERT_THRESHOLD, 1);
+    REQUIRE(partition.mTaskThreshold == INSERT_THRESHOLD);
+
+    for (auto* p : pts) delete p;
+}
+
+TEST_CASE("Node blocks of a destroyed tree are reused by the next one")
+{
+    std::vector<Particle*> pts = makeSpreadPoints(20000);
+
+    size_t blocks = 0;
+    {
+        Octree tree(pts, Octree::BuildStrategy::Serial, PARALLEL_THRESHOLD_FOR_INSERT, 1);
+        blocks = tree.mBlocks.size();
+
+        // more nodes than one block holds
+        REQUIRE(blocks > 1);
+    }
+
+    // the same serial build takes the same blocks from the free list, a parallel build in
+    // between hands back what it took
+    for (auto strategy : { Octree::BuildStrategy::Task, Octree::BuildStrategy::Serial, Octree::BuildStrategy::LockFree, Octree::BuildStrategy::Serial })
+    {
+        const bool serial = strategy == Octree::BuildStrategy::Serial;
+        const size_t before = NodeBlocks::getInstance().numBlocks();
+
+        Octree tree(pts, strategy, PARALLEL_THRESHOLD_FOR_INSERT, 1);
+        validateNodeRecursive(tree.mRoot, 1);
+        REQUIRE(countPointsInTree(tree.mRoot) == pts.size());
+
+        if (serial)
+        {
+            REQUIRE(tree.mBlocks.size() == blocks);
+            REQUIRE(NodeBlocks::getInstance().numBlocks() == before);
+        }
+    }
+
+    for (auto* p : pts) delete p;
+}
+
+TEST_CASE("Build calibration round trips through its file and picks the closest row")
+{
+    auto& calibration = BuildCalibration::getInstance();
+    calibration.mRows.clear();
+
+    // no rows, the compiled in defaults
+    auto defaults = calibration.lookup(8);
+    REQUIRE(defaults.parallelThresholdForInsert == PARALLEL_THRESHOLD_FOR_INSERT);
+    REQUIRE(defaults.taskThreshold == THRESHOLD_FOR_TASK_BASED);
+
+    calibration.setRow({ 18, 1000, 50000 });
+    calibration.setRow({ 4, 100, std::numeric_limits<size_t>::max() });
+    calibration.setRow({ 36, 10000, 200000 });
+    calibration.setRow({ 18, 1000, 10000 });
+
+    REQUIRE(calibration.rows().size() == 3);
+    REQUIRE(calibration.lookup(2).threads == 4);
+    REQUIRE(calibration.lookup(9).threads == 4);
+    REQUIRE(calibration.lookup(18).taskThreshold == 10000);
+    REQUIRE(calibration.lookup(64).threads == 36);
+
+    const auto path = std::filesystem::temp_directory_path() / "octree_calibration_test.txt";
+    calibration.save(path.string());
+
+    calibration.mRows.clear();
+    calibration.load(path.string());
+
+    REQUIRE(calibration.rows().size() == 3);
+    REQUIRE(calibration.lookup(4).taskThreshold == std::numeric_limits<size_t>::max());
+    REQUIRE(calibration.lookup(18).parallelThresholdForInsert == 1000);
+    REQUIRE(calibration.lookup(36).taskThreshold == 200000);
+
+    // the traversal column is optional
+    calibration.setRow({ 9, 100, 10000, 16 });
+    calibration.save(path.string());
+    calibration.load(path.string());
+    REQUIRE(calibration.lookup(9).traversalWorkPerThread == 16);
+    REQUIRE(calibration.lookup(4).traversalWorkPerThread == TRAVERSAL_WORK_PER_THREAD);
+
+    {
+        std::ofstream file(path);
+        file << "4 100 never\n";
+    }
+    calibration.load(path.string());
+    REQUIRE(calibration.lookup(4).traversalWorkPerThread == TRAVERSAL_WORK_PER_THREAD);
+
+    {
+        std::ofstream file(path);
+        file << "# threads insert_threshold task_threshold\n4 100 never\n8 100\n";
+    }
+    REQUIRE_THROWS_AS(calibration.load(path.string()), std::runtime_error);
+    REQUIRE_THROWS_AS(calibration.load((path.string() + ".missing")), std::runtime_error);
+
+    REQUIRE(Octree::buildStrategyFromString("hybrid") == Octree::BuildStrategy::Hybrid);
+    REQUIRE(std::string(Octree::buildStrategyName(Octree::BuildStrategy::LockFree)) == "lockfree");
+    REQUIRE_THROWS_AS(Octree::buildStrategyFromString("fastest"), std::runtime_error);
+
+    std::filesystem::remove(path);
+    calibration.mRows.clear();
+}
@@ -1,13 +1,28 @@
 #pragma once
 
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <cmath>
+#include <cstdlib>
 #include <array>
 #include <vector>
 #include <string>
 #include <fstream>
 #include <stdexcept>
 #include <random>
-#include <fstream>
+#include <type_traits>
+#include <string_view>
+#include <charconv>
+#include <algorithm>
+#include <future>
+#include <bit>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <omp.h>
 
 namespace {
 namespace ParticleConfig
@@ -29,9 +44,31 @@ namespace ParticleConfig
         std::array<double, 2> accelerationLimits;
     };
 
+    enum class Format
+    {
+        Text,
+        Binary
+    };
+
+    // binary particle config
+    // layout: BinaryHeader followed by numParticles Particle records exactly as they are laid out in memory
+    struct BinaryHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t recordSize;
+        uint64_t numParticles;
+    };
+
+    static constexpr char BINARY_MAGIC[8] = {'N', 'B', 'O', 'D', 'Y', 'P', 'C', '\0'};
+    static constexpr uint32_t BINARY_VERSION = 1;
+
+    static_assert(std::is_trivially_copyable_v<Particle> && sizeof(Particle) == 11 * sizeof(double),
+                  "binary particle config requires a packed trivially copyable Particle");
+
     std::ostream& operator<<(std::ostream& os, const Particle& p)
     {
-        os << "Particle ID: " << p.id << std::endl;
+        os << "Particle ID: " << p.id << "\n";
 
         os << "Position: (" 
             << p.position[0] << ", " 
@@ -53,117 +90,1166 @@ namespace ParticleConfig
         return os;
     }
 
-    // assumes that if the file exists then it is well formed
-    static std::vector<Particle> parse(std::string fileName)
+    // returns Format::Binary if the file starts with the binary magic, otherwise assumes text
+    static Format detectFormat(const std::string& fileName)
     {
-        std::ifstream file(fileName);
-
-        std::vector<Particle> particles;
+        std::ifstream file(fileName, std::ios::binary);
 
         if (!file.is_open())
         {
             throw std::runtime_error("unable to open: " + fileName);
         }
-        else
+
+        char magic[sizeof(BINARY_MAGIC)] = {};
+        file.read(magic, sizeof(magic));
+
+        bool isBinary = file.gcount() == sizeof(magic) && std::memcmp(magic, BINARY_MAGIC, sizeof(magic)) == 0;
+
+        return isBinary ? Format::Binary : Format::Text;
+    }
+
+    namespace detail
+    {
+        // read only memory map of a whole file
+        class MappedFile
         {
-            std::string temp;
+        public:
+            MappedFile(const std::string& fileName)
+            {
+                int fd = ::open(fileName.c_str(), O_RDONLY);
+
+                if (fd == -1)
+                {
+                    throw std::runtime_error("unable to open: " + fileName);
+                }
+
+                struct stat fileStat{};
+                if (::fstat(fd, &fileStat) != 0)
+                {
+                    ::close(fd);
+                    throw std::runtime_error("unable to stat: " + fileName);
+                }
+
+                mSize = static_cast<size_t>(fileStat.st_size);
+                mModifiedNs = static_cast<int64_t>(fileStat.st_mtim.tv_sec) * 1000000000 + fileStat.st_mtim.tv_nsec;
+
+                // mmap of 0 bytes is invalid, an empty file is simply an empty view
+                if (mSize > 0)
+                {
+                    void* data = ::mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, fd, 0);
+                    if (data == MAP_FAILED)
+                    {
+                        ::close(fd);
+                        throw std::runtime_error("unable to mmap: " + fileName);
+                    }
+
+                    mData = static_cast<const char*>(data);
+                }
 
-            // skip first line since it is not needed
-            std::getline(file, temp);
+                ::close(fd);
+            }
 
-            while (file >> temp)
+            ~MappedFile()
             {
-                Particle particle;
+                if (mData)
+                {
+                    ::munmap(const_cast<char*>(mData), mSize);
+                }
+            }
+
+            MappedFile(const MappedFile&) = delete;
+            MappedFile& operator=(const MappedFile&) = delete;
+
+            inline std::string_view view() const
+            {
+                return std::string_view(mData, mSize);
+            }
+
+            inline int64_t modifiedNs() const
+            {
+                return mModifiedNs;
+            }
+
+        private:
+            const char* mData = nullptr;
+            size_t mSize = 0;
+            int64_t mModifiedNs = 0;
+        };
 
-                if (temp != "Particle")
+        // whitespace separated tokenizer over the text particle config format
+        struct TextCursor
+        {
+            const char* p;
+            const char* end;
+
+            inline void skipSpace()
+            {
+                while (p < end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t'))
                 {
-                    break; // invalid particle config
+                    ++p;
                 }
+            }
 
-                file >> temp;
-                file >> particle.id;
+            inline bool token(std::string_view expected)
+            {
+                skipSpace();
+                if (static_cast<size_t>(end - p) < expected.size() || std::string_view(p, expected.size()) != expected)
+                {
+                    return false;
+                }
 
-                file >> temp;
-                char c;
-                file >> c; // '('
-                file >> particle.position[0]; file >> c; // ','
-                file >> particle.position[1]; file >> c; // ','
-                file >> particle.position[2]; file >> c; // ')'
+                p += expected.size();
+                return true;
+            }
 
-                file >> temp; 
-                file >> c; // '('
-                file >> particle.velocity[0]; file >> c; // ','
-                file >> particle.velocity[1]; file >> c; // ','
-                file >> particle.velocity[2]; file >> c; // ')'
+            // skips labels such as "Position:"
+            inline bool skipToken()
+            {
+                skipSpace();
+                if (p == end) return false;
 
-                file >> temp;
-                file >> c; // '('
-                file >> particle.acceleration[0]; file >> c; // ','
-                file >> particle.acceleration[1]; file >> c; // ','
-                file >> particle.acceleration[2]; file >> c; // ')'
+                while (p < end && *p != ' ' && *p != '\n' && *p != '\r' && *p != '\t')
+                {
+                    ++p;
+                }
+                return true;
+            }
 
-                file >> temp;
-                file >> particle.mass;
+            inline bool expect(char c)
+            {
+                skipSpace();
+                if (p == end || *p != c) return false;
 
-                particles.push_back(particle);
+                ++p;
+                return true;
             }
+
+            template <class T>
+            inline bool number(T& out)
+            {
+                skipSpace();
+                auto result = std::from_chars(p, end, out);
+                if (result.ec != std::errc()) return false;
+
+                p = result.ptr;
+                return true;
+            }
+
+            // "Label: (x, y, z)"
+            inline bool vector3(std::array<double, 3>& out)
+            {
+                return skipToken() &&
+                       expect('(') && number(out[0]) &&
+                       expect(',') && number(out[1]) &&
+                       expect(',') && number(out[2]) &&
+                       expect(')');
+            }
+
+            inline bool particle(Particle& out)
+            {
+                return token("Particle") && skipToken() && number(out.id) &&
+                       vector3(out.position) &&
+                       vector3(out.velocity) &&
+                       vector3(out.acceleration) &&
+                       skipToken() && number(out.mass);
+            }
+        };
+    }
+
+    // parses in parallel: the file is memory mapped and split into chunks at
+    // "Particle" record boundaries, records are counted per chunk so every chunk
+    // can parse straight into its slot of the result
+    // parsing stops at the first malformed record (same as the original stream parser)
+    //
+    // allocate(count) is called once before any record is stored and store(index, particle)
+    // is called concurrently from the parsing threads, returns the number of valid records
+    template <class Allocate, class Store>
+    static size_t parseText(const std::string& fileName, Allocate&& allocate, Store&& store)
+    {
+        static constexpr std::string_view RECORD_START = "Particle";
+        static constexpr size_t MIN_CHUNK_BYTES = 1 << 20;
+
+        detail::MappedFile file(fileName);
+        const std::string_view text = file.view();
+
+        // first line: "Particle System with N particles:"
+        size_t headerEnd = text.find('\n');
+        if (headerEnd == std::string_view::npos)
+        {
+            allocate(0);
+            return 0;
         }
-        
-        return particles;
+
+        const std::string_view body = text.substr(headerEnd + 1);
+
+        const size_t maxChunks = 4 * static_cast<size_t>(omp_get_max_threads());
+        const size_t numChunks = std::max<size_t>(1, std::min(maxChunks, body.size() / MIN_CHUNK_BYTES));
+
+        std::vector<size_t> chunkStart(numChunks + 1, body.size());
+        chunkStart[0] = 0;
+        for (size_t chunk = 1; chunk < numChunks; ++chunk)
+        {
+            size_t pos = std::max(chunkStart[chunk - 1], (body.size() * chunk) / numChunks);
+            chunkStart[chunk] = std::min(body.find(RECORD_START, pos), body.size());
+        }
+
+        // count records in each chunk, the header count is only a hint so the records are what gets parsed
+        std::vector<size_t> chunkOffset(numChunks + 1, 0);
+        #pragma omp parallel for schedule(dynamic)
+        for (size_t chunk = 0; chunk < numChunks; ++chunk)
+        {
+            std::string_view chunkText = body.substr(chunkStart[chunk], chunkStart[chunk + 1] - chunkStart[chunk]);
+
+            size_t count = 0;
+            for (size_t pos = chunkText.find(RECORD_START); pos != std::string_view::npos; pos = chunkText.find(RECORD_START, pos + RECORD_START.size()))
+            {
+                ++count;
+            }
+            chunkOffset[chunk + 1] = count;
+        }
+
+        for (size_t chunk = 0; chunk < numChunks; ++chunk)
+        {
+            chunkOffset[chunk + 1] += chunkOffset[chunk];
+        }
+
+        allocate(chunkOffset[numChunks]);
+
+        std::vector<size_t> chunkParsed(numChunks, 0);
+        #pragma omp parallel for schedule(dynamic)
+        for (size_t chunk = 0; chunk < numChunks; ++chunk)
+        {
+            detail::TextCursor cursor{ body.data() + chunkStart[chunk], body.data() + chunkStart[chunk + 1] };
+
+            const size_t count = chunkOffset[chunk + 1] - chunkOffset[chunk];
+            size_t parsed = 0;
+            Particle particle;
+            while (parsed < count && cursor.particle(particle))
+            {
+                store(chunkOffset[chunk] + parsed, particle);
+                ++parsed;
+            }
+            chunkParsed[chunk] = parsed;
+        }
+
+        // truncate at the first malformed record
+        for (size_t chunk = 0; chunk < numChunks; ++chunk)
+        {
+            if (chunkParsed[chunk] != chunkOffset[chunk + 1] - chunkOffset[chunk])
+            {
+                return chunkOffset[chunk] + chunkParsed[chunk];
+            }
+        }
+
+        return chunkOffset[numChunks];
     }
 
-    static std::vector<Particle> generate(size_t numToGenerate, Limits& limits)
+    namespace detail
     {
-        struct helper
+        template <class Allocate, class Store>
+        size_t parseBinaryView(std::string_view data, const std::string& fileName, Allocate&& allocate, Store&& store)
         {
-            static double getRandomNumber(double lower, double upper)
+            BinaryHeader header{};
+            if (data.size() < sizeof(header))
+            {
+                throw std::runtime_error("not a valid binary particle config: " + fileName);
+            }
+            std::memcpy(&header, data.data(), sizeof(header));
+
+            if (std::memcmp(header.magic, BINARY_MAGIC, sizeof(BINARY_MAGIC)) != 0 ||
+                header.version != BINARY_VERSION ||
+                header.recordSize != sizeof(Particle))
+            {
+                throw std::runtime_error("not a valid binary particle config: " + fileName);
+            }
+
+            if ((data.size() - sizeof(header)) / sizeof(Particle) < header.numParticles)
             {
-                static std::mt19937_64 rng{std::random_device{}()};
-                std::uniform_real_distribution<double> distribution(lower, upper);
-                return distribution(rng);
+                throw std::runtime_error("truncated binary particle config: " + fileName);
+            }
+
+            const char* records = data.data() + sizeof(header);
+            const size_t numParticles = header.numParticles;
+
+            allocate(numParticles);
+
+            #pragma omp parallel for schedule(static)
+            for (size_t i = 0; i < numParticles; ++i)
+            {
+                Particle particle;
+                std::memcpy(&particle, records + i * sizeof(Particle), sizeof(Particle));
+                store(i, particle);
             }
+
+            return numParticles;
+        }
+    }
+
+    // same contract as the templated parseText, records are copied out of the mapped file in parallel
+    template <class Allocate, class Store>
+    static size_t parseBinary(const std::string& fileName, Allocate&& allocate, Store&& store)
+    {
+        detail::MappedFile file(fileName);
+        return detail::parseBinaryView(file.view(), fileName, allocate, store);
+    }
+
+    // auto detects text or binary
+    template <class Allocate, class Store>
+    static size_t parse(const std::string& fileName, Allocate&& allocate, Store&& store)
+    {
+        return detectFormat(fileName) == Format::Binary ? parseBinary(fileName, allocate, store) : parseText(fileName, allocate, store);
+    }
+
+    namespace detail
+    {
+        template <class ParseFunction>
+        std::vector<Particle> parseToVector(ParseFunction&& parseFunction)
+        {
+            std::vector<Particle> particles;
+            const size_t numParsed = parseFunction([&particles](size_t count) { particles.resize(count); },
+                                                   [&particles](size_t i, const Particle& particle) { particles[i] = particle; });
+            particles.resize(numParsed);
+
+            return particles;
+        }
+    }
+
+    static std::vector<Particle> parseText(const std::string& fileName)
+    {
+        return detail::parseToVector([&fileName](auto&& allocate, auto&& store) { return parseText(fileName, allocate, store); });
+    }
+
+    static std::vector<Particle> parseBinary(const std::string& fileName)
+    {
+        return detail::parseToVector([&fileName](auto&& allocate, auto&& store) { return parseBinary(fileName, allocate, store); });
+    }
+
+    static std::vector<Particle> parse(const std::string& fileName)
+    {
+        return detectFormat(fileName) == Format::Binary ? parseBinary(fileName) : parseText(fileName);
+    }
+
+    // opt-in cache of parsed text particle configs
+    // cache file: CacheKey followed by a regular binary particle config, it is only used
+    // while the size, modification time and content hash of the text file still match
+    struct CacheKey
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t reserved;
+        uint64_t fileSize;
+        int64_t modifiedNs;
+        uint64_t contentHash;
+    };
+
+    static constexpr char CACHE_MAGIC[8] = {'N', 'B', 'O', 'D', 'Y', 'C', 'C', '\0'};
+    static constexpr uint32_t CACHE_VERSION = 1;
+
+    enum class CacheResult
+    {
+        Hit,        // loaded from the cache
+        Written,    // cache missing or stale, parsed and (re)written
+        Failed,     // parsed but the cache could not be written
+        Bypassed    // input is already binary
+    };
+
+    namespace detail
+    {
+        inline uint64_t mix64(uint64_t z)
+        {
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+            return z ^ (z >> 31);
+        }
+
+        // fixed size blocks are hashed in parallel and combined in order so the
+        // hash does not depend on the number of threads (change detection, not crypto)
+        inline uint64_t contentHash(std::string_view data)
+        {
+            static constexpr size_t BLOCK_BYTES = 1 << 20;
+            const size_t numBlocks = (data.size() + BLOCK_BYTES - 1) / BLOCK_BYTES;
+
+            std::vector<uint64_t> blockHash(numBlocks);
+
+            #pragma omp parallel for schedule(static)
+            for (size_t block = 0; block < numBlocks; ++block)
+            {
+                const char* ptr = data.data() + block * BLOCK_BYTES;
+                const size_t size = std::min(BLOCK_BYTES, data.size() - block * BLOCK_BYTES);
+
+                uint64_t h = size;
+                size_t i = 0;
+                for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+                {
+                    uint64_t word;
+                    std::memcpy(&word, ptr + i, sizeof(word));
+                    h = std::rotl((h ^ word) * 0x9e3779b97f4a7c15ULL, 29);
+                }
+                for (; i < size; ++i)
+                {
+                    h = std::rotl((h ^ static_cast<unsigned char>(ptr[i])) * 0x9e3779b97f4a7c15ULL, 29);
+                }
+
+                blockHash[block] = mix64(h);
+            }
+
+            uint64_t hash = mix64(data.size());
+            for (uint64_t h : blockHash)
+            {
+                hash = mix64(hash ^ h) + 0x9e3779b97f4a7c15ULL;
+            }
+
+            return hash;
+        }
+
+        inline bool sameKey(const CacheKey& lhs, const CacheKey& rhs)
+        {
+            return std::memcmp(lhs.magic, rhs.magic, sizeof(lhs.magic)) == 0 &&
+                   lhs.version == rhs.version &&
+                   lhs.fileSize == rhs.fileSize &&
+                   lhs.modifiedNs == rhs.modifiedNs &&
+                   lhs.contentHash == rhs.contentHash;
+        }
+
+        // writable file mapping the parsed records are copied into while parsing
+        class CacheWriter
+        {
+        public:
+            CacheWriter(const std::string& path)
+                : mPath(path)
+                , mTempPath(path + ".tmp." + std::to_string(::getpid()))
+            {}
+
+            ~CacheWriter()
+            {
+                unmap();
+                if (mFd != -1)
+                {
+                    ::close(mFd);
+                    ::unlink(mTempPath.c_str());
+                }
+            }
+
+            CacheWriter(const CacheWriter&) = delete;
+            CacheWriter& operator=(const CacheWriter&) = delete;
+
+            // failures only disable the cache, the parse itself goes on
+            inline void open(size_t numParticles)
+            {
+                mFd = ::open(mTempPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+                if (mFd == -1) return;
+
+                mBytes = sizeof(CacheKey) + sizeof(BinaryHeader) + numParticles * sizeof(Particle);
+                if (::ftruncate(mFd, static_cast<off_t>(mBytes)) != 0) return;
+
+                void* data = ::mmap(nullptr, mBytes, PROT_READ | PROT_WRITE, MAP_SHARED, mFd, 0);
+                if (data == MAP_FAILED) return;
+
+                mData = static_cast<char*>(data);
+                mRecords = mData + sizeof(CacheKey) + sizeof(BinaryHeader);
+            }
+
+            inline void store(size_t i, const Particle& particle)
+            {
+                if (mRecords)
+                {
+                    std::memcpy(mRecords + i * sizeof(Particle), &particle, sizeof(Particle));
+                }
+            }
+
+            // the key goes in last so a partially written cache never matches
+            inline bool commit(const CacheKey& key, size_t numParticles)
+            {
+                if (!mData) return false;
+
+                BinaryHeader header{};
+                std::memcpy(header.magic, BINARY_MAGIC, sizeof(BINARY_MAGIC));
+                header.version = BINARY_VERSION;
+                header.recordSize = sizeof(Particle);
+                header.numParticles = numParticles;
+
+                std::memcpy(mData + sizeof(CacheKey), &header, sizeof(header));
+                std::memcpy(mData, &key, sizeof(key));
+                unmap();
+
+                // drop records past the first malformed one
+                const size_t bytes = sizeof(CacheKey) + sizeof(BinaryHeader) + numParticles * sizeof(Particle);
+                bool success = ::ftruncate(mFd, static_cast<off_t>(bytes)) == 0;
+                success = (::close(mFd) == 0) && success;
+                mFd = -1;
+
+                success = success && std::rename(mTempPath.c_str(), mPath.c_str()) == 0;
+                if (!success)
+                {
+                    ::unlink(mTempPath.c_str());
+                }
+
+                return success;
+            }
+
+        private:
+            inline void unmap()
+            {
+                if (mData)
+                {
+                    ::munmap(mData, mBytes);
+                }
+
+                mData = nullptr;
+                mRecords = nullptr;
+            }
+
+            std::string mPath;
+            std::string mTempPath;
+            int mFd = -1;
+            size_t mBytes = 0;
+            char* mData = nullptr;
+            char* mRecords = nullptr;
         };
+    }
+
+    // next to the input when cacheDirectory is empty, otherwise in cacheDirectory
+    // named after the input and a hash of its absolute path
+    static std::string cachePath(const std::string& fileName, const std::string& cacheDirectory)
+    {
+        if (cacheDirectory.empty())
+        {
+            return fileName + ".pcache";
+        }
 
-        std::vector<Particle> particles;
+        char* absolute = ::realpath(fileName.c_str(), nullptr);
+        std::string path = absolute ? absolute : fileName;
+        std::free(absolute);
 
-        for (size_t i = 0; i < numToGenerate; ++i)
+        const size_t slash = path.find_last_of('/');
+        const std::string name = (slash == std::string::npos) ? path : path.substr(slash + 1);
+
+        char hash[17] = {};
+        std::to_chars(hash, hash + 16, detail::contentHash(path), 16);
+
+        return cacheDirectory + "/" + name + "." + hash + ".pcache";
+    }
+
+    // same contract as parse, text inputs are loaded from the cache when it is still valid
+    // and parsed into the cache otherwise, the content hash is checked on every load
+    template <class Allocate, class Store>
+    static size_t parseCached(const std::string& fileName, const std::string& cacheDirectory, Allocate&& allocate, Store&& store, CacheResult& result)
+    {
+        if (detectFormat(fileName) == Format::Binary)
         {
-            particles.emplace_back(Particle{
-                                            { helper::getRandomNumber(limits.boundingBox[0][0], limits.boundingBox[1][0]),
-                                              helper::getRandomNumber(limits.boundingBox[0][1], limits.boundingBox[1][1]),
-                                              helper::getRandomNumber(limits.boundingBox[0][2], limits.boundingBox[1][2]) }, 
-                                            { helper::getRandomNumber(limits.velocityLimits[0], limits.velocityLimits[1]),
-                                              helper::getRandomNumber(limits.velocityLimits[0], limits.velocityLimits[1]),
-                                              helper::getRandomNumber(limits.velocityLimits[0], limits.velocityLimits[1]) }, 
-                                            { helper::getRandomNumber(limits.accelerationLimits[0], limits.accelerationLimits[1]),
-                                              helper::getRandomNumber(limits.accelerationLimits[0], limits.accelerationLimits[1]),
-                                              helper::getRandomNumber(limits.accelerationLimits[0], limits.accelerationLimits[1]) },
-                                            helper::getRandomNumber(limits.massLimits[0], limits.massLimits[1]),
-                                            i });
+            result = CacheResult::Bypassed;
+            return parseBinary(fileName, allocate, store);
         }
 
-        return particles;
+        CacheKey key{};
+        {
+            detail::MappedFile input(fileName);
+            std::memcpy(key.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+            key.version = CACHE_VERSION;
+            key.fileSize = input.view().size();
+            key.modifiedNs = input.modifiedNs();
+            key.contentHash = detail::contentHash(input.view());
+        }
+
+        const std::string path = cachePath(fileName, cacheDirectory);
+
+        // a missing, stale or unreadable cache is just a miss
+        try
+        {
+            detail::MappedFile cache(path);
+            const std::string_view data = cache.view();
+
+            CacheKey cachedKey{};
+            if (data.size() >= sizeof(CacheKey))
+            {
+                std::memcpy(&cachedKey, data.data(), sizeof(CacheKey));
+
+                if (detail::sameKey(key, cachedKey))
+                {
+                    const size_t numParsed = detail::parseBinaryView(data.substr(sizeof(CacheKey)), path, allocate, store);
+                    result = CacheResult::Hit;
+                    return numParsed;
+                }
+            }
+        }
+        catch (const std::exception&)
+        {
+        }
+
+        detail::CacheWriter writer(path);
+
+        const size_t numParsed = parseText(fileName,
+                                           [&](size_t count) { allocate(count); writer.open(count); },
+                                           [&](size_t i, const Particle& particle) { store(i, particle); writer.store(i, particle); });
+
+        result = writer.commit(key, numParsed) ? CacheResult::Written : CacheResult::Failed;
+        return numParsed;
     }
 
-    static void generate(size_t numToGenerate, Limits& limits, std::string& filename)
+    static std::vector<Particle> parseCached(const std::string& fileName, const std::string& cacheDirectory, CacheResult& result)
     {
-        std::ofstream file(filename, std::ios::out | std::ios::trunc);
-        
+        return detail::parseToVector([&](auto&& allocate, auto&& store) { return parseCached(fileName, cacheDirectory, allocate, store, result); });
+    }
+
+    namespace detail
+    {
+        // upper bound of one text record, %g of a double is at most 13 characters
+        static constexpr size_t MAX_TEXT_RECORD_BYTES = 256;
+
+        inline char* appendText(char* out, std::string_view text)
+        {
+            std::memcpy(out, text.data(), text.size());
+            return out + text.size();
+        }
+
+        // same formatting as the default ostream (%g, 6 significant digits)
+        inline char* appendNumber(char* out, double value)
+        {
+            return std::to_chars(out, out + 32, value, std::chars_format::general, 6).ptr;
+        }
+
+        inline char* appendVector(char* out, std::string_view label, const std::array<double, 3>& v)
+        {
+            out = appendText(out, label);
+            out = appendNumber(out, v[0]);
+            out = appendText(out, ", ");
+            out = appendNumber(out, v[1]);
+            out = appendText(out, ", ");
+            out = appendNumber(out, v[2]);
+            return appendText(out, ")\n");
+        }
+
+        // byte for byte identical to operator<<
+        inline char* formatParticle(char* out, const Particle& p)
+        {
+            out = appendText(out, "Particle ID: ");
+            out = std::to_chars(out, out + 32, p.id).ptr;
+            out = appendText(out, "\n");
+            out = appendVector(out, "Position: (", p.position);
+            out = appendVector(out, "Velocity: (", p.velocity);
+            out = appendVector(out, "Acceleration: (", p.acceleration);
+            out = appendText(out, "Mass: ");
+            out = appendNumber(out, p.mass);
+            return appendText(out, "\n");
+        }
+    }
+
+    // streams numParticles records returned by makeParticle(index) to filename
+    // records are produced and formatted in parallel one chunk at a time while the
+    // previous chunk is being written, so the whole set is never held in memory
+    template <class F>
+    static void writeStream(size_t numParticles, F&& makeParticle, const std::string& filename, Format format = Format::Text)
+    {
+        static constexpr size_t CHUNK_SIZE = 1 << 16;
+
+        std::ofstream file(filename, std::ios::out | std::ios::trunc | std::ios::binary);
+
         if (!file.is_open())
         {
             throw std::runtime_error("unable to open: " + filename + " to create particle config file");
         }
+
+        if (format == Format::Binary)
+        {
+            BinaryHeader header{};
+            std::memcpy(header.magic, BINARY_MAGIC, sizeof(BINARY_MAGIC));
+            header.version = BINARY_VERSION;
+            header.recordSize = sizeof(Particle);
+            header.numParticles = numParticles;
+
+            file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        }
         else
         {
-            file << "Particle System with " << numToGenerate << " particles:\n";
+            std::string header = "Particle System with " + std::to_string(numParticles) + " particles:\n";
+            file.write(header.data(), header.size());
+        }
+
+        // each chunk is split into blocks, a block is formatted by one thread into
+        // its own region of the chunk buffer and regions are written in order
+        const size_t numBlocks = static_cast<size_t>(omp_get_max_threads());
+        const size_t bytesPerRecord = (format == Format::Binary) ? sizeof(Particle) : detail::MAX_TEXT_RECORD_BYTES;
+
+        struct Chunk
+        {
+            std::vector<char> buffer;
+            std::vector<size_t> blockBytes;
+        };
 
-            auto particles = generate(numToGenerate, limits);
-            for (const auto& particle : particles)
+        std::array<Chunk, 2> chunks;
+        for (auto& chunk : chunks)
+        {
+            chunk.buffer.resize(CHUNK_SIZE * bytesPerRecord);
+            chunk.blockBytes.resize(numBlocks);
+        }
+
+        std::future<void> pendingWrite;
+
+        for (size_t chunkStart = 0, chunkId = 0; chunkStart < numParticles; chunkStart += CHUNK_SIZE, ++chunkId)
+        {
+            Chunk& chunk = chunks[chunkId % 2];
+            const size_t chunkCount = std::min(CHUNK_SIZE, numParticles - chunkStart);
+
+            #pragma omp parallel for schedule(static, 1)
+            for (size_t block = 0; block < numBlocks; ++block)
             {
-                file << particle;
+                const size_t begin = (chunkCount * block) / numBlocks;
+                const size_t end = (chunkCount * (block + 1)) / numBlocks;
+
+                char* const blockStart = chunk.buffer.data() + begin * bytesPerRecord;
+                char* out = blockStart;
+
+                for (size_t i = begin; i < end; ++i)
+                {
+                    const Particle particle = makeParticle(chunkStart + i);
+
+                    if (format == Format::Binary)
+                    {
+                        std::memcpy(out, &particle, sizeof(Particle));
+                        out += sizeof(Particle);
+                    }
+                    else
+                    {
+                        out = detail::formatParticle(out, particle);
+                    }
+                }
+
+                chunk.blockBytes[block] = static_cast<size_t>(out - blockStart);
             }
+
+            // only one chunk is written at a time which also frees the other buffer
+            if (pendingWrite.valid())
+            {
+                pendingWrite.get();
+            }
+
+            pendingWrite = std::async(std::launch::async, [&file, &chunk, chunkCount, numBlocks, bytesPerRecord]()
+            {
+                for (size_t block = 0; block < numBlocks; ++block)
+                {
+                    const size_t begin = (chunkCount * block) / numBlocks;
+                    file.write(chunk.buffer.data() + begin * bytesPerRecord, chunk.blockBytes[block]);
+                }
+            });
+        }
+
+        if (pendingWrite.valid())
+        {
+            pendingWrite.get();
+        }
+
+        if (!file)
+        {
+            throw std::runtime_error("failed writing particle config file: " + filename);
         }
 
         file.close();
     }
+
+    static void write(const std::vector<Particle>& particles, const std::string& filename, Format format = Format::Text)
+    {
+        writeStream(particles.size(), [&particles](size_t i) { return particles[i]; }, filename, format);
+    }
+
+    namespace detail
+    {
+        // counter based generator (splitmix64): particle i draws from a stream derived
+        // from (seed, i) only, so the output for a seed does not depend on how the
+        // particles are distributed over threads
+        class CounterRng
+        {
+        public:
+            CounterRng(uint64_t seed, uint64_t counter)
+                : mState(mix(seed) + counter * 0xd1b54a32d192ed03ULL)
+            {}
+
+            inline uint64_t next()
+            {
+                return mix(mState += 0x9e3779b97f4a7c15ULL);
+            }
+
+            // uniform in [lower, upper)
+            inline double uniform(double lower, double upper)
+            {
+                return lower + (upper - lower) * (static_cast<double>(next() >> 11) * 0x1.0p-53);
+            }
+
+        private:
+            static inline uint64_t mix(uint64_t z)
+            {
+                z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+                z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+                return z ^ (z >> 31);
+            }
+
+            uint64_t mState;
+        };
+    }
+
+    static uint64_t randomSeed()
+    {
+        std::random_device device;
+        return (static_cast<uint64_t>(device()) << 32) | device();
+    }
+
+    static Particle generateParticle(size_t index, const Limits& limits, uint64_t seed)
+    {
+        detail::CounterRng rng(seed, index);
+
+        Particle particle;
+        for (size_t d = 0; d < 3; ++d)
+        {
+            particle.position[d] = rng.uniform(limits.boundingBox[0][d], limits.boundingBox[1][d]);
+        }
+        for (size_t d = 0; d < 3; ++d)
+        {
+            particle.velocity[d] = rng.uniform(limits.velocityLimits[0], limits.velocityLimits[1]);
+        }
+        for (size_t d = 0; d < 3; ++d)
+        {
+            particle.acceleration[d] = rng.uniform(limits.accelerationLimits[0], limits.accelerationLimits[1]);
+        }
+        particle.mass = rng.uniform(limits.massLimits[0], limits.massLimits[1]);
+        particle.id = index;
+
+        return particle;
+    }
+
+    // same seed gives identical particles regardless of the number of threads
+    static std::vector<Particle> generate(size_t numToGenerate, Limits& limits, uint64_t seed)
+    {
+        std::vector<Particle> particles(numToGenerate);
+
+        #pragma omp parallel for schedule(static)
+        for (size_t i = 0; i < numToGenerate; ++i)
+        {
+            particles[i] = generateParticle(i, limits, seed);
+        }
+
+        return particles;
+    }
+
+    static std::vector<Particle> generate(size_t numToGenerate, Limits& limits)
+    {
+        return generate(numToGenerate, limits, randomSeed());
+    }
+
+    // streams straight to the file, identical to write(generate(numToGenerate, limits, seed), ...)
+    static void generate(size_t numToGenerate, Limits& limits, std::string& filename, uint64_t seed, Format format = Format::Text)
+    {
+        writeStream(numToGenerate, [&limits, seed](size_t i) { return generateParticle(i, limits, seed); }, filename, format);
+    }
+
+    static void generate(size_t numToGenerate, Limits& limits, std::string& filename, Format format = Format::Text)
+    {
+        generate(numToGenerate, limits, filename, randomSeed(), format);
+    }
+
+    // structured initial conditions, SI units to match Particle::applyForce
+    enum class Distribution
+    {
+        Plummer,            // plummer sphere with scale radius a, truncated at 10a
+        Hernquist,          // hernquist halo with scale radius a, truncated at 20a
+        ExponentialDisk,    // exponential disk with scale length a and sech^2 scale height 0.1a
+        GalaxyPair,         // two plummer spheres on a parabolic collision course
+        Clustered           // soneira-peebles hierarchy inside a sphere of radius a
+    };
+
+    struct Model
+    {
+        Distribution distribution = Distribution::Plummer;
+        double totalMass = 1.0e9;                       // kg, split evenly between the particles
+        double scaleRadius = 100.0;                     // m
+        std::array<double, 3> center = {0.0, 0.0, 0.0};
+        double gravitationalConstant = 6.6743e-11;
+
+        // galaxy pair, 0 picks 10 scale radii apart with an impact parameter of 1 scale radius
+        double separation = 0.0;
+        double impactParameter = 0.0;
+
+        // soneira-peebles, every level splits a sphere into subclusters spheres radiusRatio times smaller
+        size_t levels = 4;
+        size_t subclusters = 4;
+        double radiusRatio = 1.9;
+    };
+
+    static Distribution distributionFromString(const std::string& name)
+    {
+        if (name == "plummer")   return Distribution::Plummer;
+        if (name == "hernquist") return Distribution::Hernquist;
+        if (name == "disk")      return Distribution::ExponentialDisk;
+        if (name == "pair")      return Distribution::GalaxyPair;
+        if (name == "clustered") return Distribution::Clustered;
+
+        throw std::runtime_error("unknown distribution: " + name);
+    }
+
+    namespace detail
+    {
+        static constexpr double PI = 3.14159265358979323846;
+
+        // uniform in (0, 1], safe for log and pow with negative exponents
+        inline double openUniform(CounterRng& rng)
+        {
+            return 1.0 - rng.uniform(0.0, 1.0);
+        }
+
+        inline double gaussian(CounterRng& rng)
+        {
+            const double radius = std::sqrt(-2.0 * std::log(openUniform(rng)));
+            return radius * std::cos(2.0 * PI * rng.uniform(0.0, 1.0));
+        }
+
+        inline std::array<double, 3> isotropic(CounterRng& rng, double length)
+        {
+            const double z = rng.uniform(-1.0, 1.0);
+            const double phi = rng.uniform(0.0, 2.0 * PI);
+            const double r = std::sqrt(1.0 - z * z);
+
+            return { length * r * std::cos(phi), length * r * std::sin(phi), length * z };
+        }
+
+        inline std::array<double, 3> inSphere(CounterRng& rng, double radius)
+        {
+            return isotropic(rng, radius * std::cbrt(rng.uniform(0.0, 1.0)));
+        }
+
+        inline std::array<double, 3> gaussian3(CounterRng& rng, double sigma)
+        {
+            return { sigma * gaussian(rng), sigma * gaussian(rng), sigma * gaussian(rng) };
+        }
+
+        inline void add(std::array<double, 3>& lhs, const std::array<double, 3>& rhs)
+        {
+            for (size_t d = 0; d < 3; ++d) lhs[d] += rhs[d];
+        }
+
+        // aarseth, henon & wielen (1974), isotropic distribution function
+        inline void samplePlummer(CounterRng& rng, double mass, double a, double G,
+                                  std::array<double, 3>& position, std::array<double, 3>& velocity)
+        {
+            double r;
+            do
+            {
+                r = a / std::sqrt(std::pow(openUniform(rng), -2.0 / 3.0) - 1.0);
+            } while (!(r <= 10.0 * a));
+
+            position = isotropic(rng, r);
+
+            // speed as a fraction q of the local escape speed, g(q) = q^2 (1 - q^2)^3.5 peaks below 0.1
+            double q, g;
+            do
+            {
+                q = rng.uniform(0.0, 1.0);
+                g = rng.uniform(0.0, 0.1);
+            } while (g > q * q * std::pow(1.0 - q * q, 3.5));
+
+            const double escape = std::sqrt(2.0 * G * mass) * std::pow(r * r + a * a, -0.25);
+            velocity = isotropic(rng, q * escape);
+        }
+
+        // hernquist (1990), gaussian velocities with the isotropic jeans dispersion (eq. 10)
+        inline void sampleHernquist(CounterRng& rng, double mass, double a, double G,
+                                    std::array<double, 3>& position, std::array<double, 3>& velocity)
+        {
+            const double rMax = 20.0 * a;
+            // scale the untruncated halo so that the mass inside rMax is the requested mass
+            const double haloMass = mass * (rMax + a) * (rMax + a) / (rMax * rMax);
+
+            double r;
+            do
+            {
+                const double m = std::sqrt(rng.uniform(0.0, 1.0));
+                r = a * m / (1.0 - m);
+            } while (r > rMax);
+
+            position = isotropic(rng, r);
+
+            const double s = r / a;
+            double sigma2 = 0.0;
+            if (s > 1.0e-6)
+            {
+                sigma2 = G * haloMass / (12.0 * a) *
+                         (12.0 * s * std::pow(1.0 + s, 3) * std::log((1.0 + s) / s) -
+                          s / (1.0 + s) * (25.0 + 52.0 * s + 42.0 * s * s + 12.0 * s * s * s));
+            }
+            const double sigma = std::sqrt(std::max(sigma2, 0.0));
+
+            // keep the particles bound
+            const double maxSpeed2 = 0.95 * 0.95 * 2.0 * G * haloMass / (r + a);
+            do
+            {
+                velocity = gaussian3(rng, sigma);
+            } while (velocity[0] * velocity[0] + velocity[1] * velocity[1] + velocity[2] * velocity[2] > maxSpeed2);
+        }
+
+        // surface density ~ exp(-R/a), circular velocity of a thin exponential disk from freeman (1970)
+        // plus a 10% velocity dispersion
+        inline void sampleExponentialDisk(CounterRng& rng, double mass, double a, double G,
+                                          std::array<double, 3>& position, std::array<double, 3>& velocity)
+        {
+            double R;
+            do
+            {
+                R = -a * std::log(openUniform(rng) * openUniform(rng));
+            } while (R > 10.0 * a);
+
+            const double phi = rng.uniform(0.0, 2.0 * PI);
+
+            double u;
+            do
+            {
+                u = rng.uniform(0.0, 1.0);
+            } while (u == 0.0);
+            const double z = 0.05 * a * std::log(u / (1.0 - u));
+
+            position = { R * std::cos(phi), R * std::sin(phi), z };
+
+            const double y = R / (2.0 * a);
+            double vc = 0.0;
+            if (y > 1.0e-8)
+            {
+                const double bessel = std::cyl_bessel_i(0.0, y) * std::cyl_bessel_k(0.0, y) -
+                                      std::cyl_bessel_i(1.0, y) * std::cyl_bessel_k(1.0, y);
+                vc = std::sqrt(std::max(2.0 * G * mass / a * y * y * bessel, 0.0));
+            }
+
+            velocity = gaussian3(rng, 0.1 * vc);
+            velocity[0] -= vc * std::sin(phi);
+            velocity[1] += vc * std::cos(phi);
+        }
+
+        // every subcluster draws its offset and bulk velocity from a stream keyed by its node id so
+        // all particles in it agree without any shared state, velocities at each level are the
+        // virial dispersion of a uniform sphere, sigma^2 = GM / 5R
+        inline void sampleClustered(CounterRng& rng, const Model& model, uint64_t seed, double G,
+                                    std::array<double, 3>& position, std::array<double, 3>& velocity)
+        {
+            const uint64_t eta = model.subclusters;
+
+            uint64_t numLeaves = 1;
+            for (size_t level = 0; level < model.levels; ++level) numLeaves *= eta;
+
+            uint64_t leaf = rng.next() % numLeaves;
+            uint64_t span = numLeaves;
+            uint64_t nodeId = 0;
+
+            double radius = model.scaleRadius;
+            double mass = model.totalMass;
+
+            position = {0.0, 0.0, 0.0};
+            velocity = {0.0, 0.0, 0.0};
+
+            for (size_t level = 0; level < model.levels; ++level)
+            {
+                span /= eta;
+                nodeId = nodeId * eta + (leaf / span) + 1;
+                leaf %= span;
+
+                CounterRng nodeRng(seed ^ 0x243f6a8885a308d3ULL, nodeId);
+
+                const double childRadius = radius / model.radiusRatio;
+                add(position, inSphere(nodeRng, radius - childRadius));
+                add(velocity, gaussian3(nodeRng, std::sqrt(G * mass / (5.0 * radius))));
+
+                radius = childRadius;
+                mass /= static_cast<double>(eta);
+            }
+
+            add(position, inSphere(rng, radius));
+            add(velocity, gaussian3(rng, std::sqrt(G * mass / (5.0 * radius))));
+        }
+    }
+
+    static void validateModel(const Model& model)
+    {
+        if (model.totalMass <= 0.0 || model.scaleRadius <= 0.0)
+        {
+            throw std::runtime_error("model mass and scale radius must be positive");
+        }
+
+        if (model.distribution == Distribution::Clustered)
+        {
+            if (model.subclusters < 2 || model.radiusRatio <= 1.0 ||
+                static_cast<double>(model.levels) * std::log2(static_cast<double>(model.subclusters)) > 48.0)
+            {
+                throw std::runtime_error("clustered model needs subclusters >= 2, radius ratio > 1 and at most 2^48 leaf clusters");
+            }
+        }
+    }
+
+    // same seed gives identical particles regardless of the number of threads, particles are
+    // drawn independently so the system is only in equilibrium up to sampling noise
+    static Particle generateParticle(size_t index, size_t numParticles, const Model& model, uint64_t seed)
+    {
+        detail::CounterRng rng(seed, index);
+
+        const double G = model.gravitationalConstant;
+        const double a = model.scaleRadius;
+
+        Particle particle;
+        particle.acceleration = {0.0, 0.0, 0.0};
+        particle.mass = model.totalMass / static_cast<double>(numParticles);
+        particle.id = index;
+
+        switch (model.distribution)
+        {
+        case Distribution::Plummer:
+            detail::samplePlummer(rng, model.totalMass, a, G, particle.position, particle.velocity);
+            break;
+        case Distribution::Hernquist:
+            detail::sampleHernquist(rng, model.totalMass, a, G, particle.position, particle.velocity);
+            break;
+        case Distribution::ExponentialDisk:
+            detail::sampleExponentialDisk(rng, model.totalMass, a, G, particle.position, particle.velocity);
+            break;
+        case Distribution::GalaxyPair:
+        {
+            const double galaxyMass = 0.5 * model.totalMass;
+            detail::samplePlummer(rng, galaxyMass, a, G, particle.position, particle.velocity);
+
+            const double separation = model.separation > 0.0 ? model.separation : 10.0 * a;
+            const double impact = model.impactParameter > 0.0 ? model.impactParameter : a;
+
+            // parabolic encounter, the galaxies approach along x offset by the impact parameter in y
+            const double distance = std::sqrt(separation * separation + impact * impact);
+            const double approach = std::sqrt(2.0 * G * model.totalMass / distance);
+            const double side = index < numParticles / 2 ? -0.5 : 0.5;
+
+            particle.position[0] += side * separation;
+            particle.position[1] += side * impact;
+            particle.velocity[0] -= side * approach;
+            break;
+        }
+        case Distribution::Clustered:
+            detail::sampleClustered(rng, model, seed, G, particle.position, particle.velocity);
+            break;
+        }
+
+        detail::add(particle.position, model.center);
+
+        return particle;
+    }
+
+    static std::vector<Particle> generate(size_t numToGenerate, const Model& model, uint64_t seed)
+    {
+        validateModel(model);
+
+        std::vector<Particle> particles(numToGenerate);
+
+        #pragma omp parallel for schedule(static)
+        for (size_t i = 0; i < numToGenerate; ++i)
+        {
+            particles[i] = generateParticle(i, numToGenerate, model, seed);
+        }
+
+        return particles;
+    }
+
+    static void generate(size_t numToGenerate, const Model& model, std::string& filename, uint64_t seed, Format format = Format::Text)
+    {
+        validateModel(model);
+
+        writeStream(numToGenerate, [&model, numToGenerate, seed](size_t i) { return generateParticle(i, numToGenerate, model, seed); }, filename, format);
+    }
 } }
\ No newline at end of file
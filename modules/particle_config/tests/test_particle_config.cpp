@@ -2,7 +2,11 @@
 #include <catch2/catch_all.hpp>
 
 #include <filesystem>
+#include <fstream>
 #include <string>
+#include <sstream>
+#include <cmath>
+#include <omp.h>
 
 #include "particle_config.hpp"
 
@@ -159,6 +163,123 @@ TEST_CASE("Particle generation returns particles within limits", "[particle][gen
 }
 
 
+TEST_CASE("Seeded particle generation is reproducible regardless of thread count", "[particle][generate]")
+{
+    ParticleConfig::Limits limits;
+    limits.boundingBox         = {{ { -10.0, -5.0, 0.0 }, { 10.0, 5.0, 1.0 } }};
+    limits.massLimits          = { 1.0, 5.0 };
+    limits.velocityLimits      = { -2.0, 2.0 };
+    limits.accelerationLimits  = { -0.5, 0.5 };
+
+    const size_t N = 10000;
+    const int maxThreads = omp_get_max_threads();
+
+    omp_set_num_threads(1);
+    auto serial = ParticleConfig::generate(N, limits, 587);
+
+    omp_set_num_threads(4);
+    auto parallel = ParticleConfig::generate(N, limits, 587);
+    auto otherSeed = ParticleConfig::generate(N, limits, 588);
+
+    omp_set_num_threads(maxThreads);
+
+    REQUIRE(serial.size() == N);
+    REQUIRE(parallel.size() == N);
+
+    size_t numDifferent = 0;
+    for (size_t i = 0; i < N; ++i)
+    {
+        REQUIRE(serial[i].id == parallel[i].id);
+        REQUIRE(serial[i].position == parallel[i].position);
+        REQUIRE(serial[i].velocity == parallel[i].velocity);
+        REQUIRE(serial[i].acceleration == parallel[i].acceleration);
+        REQUIRE(serial[i].mass == parallel[i].mass);
+
+        numDifferent += (serial[i].position != otherSeed[i].position) ? 1 : 0;
+    }
+
+    REQUIRE(numDifferent == N);
+}
+
+TEST_CASE("Structured models are reproducible and in virial equilibrium", "[particle][generate][model]")
+{
+    const size_t N = 2000;
+    const int maxThreads = omp_get_max_threads();
+
+    for (const std::string name : { "plummer", "hernquist", "disk", "pair", "clustered" })
+    {
+        DYNAMIC_SECTION(name)
+        {
+            ParticleConfig::Model model;
+            model.distribution = ParticleConfig::distributionFromString(name);
+            model.totalMass = 1.0e9;
+            model.scaleRadius = 100.0;
+
+            omp_set_num_threads(1);
+            auto serial = ParticleConfig::generate(N, model, 587);
+
+            omp_set_num_threads(4);
+            auto parallel = ParticleConfig::generate(N, model, 587);
+
+            omp_set_num_threads(maxThreads);
+
+            REQUIRE(serial.size() == N);
+
+            double totalMass = 0.0;
+            for (size_t i = 0; i < N; ++i)
+            {
+                REQUIRE(serial[i].id == i);
+                REQUIRE(serial[i].position == parallel[i].position);
+                REQUIRE(serial[i].velocity == parallel[i].velocity);
+                REQUIRE(std::isfinite(serial[i].velocity[0] + serial[i].velocity[1] + serial[i].velocity[2]));
+                totalMass += serial[i].mass;
+            }
+            REQUIRE(totalMass == Catch::Approx(model.totalMass));
+
+            // the galaxy pair carries orbital energy and the clustered hierarchy is not relaxed
+            if (model.distribution == ParticleConfig::Distribution::GalaxyPair ||
+                model.distribution == ParticleConfig::Distribution::Clustered)
+            {
+                continue;
+            }
+
+            std::array<double, 3> meanVelocity = { 0.0, 0.0, 0.0 };
+            for (const auto& p : serial)
+            {
+                for (size_t d = 0; d < 3; ++d) meanVelocity[d] += p.velocity[d] / N;
+            }
+
+            double kinetic = 0.0;
+            double potential = 0.0;
+            for (size_t i = 0; i < N; ++i)
+            {
+                double v2 = 0.0;
+                for (size_t d = 0; d < 3; ++d)
+                {
+                    const double v = serial[i].velocity[d] - meanVelocity[d];
+                    v2 += v * v;
+                }
+                kinetic += 0.5 * serial[i].mass * v2;
+
+                for (size_t j = i + 1; j < N; ++j)
+                {
+                    double r2 = 0.0;
+                    for (size_t d = 0; d < 3; ++d)
+                    {
+                        const double dx = serial[i].position[d] - serial[j].position[d];
+                        r2 += dx * dx;
+                    }
+                    potential -= model.gravitationalConstant * serial[i].mass * serial[j].mass / std::sqrt(r2);
+                }
+            }
+
+            const double virialRatio = 2.0 * kinetic / -potential;
+            REQUIRE(virialRatio > 0.85);
+            REQUIRE(virialRatio < 1.15);
+        }
+    }
+}
+
 TEST_CASE("Particle::generate creates a valid output file", "[particle][generate][file]")
 {
     ParticleConfig::Limits limits;
@@ -208,4 +329,191 @@ TEST_CASE("Particle::generate creates a valid output file", "[particle][generate
     // Clean up after test
     std::filesystem::remove(filename);
     REQUIRE(!std::filesystem::exists(filename));
-}
\ No newline at end of file
+}
+
+TEST_CASE("Text parsing splits large files into chunks and stops at the first malformed record", "[particle][parse]")
+{
+    // about 6 MB of records, several 1 MB chunks at 1 and at 4 threads
+    const size_t N = 40000;
+    const size_t malformed = 30000;
+
+    // values that print exactly with the default stream precision
+    std::vector<ParticleConfig::Particle> expected(N);
+    for (size_t i = 0; i < N; ++i)
+    {
+        auto& p = expected[i];
+        p.id = i;
+        p.position = { (i % 1000) * 0.25, -static_cast<double>(i % 777), (i % 13) * 0.5 };
+        p.velocity = { (i % 7) * 0.125, 1.0, -2.5 };
+        p.acceleration = { 0.0, (i % 5) * 0.75, -0.25 };
+        p.mass = 1.0 + (i % 9);
+    }
+
+    std::string filename = "test_particle_chunks.txt";
+    {
+        std::ofstream file(filename);
+        file << "Particle System with " << N << " particles:\n";
+
+        for (size_t i = 0; i < N; ++i)
+        {
+            if (i == malformed)
+            {
+                file << "Particle ID: " << i << "\nPosition: (1, 2, 3)\nVelocity: (1, 2, 3)\n"
+                     << "Acceleration: (1, 2, 3)\nMass: oops\n";
+                continue;
+            }
+
+            file << expected[i];
+        }
+    }
+
+    REQUIRE(std::filesystem::file_size(filename) > 4 * (1 << 20));
+
+    const int maxThreads = omp_get_max_threads();
+
+    for (int threads : { 1, 4 })
+    {
+        omp_set_num_threads(threads);
+        auto particles = ParticleConfig::parse(filename);
+
+        // the malformed record is in a later chunk, everything after it is dropped
+        REQUIRE(particles.size() == malformed);
+        for (size_t i = 0; i < malformed; ++i)
+        {
+            REQUIRE(particles[i].id == expected[i].id);
+            REQUIRE(particles[i].position == expected[i].position);
+            REQUIRE(particles[i].velocity == expected[i].velocity);
+            REQUIRE(particles[i].acceleration == expected[i].acceleration);
+            REQUIRE(particles[i].mass == expected[i].mass);
+        }
+    }
+
+    omp_set_num_threads(maxThreads);
+
+    std::filesystem::remove(filename);
+}
+
+TEST_CASE("Binary particle config round trips and is auto detected", "[particle][binary]")
+{
+    std::filesystem::path textFile = base() / "inputs" / "test_particle_config0.txt";
+    auto expected = ParticleConfig::parse(textFile.string());
+
+    REQUIRE(ParticleConfig::detectFormat(textFile.string()) == ParticleConfig::Format::Text);
+
+    std::string filename = "test_particle_output.bin";
+
+    REQUIRE_NOTHROW( ParticleConfig::write(expected, filename, ParticleConfig::Format::Binary) );
+    REQUIRE(ParticleConfig::detectFormat(filename) == ParticleConfig::Format::Binary);
+
+    auto particles = ParticleConfig::parse(filename);
+
+    REQUIRE(particles.size() == expected.size());
+
+    for (size_t i = 0; i < particles.size(); ++i)
+    {
+        // binary is lossless so values must match exactly
+        REQUIRE(particles[i].id == expected[i].id);
+        REQUIRE(particles[i].position == expected[i].position);
+        REQUIRE(particles[i].velocity == expected[i].velocity);
+        REQUIRE(particles[i].acceleration == expected[i].acceleration);
+        REQUIRE(particles[i].mass == expected[i].mass);
+    }
+
+    std::filesystem::remove(filename);
+}
+
+TEST_CASE("Parsing a truncated binary particle config throws", "[particle][binary]")
+{
+    ParticleConfig::Limits limits;
+    limits.boundingBox         = {{ { -1.0, -1.0, -1.0 }, { 1.0, 1.0, 1.0 } }};
+    limits.massLimits          = { 0.1, 10.0 };
+    limits.velocityLimits      = { -1.0, 1.0 };
+    limits.accelerationLimits  = { -0.1, 0.1 };
+
+    std::string filename = "test_particle_output.bin";
+    ParticleConfig::generate(10, limits, filename, ParticleConfig::Format::Binary);
+
+    std::filesystem::resize_file(filename, std::filesystem::file_size(filename) - 1);
+
+    REQUIRE_THROWS(ParticleConfig::parse(filename));
+
+    std::filesystem::remove(filename);
+}
+
+TEST_CASE("Parsed input cache is reused until the input changes", "[particle][cache]")
+{
+    ParticleConfig::Limits limits;
+    limits.boundingBox         = {{ { -1.0, -1.0, -1.0 }, { 1.0, 1.0, 1.0 } }};
+    limits.massLimits          = { 0.1, 10.0 };
+    limits.velocityLimits      = { -1.0, 1.0 };
+    limits.accelerationLimits  = { -0.1, 0.1 };
+
+    std::string filename = "test_particle_cache.txt";
+    ParticleConfig::generate(1000, limits, filename, 587);
+
+    const std::string cacheFile = ParticleConfig::cachePath(filename, "");
+    std::filesystem::remove(cacheFile);
+
+    ParticleConfig::CacheResult result;
+    auto expected = ParticleConfig::parse(filename);
+
+    auto written = ParticleConfig::parseCached(filename, "", result);
+    REQUIRE(result == ParticleConfig::CacheResult::Written);
+    REQUIRE(std::filesystem::exists(cacheFile));
+
+    auto cached = ParticleConfig::parseCached(filename, "", result);
+    REQUIRE(result == ParticleConfig::CacheResult::Hit);
+
+    REQUIRE(written.size() == expected.size());
+    REQUIRE(cached.size() == expected.size());
+    for (size_t i = 0; i < expected.size(); ++i)
+    {
+        REQUIRE(std::memcmp(&cached[i], &expected[i], sizeof(ParticleConfig::Particle)) == 0);
+        REQUIRE(std::memcmp(&written[i], &expected[i], sizeof(ParticleConfig::Particle)) == 0);
+    }
+
+    // different content with the old modification time
+    auto modified = std::filesystem::last_write_time(filename);
+    ParticleConfig::generate(1000, limits, filename, 588);
+    std::filesystem::last_write_time(filename, modified);
+
+    auto changed = ParticleConfig::parseCached(filename, "", result);
+    REQUIRE(result == ParticleConfig::CacheResult::Written);
+    REQUIRE(changed.size() == 1000);
+    REQUIRE(changed[0].position == ParticleConfig::parse(filename)[0].position);
+
+    std::filesystem::remove(cacheFile);
+    std::filesystem::remove(filename);
+}
+
+TEST_CASE("Streamed particle file is identical to operator<< output", "[particle][generate][file]")
+{
+    ParticleConfig::Limits limits;
+    limits.boundingBox         = {{ { -1e6, -1e-3, 0.0 }, { 1e6, 1e-3, 1.0 } }};
+    limits.massLimits          = { 0.1, 1e30 };
+    limits.velocityLimits      = { -1.0, 1.0 };
+    limits.accelerationLimits  = { -1e-7, 1e-7 };
+
+    // spans more than one chunk of the streaming writer
+    const size_t N = 70000;
+    const uint64_t seed = 12345;
+
+    std::stringstream expected;
+    expected << "Particle System with " << N << " particles:\n";
+    for (const auto& particle : ParticleConfig::generate(N, limits, seed))
+    {
+        expected << particle;
+    }
+
+    std::string filename = "test_particle_output.txt";
+    ParticleConfig::generate(N, limits, filename, seed);
+
+    std::ifstream file(filename, std::ios::binary);
+    std::stringstream actual;
+    actual << file.rdbuf();
+    file.close();
+
+    REQUIRE(actual.str() == expected.str());
+
+    std::filesystem::remove(filename);
+}
@@ -2,41 +2,253 @@
 
 
 #include <sys/syscall.h>
+#include <sys/mman.h>
 #include <sstream>
+#include <iomanip>
 #include <fstream>
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <exception>
+#include <mutex>
+#include <tuple>
+
+#include "threading.h"
+
+namespace
+{
+    constexpr uint64_t cacheEvent(uint64_t cache, uint64_t op, uint64_t result)
+    {
+        return cache | (op << 8) | (result << 16);
+    }
+
+    // names follow `perf list`
+    const std::vector<PerfEvent> NAMED_EVENTS = {
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES,              "cycles" },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS,            "instructions" },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES,        "cache-references" },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES,            "cache-misses" },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_INSTRUCTIONS,     "branches" },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES,           "branch-misses" },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_STALLED_CYCLES_FRONTEND, "stalled-cycles-frontend" },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_STALLED_CYCLES_BACKEND,  "stalled-cycles-backend" },
+        { PERF_TYPE_HARDWARE, PERF_COUNT_HW_REF_CPU_CYCLES,          "ref-cycles" },
+        { PERF_TYPE_HW_CACHE, cacheEvent(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_ACCESS),  "L1-dcache-loads" },
+        { PERF_TYPE_HW_CACHE, cacheEvent(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS),    "L1-dcache-load-misses" },
+        { PERF_TYPE_HW_CACHE, cacheEvent(PERF_COUNT_HW_CACHE_L1I, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS),    "L1-icache-load-misses" },
+        { PERF_TYPE_HW_CACHE, cacheEvent(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_ACCESS),   "LLC-loads" },
+        { PERF_TYPE_HW_CACHE, cacheEvent(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS),     "LLC-load-misses" },
+        { PERF_TYPE_HW_CACHE, cacheEvent(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_ACCESS), "dTLB-loads" },
+        { PERF_TYPE_HW_CACHE, cacheEvent(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS),   "dTLB-load-misses" },
+        { PERF_TYPE_HW_CACHE, cacheEvent(PERF_COUNT_HW_CACHE_ITLB, PERF_COUNT_HW_CACHE_OP_READ, PERF_COUNT_HW_CACHE_RESULT_MISS),   "iTLB-load-misses" },
+        { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK,              "task-clock" },
+        { PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS,             "page-faults" },
+    };
+
+    // a group has to fit into the pmu's counters (cycles and instructions use fixed counters
+    // on intel), the vectorization codes are FP_ARITH_INST_RETIRED on intel skylake and later
+    const std::vector<std::pair<std::string, std::string>> PRESETS = {
+        { "default",       "cache-references,cache-misses,cycles,instructions,branch-misses" },
+        { "memory",        "cycles,instructions,L1-dcache-load-misses,LLC-load-misses,dTLB-load-misses,stalled-cycles-backend" },
+        { "frontend",      "cycles,instructions,stalled-cycles-frontend,L1-icache-load-misses,iTLB-load-misses,branch-misses" },
+        { "vectorization", "cycles,instructions,r01c7,r04c7,r10c7,r40c7" },
+    };
+
+    size_t findEvent(const std::vector<PerfEvent>& events, const std::string& name)
+    {
+        for (size_t i = 0; i < events.size(); ++i)
+        {
+            if (events[i].name == name) return i;
+        }
+        return events.size();
+    }
+
+    constexpr size_t CALIBRATION_ITERATIONS = 64;
+
+    constexpr size_t SAMPLE_TOP_FUNCTIONS = 15;
+    constexpr size_t SAMPLE_TOP_ADDRESSES = 10;
+
+    double percent(uint64_t part, uint64_t total)
+    {
+        return total == 0 ? 0.0 : 100.0 * static_cast<double>(part) / static_cast<double>(total);
+    }
+
+    double ratio(long long numerator, long long denominator)
+    {
+        return denominator == 0 ? 0.0 : static_cast<double>(numerator) / static_cast<double>(denominator);
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+    inline uint64_t rdpmc(uint32_t counter)
+    {
+        uint32_t low, high;
+        asm volatile("rdpmc" : "=a"(low), "=d"(high) : "c"(counter));
+        return static_cast<uint64_t>(low) | (static_cast<uint64_t>(high) << 32);
+    }
+
+    // self monitoring protocol from linux/perf_event.h, returns false if the
+    // counter can not be read from user space right now
+    inline bool readMappedCounter(const perf_event_mmap_page* page, long long& value)
+    {
+        const volatile perf_event_mmap_page* pc = page;
+        uint32_t seq;
+        int64_t count;
+
+        do
+        {
+            seq = pc->lock;
+            std::atomic_signal_fence(std::memory_order_seq_cst);
+
+            const uint32_t index = pc->index;
+            if (!pc->cap_user_rdpmc || index == 0)
+            {
+                return false;
+            }
+
+            const uint16_t width = pc->pmc_width;
+            int64_t pmc = static_cast<int64_t>(rdpmc(index - 1));
+            pmc <<= 64 - width;
+            pmc >>= 64 - width;
+
+            count = pc->offset + pmc;
+
+            std::atomic_signal_fence(std::memory_order_seq_cst);
+        } while (pc->lock != seq);
+
+        value = count;
+        return true;
+    }
+#else
+    inline bool readMappedCounter(const perf_event_mmap_page*, long long&)
+    {
+        return false;
+    }
+#endif
+}
+
 
 
 
+PerfGroup::PerfGroup(const std::vector<PerfEvent>& events, bool mapPages)
+{
+    if (events.empty() || events.size() > MAX_EVENTS)
+    {
+        throw std::runtime_error("perf event group needs between 1 and " + std::to_string(MAX_EVENTS) + " events");
+    }
+
+    for (const auto& event : events)
+    {
+        perf_event_attr attr;
+        memset(&attr, 0x0, sizeof(attr));
+        attr.type = event.type;
+        attr.size = sizeof(perf_event_attr);
+        attr.config = event.config;
+        // members follow the leader, only the leader is enabled/disabled
+        attr.disabled = mFds.empty() ? 1 : 0;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
 
-PerfCounter::PerfCounter(uint32_t type, uint64_t config)
+        // pid 0 is the calling thread, without inherit other threads are not counted
+        int fd = perf_event_open(&attr, 0, -1, mFds.empty() ? -1 : mFds[0], 0);
+
+        if (fd == -1)
+        {
+            std::string error = strerror(errno);
+            release();
+            throw std::runtime_error("perf_event_open failed for " + std::string(event.name) + ": " + error);
+        }
+
+        mFds.push_back(fd);
+
+        if (mapPages)
+        {
+            // a missing page only disables the user space read for this event
+            void* page = mmap(nullptr, sysconf(_SC_PAGESIZE), PROT_READ, MAP_SHARED, fd, 0);
+            mPages.push_back(page == MAP_FAILED ? nullptr : static_cast<perf_event_mmap_page*>(page));
+        }
+    }
+}
+
+PerfGroup::~PerfGroup()
 {
-    memset(&mAttr, 0x0, sizeof(mAttr));
-    mAttr.type = type;
-    mAttr.size = sizeof(perf_event_attr);
-    mAttr.config = config;
-    mAttr.disabled = 1;
-    mAttr.exclude_kernel = 1;
-    mAttr.exclude_hv = 1;
-    mAttr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    release();
+}
 
-    mFd = perf_event_open(&mAttr, getpid(), -1, -1, 0);
+void PerfGroup::release()
+{
+    for (auto* page : mPages)
+    {
+        if (page)
+        {
+            munmap(page, sysconf(_SC_PAGESIZE));
+        }
+    }
 
-    if (mFd == -1)
+    // members before the leader
+    for (auto it = mFds.rbegin(); it != mFds.rend(); ++it)
     {
-        throw std::runtime_error("perf_event_open failed: " + std::string(strerror(errno)));
+        close(*it);
     }
+
+    mPages.clear();
+    mFds.clear();
 }
 
-PerfCounter::~PerfCounter()
+void PerfGroup::read(std::vector<long long>& values) const
 {
-    if (mFd != -1)
+    readGroup(values, true);
+}
+
+void PerfGroup::readUser(std::vector<long long>& values) const
+{
+    values.resize(mFds.size());
+
+    for (size_t i = 0; i < mPages.size(); ++i)
     {
-        close(mFd);
+        if (!mPages[i] || !readMappedCounter(mPages[i], values[i]))
+        {
+            readGroup(values, false);
+            return;
+        }
+    }
+
+    if (mPages.size() != mFds.size())
+    {
+        readGroup(values, false);
     }
 }
 
-int PerfCounter::perf_event_open(struct perf_event_attr* hw_event,
-                                 pid_t pid, int cpu, int group_fd, unsigned long flags)
+void PerfGroup::readGroup(std::vector<long long>& values, bool scale) const
+{
+    // layout for PERF_FORMAT_GROUP | TOTAL_TIME_ENABLED | TOTAL_TIME_RUNNING
+    struct
+    {
+        uint64_t nr;
+        uint64_t timeEnabled;
+        uint64_t timeRunning;
+        uint64_t values[MAX_EVENTS];
+    } data;
+
+    values.assign(mFds.size(), 0);
+
+    const size_t bytes = 3 * sizeof(uint64_t) + mFds.size() * sizeof(uint64_t);
+    if (::read(mFds[0], &data, bytes) != static_cast<ssize_t>(bytes) || data.timeRunning == 0)
+    {
+        return;
+    }
+
+    // scale counters to account for multiplexing, the whole group is always scheduled together
+    const double factor = scale ? static_cast<double>(data.timeEnabled) / static_cast<double>(data.timeRunning) : 1.0;
+
+    for (size_t i = 0; i < mFds.size() && i < data.nr; ++i)
+    {
+        values[i] = static_cast<long long>(static_cast<double>(data.values[i]) * factor);
+    }
+}
+
+int PerfGroup::perf_event_open(struct perf_event_attr* hw_event,
+                               pid_t pid, int cpu, int group_fd, unsigned long flags)
 {
     return syscall(__NR_perf_event_open, hw_event, pid, cpu, group_fd, flags);
 }
@@ -44,36 +256,432 @@ int PerfCounter::perf_event_open(struct perf_event_attr* hw_event,
 
 
 
+PerfSampler::PerfSampler(const PerfEvent& event, uint64_t period)
+{
+    perf_event_attr attr;
+    memset(&attr, 0x0, sizeof(attr));
+    attr.type = event.type;
+    attr.size = sizeof(perf_event_attr);
+    attr.config = event.config;
+    attr.sample_period = period;
+    attr.sample_type = PERF_SAMPLE_IP;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    // pid 0 is the calling thread
+    mFd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+
+    if (mFd == -1)
+    {
+        throw std::runtime_error("perf_event_open failed for sampling " + event.name + ": " + strerror(errno));
+    }
+
+    // one metadata page followed by a power of two of data pages
+    mPageSize = sysconf(_SC_PAGESIZE);
+    mDataSize = DATA_PAGES * mPageSize;
+
+    void* ring = mmap(nullptr, mPageSize + mDataSize, PROT_READ | PROT_WRITE, MAP_SHARED, mFd, 0);
+
+    if (ring == MAP_FAILED)
+    {
+        std::string error = strerror(errno);
+        close(mFd);
+        throw std::runtime_error("unable to map perf sample buffer: " + error);
+    }
+
+    mPage = static_cast<perf_event_mmap_page*>(ring);
+}
+
+PerfSampler::~PerfSampler()
+{
+    munmap(mPage, mPageSize + mDataSize);
+    close(mFd);
+}
+
+uint64_t PerfSampler::drain(std::unordered_map<uint64_t, uint64_t>& samples)
+{
+    const unsigned char* data = reinterpret_cast<const unsigned char*>(mPage) + mPageSize;
+    return drainRing(*mPage, data, mDataSize, samples);
+}
+
+uint64_t PerfSampler::drainRing(perf_event_mmap_page& page, const unsigned char* data, size_t dataSize,
+                                std::unordered_map<uint64_t, uint64_t>& samples)
+{
+    // records can wrap around the end of the ring
+    auto copy = [&](uint64_t position, void* destination, size_t bytes)
+    {
+        const size_t offset = position & (dataSize - 1);
+        const size_t first = std::min(bytes, dataSize - offset);
+
+        memcpy(destination, data + offset, first);
+        memcpy(static_cast<unsigned char*>(destination) + first, data, bytes - first);
+    };
+
+    // the kernel publishes data_head after writing the records before it
+    const uint64_t head = __atomic_load_n(&page.data_head, __ATOMIC_ACQUIRE);
+    uint64_t tail = page.data_tail;
+    uint64_t lost = 0;
+
+    while (tail < head)
+    {
+        perf_event_header header;
+        copy(tail, &header, sizeof(header));
+
+        if (header.type == PERF_RECORD_SAMPLE)
+        {
+            uint64_t ip;
+            copy(tail + sizeof(header), &ip, sizeof(ip));
+            ++samples[ip];
+        }
+        else if (header.type == PERF_RECORD_LOST)
+        {
+            // u64 id followed by u64 lost
+            uint64_t count;
+            copy(tail + sizeof(header) + sizeof(uint64_t), &count, sizeof(count));
+            lost += count;
+        }
+
+        tail += header.size;
+    }
+
+    // hands the space back to the kernel
+    __atomic_store_n(&page.data_tail, tail, __ATOMIC_RELEASE);
+
+    return lost;
+}
+
+
+
+
 PerfSection::PerfSection(std::string& name, PerfProfiler& profilerInstance)
     : mName(name)
     , mProfilerInstance(profilerInstance)
+    , mEvents(profilerInstance.getEvents())
+    , mUserRead(profilerInstance.useRdpmc())
 {
-    mCounters.emplace_back(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES);
-    mCounters.emplace_back(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
-    mCounters.emplace_back(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
-    mCounters.emplace_back(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
-    mCounters.emplace_back(PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+    const size_t numThreads = Threading::numThreads();
+    const uint64_t samplePeriod = profilerInstance.getSamplePeriod();
+    const PerfEvent* sampleEvent = samplePeriod > 0 ? &profilerInstance.getSampleEvent() : nullptr;
+
+    mGroups.resize(numThreads);
+    mSamplers.resize(sampleEvent ? numThreads : 0);
+    mStartValues.resize(numThreads, std::vector<long long>(mEvents.size(), 0));
+    mStopValues.resize(numThreads, std::vector<long long>(mEvents.size(), 0));
+    mData.resize(numThreads, std::vector<long long>(mEvents.size(), 0));
+
+    std::exception_ptr error = nullptr;
+    std::mutex errorMutex;
+
+    // every worker opens its own group
+    Threading::onEveryThread([&](size_t thread)
+    {
+        try
+        {
+            mGroups[thread] = std::make_unique<PerfGroup>(mEvents, mUserRead);
+
+            if (sampleEvent)
+            {
+                mSamplers[thread] = std::make_unique<PerfSampler>(*sampleEvent, samplePeriod);
+            }
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lock(errorMutex);
+            error = std::current_exception();
+        }
+    });
+
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+
+    if (mUserRead)
+    {
+        for (auto& group : mGroups)
+        {
+            group->enable();
+        }
+    }
+
+    calibrate();
+}
+
+void PerfSection::start()
+{
+    auto begin = std::chrono::steady_clock::now();
+
+    if (mUserRead)
+    {
+        Threading::onEveryThread([&](size_t thread)
+        {
+            mGroups[thread]->readUser(mStartValues[thread]);
+        });
+    }
+    else
+    {
+        for (auto& group : mGroups)
+        {
+            group->enable();
+        }
+    }
+
+    // last so the profiler itself is not sampled
+    for (auto& sampler : mSamplers)
+    {
+        sampler->enable();
+    }
+
+    mOverhead += std::chrono::steady_clock::now() - begin;
+}
+
+void PerfSection::stop()
+{
+    auto begin = std::chrono::steady_clock::now();
+
+    for (auto& sampler : mSamplers)
+    {
+        sampler->disable();
+    }
+
+    if (mUserRead)
+    {
+        Threading::onEveryThread([&](size_t thread)
+        {
+            mGroups[thread]->readUser(mStopValues[thread]);
+
+            for (size_t i = 0; i < mEvents.size(); ++i)
+            {
+                mData[thread][i] += mStopValues[thread][i] - mStartValues[thread][i];
+            }
+        });
+    }
+    else
+    {
+        for (auto& group : mGroups)
+        {
+            group->disable();
+        }
+    }
+
+    // nothing is sampled until the next start so everything in the rings belongs to this section
+    for (auto& sampler : mSamplers)
+    {
+        mLostSamples += sampler->drain(mSamples);
+    }
+
+    ++mNumIterations;
+
+    mOverhead += std::chrono::steady_clock::now() - begin;
+}
+
+void PerfSection::calibrate()
+{
+    auto begin = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < CALIBRATION_ITERATIONS; ++i)
+    {
+        start();
+        stop();
+    }
+
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - begin;
+    mEmptyNs = elapsed.count() / CALIBRATION_ITERATIONS;
+
+    mEmptyCounts.assign(mEvents.size(), 0.0);
+    for (size_t thread = 0; thread < mGroups.size(); ++thread)
+    {
+        if (!mUserRead)
+        {
+            mGroups[thread]->read(mData[thread]);
+            mGroups[thread]->reset();
+        }
+
+        for (size_t i = 0; i < mEvents.size(); ++i)
+        {
+            mEmptyCounts[i] += static_cast<double>(mData[thread][i]) / CALIBRATION_ITERATIONS;
+        }
+
+        std::fill(mData[thread].begin(), mData[thread].end(), 0);
+    }
+
+    mSamples.clear();
+    mLostSamples = 0;
+    mNumIterations = 0;
+    mOverhead = std::chrono::steady_clock::duration::zero();
+}
+
+void PerfSection::writeSamples(std::ostream& out) const
+{
+    uint64_t total = 0;
+    std::unordered_map<std::string, uint64_t> functions;
+    std::vector<std::tuple<uint64_t, uint64_t, SymbolTable::Location>> addresses;   // samples, ip, location
+
+    const SymbolTable& symbols = mProfilerInstance.getSymbolTable();
+
+    // every distinct instruction pointer is symbolized once
+    for (const auto& [ip, count] : mSamples)
+    {
+        SymbolTable::Location location = symbols.lookup(ip);
+
+        total += count;
+        functions[location.function + "  [" + location.object + "]"] += count;
+        addresses.emplace_back(count, ip, std::move(location));
+    }
+
+    std::vector<std::pair<uint64_t, std::string>> ranked;
+    for (auto& [function, count] : functions)
+    {
+        ranked.emplace_back(count, function);
+    }
+
+    std::sort(ranked.begin(), ranked.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+    std::sort(addresses.begin(), addresses.end(), [](const auto& a, const auto& b) { return std::get<0>(a) > std::get<0>(b); });
+
+    const PerfEvent& event = mProfilerInstance.getSampleEvent();
+
+    out << "samples: " << total << " (lost " << mLostSamples << ", one every "
+        << mProfilerInstance.getSamplePeriod() << " " << event.name << ")\n";
+
+    out << "sampled functions:\n";
+    for (size_t i = 0; i < std::min(ranked.size(), SAMPLE_TOP_FUNCTIONS); ++i)
+    {
+        out << "sample " << std::right << std::fixed << std::setprecision(2) << std::setw(6)
+            << percent(ranked[i].first, total) << "% " << std::setw(9) << ranked[i].first
+            << "  " << ranked[i].second << "\n";
+    }
+
+    // the offsets are what addr2line -f -C -e <object> expects for the source line
+    out << "sampled addresses:\n";
+    for (size_t i = 0; i < std::min(addresses.size(), SAMPLE_TOP_ADDRESSES); ++i)
+    {
+        const auto& [count, ip, location] = addresses[i];
+
+        out << "sample " << std::right << std::fixed << std::setprecision(2) << std::setw(6)
+            << percent(count, total) << "% " << std::setw(9) << count
+            << "  " << location.object << "+0x" << std::hex << location.offset << std::dec
+            << "  " << location.function << "\n";
+    }
+
+    out.unsetf(std::ios::floatfield);
+    out << std::setprecision(6);
 }
 
 PerfSection::~PerfSection()
 {
+    const size_t numThreads = mData.size();
+    const size_t numEvents = mEvents.size();
+    const long long numIterations = static_cast<long long>(std::max<size_t>(mNumIterations, 1));
+
+    // the groups were only counting between start/stop so the totals can be read once
+    if (!mUserRead)
+    {
+        for (size_t thread = 0; thread < numThreads; ++thread)
+        {
+            mGroups[thread]->read(mData[thread]);
+        }
+    }
+
+    for (auto& data : mData)
+    {
+        for (size_t i = 0; i < numEvents; ++i)
+        {
+            data[i] = data[i] / numIterations;
+        }
+    }
+
+    std::vector<long long> sum(numEvents, 0);
+    std::vector<long long> min = mData[0];
+    std::vector<long long> max = mData[0];
+
     for (auto& data : mData)
     {
-        data = data / mNumIterations;
+        for (size_t i = 0; i < numEvents; ++i)
+        {
+            sum[i] += data[i];
+            min[i] = std::min(min[i], data[i]);
+            max[i] = std::max(max[i], data[i]);
+        }
     }
 
+    std::chrono::duration<double, std::nano> overhead = mOverhead;
+
     std::stringstream ss;
 
+    // totals over all threads, the default events keep their original names and
+    // derived metrics so existing tooling still works
     ss << "Section: " << mName << "\n";
-    ss << "cache-references:            " << mData[0] << "\n";
-    ss << "cache-misses:                " << mData[1] << "\n";
-    ss << "cycles:                      " << mData[2] << "\n";
-    ss << "instructions:                " << mData[3] << "\n";
-    ss << "branch-misses:               " << mData[4] << "\n";
-    ss << "cache-miss %:                " << static_cast<double>(mData[1]) / static_cast<double>(mData[0]) << "\n";
-    ss << "cache-misses / instructions: " << static_cast<double>(mData[1]) / static_cast<double>(mData[3]) << "\n";
-    ss << "IPC:                         " << static_cast<double>(mData[3]) / static_cast<double>(mData[2]) << "\n";
- 
+    ss << std::left << std::setw(29) << "threads:" << numThreads << "\n";
+    for (size_t i = 0; i < numEvents; ++i)
+    {
+        ss << std::left << std::setw(29) << (mEvents[i].name + ":") << sum[i] << "\n";
+    }
+
+    const auto metric = [&](const std::string& name, const std::string& numerator, const std::string& denominator)
+    {
+        const size_t n = findEvent(mEvents, numerator);
+        const size_t d = findEvent(mEvents, denominator);
+
+        if (n < numEvents && d < numEvents)
+        {
+            ss << std::left << std::setw(29) << (name + ":") << ratio(sum[n], sum[d]) << "\n";
+        }
+    };
+
+    metric("cache-miss %", "cache-misses", "cache-references");
+    metric("cache-misses / instructions", "cache-misses", "instructions");
+    metric("IPC", "instructions", "cycles");
+    metric("L1-dcache-load-misses / instructions", "L1-dcache-load-misses", "instructions");
+    metric("LLC-load-misses / instructions", "LLC-load-misses", "instructions");
+    metric("dTLB-load-misses / instructions", "dTLB-load-misses", "instructions");
+    metric("stalled-cycles-backend / cycles", "stalled-cycles-backend", "cycles");
+    metric("stalled-cycles-frontend / cycles", "stalled-cycles-frontend", "cycles");
+
+    // imbalance is max / mean, 1 is perfectly balanced
+    for (size_t i = 0; i < numEvents; ++i)
+    {
+        const double mean = static_cast<double>(sum[i]) / static_cast<double>(numThreads);
+
+        ss << mEvents[i].name << " min / max / imbalance: "
+           << min[i] << " / " << max[i] << " / " << (mean == 0.0 ? 0.0 : static_cast<double>(max[i]) / mean) << "\n";
+    }
+
+    for (size_t thread = 0; thread < numThreads; ++thread)
+    {
+        const auto& data = mData[thread];
+
+        ss << "thread " << thread << ":";
+        for (size_t i = 0; i < numEvents; ++i)
+        {
+            ss << " " << mEvents[i].name << "=" << data[i];
+        }
+        const size_t cycles = findEvent(mEvents, "cycles");
+        const size_t instructions = findEvent(mEvents, "instructions");
+        if (cycles < numEvents && instructions < numEvents)
+        {
+            ss << " IPC=" << ratio(data[instructions], data[cycles]);
+        }
+        ss << "\n";
+    }
+
+    // not subtracted from the values above, in an empty section the workers are spin waiting
+    // in the openmp runtime which is real cost of a short parallel section
+    ss << std::left << std::setw(29) << "counter read mode:" << (mUserRead ? "rdpmc" : "group read") << "\n";
+    ss << std::left << std::setw(29) << "profiler ns / iteration:" << overhead.count() / static_cast<double>(numIterations) << "\n";
+    ss << std::left << std::setw(29) << "empty section ns:" << mEmptyNs << "\n";
+    ss << "empty section counts:";
+    for (size_t i = 0; i < numEvents; ++i)
+    {
+        ss << " " << mEvents[i].name << "=" << static_cast<long long>(mEmptyCounts[i]);
+    }
+    ss << "\n";
+
+    if (!mSamplers.empty())
+    {
+        writeSamples(ss);
+    }
+
     auto str = ss.str();
     mProfilerInstance.addProfileData(str);
 }
@@ -81,6 +689,156 @@ PerfSection::~PerfSection()
 
 
 
+PerfProfiler::PerfProfiler()
+{
+    const char* rdpmc = std::getenv("PERF_RDPMC");
+    mUseRdpmc = rdpmc != nullptr && std::string(rdpmc) != "0";
+
+    const char* events = std::getenv("PERF_EVENTS");
+    mEventSpec = events != nullptr ? events : "default";
+
+    const char* period = std::getenv("PERF_SAMPLE_PERIOD");
+    if (period != nullptr)
+    {
+        // the whole value as an unsigned count, strtoull would wrap "-1" and stop at "abc"
+        char* end = nullptr;
+        errno = 0;
+        mSamplePeriod = std::strtoull(period, &end, 10);
+
+        if (period[0] < '0' || period[0] > '9' || errno != 0 || *end != '\0')
+        {
+            throw std::runtime_error("PERF_SAMPLE_PERIOD has to be a number of events, got: " + std::string(period));
+        }
+    }
+}
+
+std::vector<PerfEvent> PerfProfiler::parseEvents(const std::string& spec)
+{
+    std::vector<PerfEvent> events;
+
+    std::stringstream ss(spec);
+    std::string token;
+    while (std::getline(ss, token, ','))
+    {
+        if (token.empty()) continue;
+
+        auto preset = std::find_if(PRESETS.begin(), PRESETS.end(), [&](const auto& p) { return p.first == token; });
+        auto named = std::find_if(NAMED_EVENTS.begin(), NAMED_EVENTS.end(), [&](const auto& e) { return e.name == token; });
+
+        std::vector<PerfEvent> add;
+        if (preset != PRESETS.end())
+        {
+            add = parseEvents(preset->second);
+        }
+        else if (named != NAMED_EVENTS.end())
+        {
+            add.push_back(*named);
+        }
+        else if (token.size() > 1 && token[0] == 'r' && token.find_first_not_of("0123456789abcdefABCDEF", 1) == std::string::npos)
+        {
+            add.push_back({ PERF_TYPE_RAW, std::stoull(token.substr(1), nullptr, 16), token });
+        }
+        else
+        {
+            throw std::runtime_error("unknown perf event: " + token);
+        }
+
+        for (auto& event : add)
+        {
+            if (findEvent(events, event.name) == events.size())
+            {
+                events.push_back(event);
+            }
+        }
+    }
+
+    if (events.empty() || events.size() > PerfGroup::MAX_EVENTS)
+    {
+        throw std::runtime_error("perf event list needs between 1 and " + std::to_string(PerfGroup::MAX_EVENTS) + " events: " + spec);
+    }
+
+    return events;
+}
+
+void PerfProfiler::setEvents(const std::string& spec)
+{
+    // fail early on typos, support is only probed when the first section is created
+    parseEvents(spec);
+
+    mEventSpec = spec;
+    mEvents.clear();
+}
+
+void PerfProfiler::resolveEvents()
+{
+    std::string unsupported;
+    for (auto& event : parseEvents(mEventSpec))
+    {
+        // probe every event on its own so one unsupported event does not disable the whole set
+        try
+        {
+            PerfGroup probe({ event }, false);
+            mEvents.push_back(event);
+        }
+        catch (const std::exception&)
+        {
+            unsupported += " " + event.name;
+        }
+    }
+
+    if (mEvents.empty())
+    {
+        throw std::runtime_error("none of the perf events are supported: " + mEventSpec);
+    }
+
+    if (!unsupported.empty())
+    {
+        std::string note = "Unsupported perf events:" + unsupported + "\n";
+        addProfileData(note);
+    }
+}
+
+const PerfEvent& PerfProfiler::getSampleEvent()
+{
+    if (!mSampleEvent)
+    {
+        // task-clock always works, it just can not see stalls
+        for (const char* name : { "cycles", "task-clock" })
+        {
+            const PerfEvent event = parseEvents(name)[0];
+
+            try
+            {
+                PerfSampler probe(event, mSamplePeriod);
+                mSampleEvent = std::make_unique<PerfEvent>(event);
+                break;
+            }
+            catch (const std::exception& e)
+            {
+                std::string note = "Sampling event " + event.name + " not supported: " + e.what() + "\n";
+                addProfileData(note);
+            }
+        }
+
+        if (!mSampleEvent)
+        {
+            throw std::runtime_error("no perf event can be sampled");
+        }
+    }
+
+    return *mSampleEvent;
+}
+
+const SymbolTable& PerfProfiler::getSymbolTable()
+{
+    if (!mSymbolTable)
+    {
+        mSymbolTable = std::make_unique<SymbolTable>();
+    }
+
+    return *mSymbolTable;
+}
+
 PerfProfiler::~PerfProfiler()
 {
     std::string filename = mProfilerName + ".perf.txt";
@@ -104,5 +862,10 @@ PerfProfiler& PerfProfiler::getInstance()
 
 std::unique_ptr<PerfSection> PerfProfiler::createSectionProfiler(std::string name)
 {
+    if (mEvents.empty())
+    {
+        resolveEvents();
+    }
+
     return std::move(std::make_unique<PerfSection>(name, *this));
-}
\ No newline at end of file
+}
@@ -11,115 +11,163 @@
 #include <vector>
 #include <errno.h>
 #include <array>
+#include <chrono>
+#include <ostream>
+#include <unordered_map>
 
-class PerfCounter
+#include "symbol_table.h"
+
+struct PerfEvent
+{
+    uint32_t type;
+    uint64_t config;
+    std::string name;
+};
+
+// perf event group counting the calling thread only, the first event is the group leader
+// so all events are scheduled onto the pmu together and read with a single read()
+class PerfGroup
 {
 public:
-    PerfCounter(uint32_t type, uint64_t config);
+    PerfGroup(const std::vector<PerfEvent>& events, bool mapPages);
 
-    ~PerfCounter();
+    ~PerfGroup();
 
-    PerfCounter(const PerfCounter&) = delete;
-    PerfCounter& operator=(const PerfCounter&) = delete;
+    PerfGroup(const PerfGroup&) = delete;
+    PerfGroup& operator=(const PerfGroup&) = delete;
 
-    PerfCounter(PerfCounter&& other) noexcept
+    inline void enable()
     {
-        mAttr = other.mAttr;
-        mFd = other.mFd;
-        other.mFd = -1;
+        ioctl(mFds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
     }
 
-    PerfCounter& operator=(PerfCounter&& other) noexcept
+    inline void disable()
     {
-        if (this != &other)
-        {
-            if (mFd != -1) close(mFd);
-            mAttr = other.mAttr;
-            mFd = other.mFd;
-            other.mFd = -1;
-        }
-        return *this;
-    };
-
-    inline void start()
-    {
-        ioctl(mFd, PERF_EVENT_IOC_RESET, 0);
-        ioctl(mFd, PERF_EVENT_IOC_ENABLE, 0);
+        ioctl(mFds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
     }
 
-    inline void stop()
+    inline void reset()
     {
-        ioctl(mFd, PERF_EVENT_IOC_DISABLE, 0);
+        ioctl(mFds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
     }
 
-    inline long long read()
-    {
-        struct
-        {
-            long long value;
-            long long time_enabled;
-            long long time_running;
-        } data;
-
-        ::read(mFd, &data, sizeof(data));
+    // counts since the last reset scaled to account for multiplexing, one syscall for the group
+    void read(std::vector<long long>& values) const;
 
-        if (data.time_running == 0) return 0;
+    // unscaled counts read with rdpmc through the mmap'd perf pages without entering the kernel,
+    // must be called on the thread that opened the group, falls back to read() when the pmu
+    // does not allow user space reads or the group is currently not scheduled
+    void readUser(std::vector<long long>& values) const;
 
-        // scale counter to account for multiplexing
-        return (long long)(data.value * ((double)data.time_enabled / data.time_running));
+    inline size_t size() const
+    {
+        return mFds.size();
     }
 
+    static constexpr size_t MAX_EVENTS = 16;
+
 private:
-    perf_event_attr mAttr{};
-    int mFd = -1;
+    void readGroup(std::vector<long long>& values, bool scale) const;
+    void release();
+
+    std::vector<int> mFds;
+    std::vector<perf_event_mmap_page*> mPages;
 
     static int perf_event_open(struct perf_event_attr* hw_event,
                                pid_t pid, int cpu, int group_fd, unsigned long flags);
 };
 
+// samples the instruction pointer of the calling thread every period events into a ring
+// buffer shared with the kernel, the ring is drained by whichever thread calls drain()
+// while sampling is disabled so samples are attributed to the section that was running
+class PerfSampler
+{
+public:
+    PerfSampler(const PerfEvent& event, uint64_t period);
+
+    ~PerfSampler();
+
+    PerfSampler(const PerfSampler&) = delete;
+    PerfSampler& operator=(const PerfSampler&) = delete;
+
+    inline void enable()
+    {
+        ioctl(mFd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+
+    inline void disable()
+    {
+        ioctl(mFd, PERF_EVENT_IOC_DISABLE, 0);
+    }
+
+    // adds every sample in the ring to the histogram, returns the samples the kernel
+    // had to drop because the ring was full
+    uint64_t drain(std::unordered_map<uint64_t, uint64_t>& samples);
+
+    // the records between data_tail and data_head of a ring of dataSize (a power of two)
+    // bytes, records may wrap around its end, moves data_tail up to data_head
+    static uint64_t drainRing(perf_event_mmap_page& page, const unsigned char* data, size_t dataSize,
+                              std::unordered_map<uint64_t, uint64_t>& samples);
+
+    // 2^n data pages (512 kB), holds 32k samples between two drains
+    static constexpr size_t DATA_PAGES = 128;
+
+private:
+    int mFd = -1;
+    perf_event_mmap_page* mPage = nullptr;
+    size_t mPageSize = 0;
+    size_t mDataSize = 0;
+};
+
 // forward declaration
 class PerfProfiler;
 
+// groups are opened by every thread of the threading backend so a section covers the
+// whole team, start/stop are called by the master thread outside of parallel regions
+//
+// relies on the backend reusing the same worker threads for all parallel work (true for
+// the native pool and for libgomp/libomp as long as the team size does not change)
+//
+// two ways to collect:
+//  - default: the master enables/disables each thread's group with one ioctl per thread
+//    and the totals are read once when the section is destroyed
+//  - rdpmc (PERF_RDPMC=1): the groups stay enabled and every worker reads its own
+//    counters in user space at start/stop, no syscalls but a fork/join per start/stop
 class PerfSection
 {
 public:
     PerfSection(std::string& name, PerfProfiler& profilerInstance);
     ~PerfSection();
 
-    inline void start()
-    {
-        for (auto& counter : mCounters)
-        {
-            counter.start();
-        }
-    }
-
-    inline void stop()
-    {
-        for (auto& counter : mCounters)
-        {
-            counter.stop();
-        }
-        update();
-    }
+    void start();
+    void stop();
 
 private:
     PerfSection() = default;
 
-    inline void update()
-    {
-        for (size_t i = 0; i < mCounters.size(); ++i)
-        {
-            mData[i] += mCounters[i].read();
-        }
-        ++mNumIterations;
-    }
+    // empty start/stop pairs run at construction to measure what the profiler itself counts
+    void calibrate();
+
+    void writeSamples(std::ostream& out) const;
 
     std::string mName;
-    std::vector<PerfCounter> mCounters;
     PerfProfiler& mProfilerInstance;
-    std::array<long long, 5> mData = {0, 0, 0, 0, 0};
+    std::vector<PerfEvent> mEvents;
+    std::vector<std::unique_ptr<PerfGroup>> mGroups;   // [thread]
+    bool mUserRead = false;
+
+    std::vector<std::vector<long long>> mStartValues;   // [thread][event], rdpmc only
+    std::vector<std::vector<long long>> mStopValues;    // [thread][event], rdpmc only
+    std::vector<std::vector<long long>> mData;          // [thread][event]
     size_t mNumIterations = 0;
+
+    std::chrono::steady_clock::duration mOverhead{0};   // time spent in start/stop
+    std::vector<double> mEmptyCounts;                   // [event], per iteration summed over threads
+    double mEmptyNs = 0.0;
+
+    std::vector<std::unique_ptr<PerfSampler>> mSamplers;    // [thread], empty unless sampling
+    std::unordered_map<uint64_t, uint64_t> mSamples;        // instruction pointer -> samples
+    uint64_t mLostSamples = 0;
 };
 
 class PerfProfiler
@@ -141,9 +189,55 @@ public:
         mProfileData += profileData;
     }
 
+    inline bool useRdpmc() const
+    {
+        return mUseRdpmc;
+    }
+
+    // comma separated list of presets (default, memory, frontend, vectorization), generic
+    // event names (cycles, LLC-load-misses, ...) and raw pmu codes (r01c7), events the
+    // pmu does not support are dropped and listed in the output, has to be called before
+    // the first section is created (defaults to the PERF_EVENTS environment variable or "default")
+    void setEvents(const std::string& spec);
+
+    inline const std::vector<PerfEvent>& getEvents() const
+    {
+        return mEvents;
+    }
+
+    static std::vector<PerfEvent> parseEvents(const std::string& spec);
+
+    // sample the instruction pointer every period cycles (every period ns of task-clock where
+    // the pmu is not available) inside every section and report the hottest functions per
+    // section, 0 disables sampling, has to be called before the first section is created
+    // (defaults to the PERF_SAMPLE_PERIOD environment variable or 0)
+    inline void setSamplePeriod(uint64_t period)
+    {
+        mSamplePeriod = period;
+    }
+
+    inline uint64_t getSamplePeriod() const
+    {
+        return mSamplePeriod;
+    }
+
+    // cycles if the pmu supports sampling it, task-clock otherwise
+    const PerfEvent& getSampleEvent();
+
+    // loaded on first use, only needed when a section reports its samples
+    const SymbolTable& getSymbolTable();
+
 private:
-    PerfProfiler() = default;
+    PerfProfiler();
+
+    void resolveEvents();
 
     std::string mProfileData = "";
     std::string mProfilerName = "";
-};
\ No newline at end of file
+    bool mUseRdpmc = false;
+    std::string mEventSpec;
+    std::vector<PerfEvent> mEvents;
+    uint64_t mSamplePeriod = 0;
+    std::unique_ptr<PerfEvent> mSampleEvent;
+    std::unique_ptr<SymbolTable> mSymbolTable;
+};
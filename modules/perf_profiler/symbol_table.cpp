@@ -0,0 +1,182 @@
+#include "symbol_table.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <elf.h>
+#include <fcntl.h>
+#include <link.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+    std::string baseName(const std::string& path)
+    {
+        size_t slash = path.find_last_of('/');
+        return slash == std::string::npos ? path : path.substr(slash + 1);
+    }
+
+    // the main program is the first object reported by dl_iterate_phdr
+    int findMainProgram(struct dl_phdr_info* info, size_t, void* data)
+    {
+        auto* ranges = static_cast<std::pair<uint64_t, std::vector<std::pair<uint64_t, uint64_t>>>*>(data);
+        ranges->first = info->dlpi_addr;
+
+        for (int i = 0; i < info->dlpi_phnum; ++i)
+        {
+            const ElfW(Phdr)& header = info->dlpi_phdr[i];
+            if (header.p_type == PT_LOAD && (header.p_flags & PF_X))
+            {
+                uint64_t begin = info->dlpi_addr + header.p_vaddr;
+                ranges->second.emplace_back(begin, begin + header.p_memsz);
+            }
+        }
+
+        return 1;
+    }
+}
+
+SymbolTable::SymbolTable()
+{
+    const char* path = "/proc/self/exe";
+
+    char resolved[4096];
+    ssize_t length = readlink(path, resolved, sizeof(resolved) - 1);
+    mObject = length > 0 ? baseName(std::string(resolved, length)) : "exe";
+
+    int fd = open(path, O_RDONLY);
+    struct stat info;
+    if (fd == -1 || fstat(fd, &info) == -1)
+    {
+        if (fd != -1) close(fd);
+        throw std::runtime_error("unable to open " + std::string(path) + " to read its symbol table");
+    }
+
+    void* mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (mapping == MAP_FAILED)
+    {
+        throw std::runtime_error("unable to map " + std::string(path) + " to read its symbol table");
+    }
+
+    const auto* bytes = static_cast<const unsigned char*>(mapping);
+    const auto* elf = reinterpret_cast<const ElfW(Ehdr)*>(bytes);
+
+    if (static_cast<size_t>(info.st_size) < sizeof(ElfW(Ehdr)) || memcmp(elf->e_ident, ELFMAG, SELFMAG) != 0)
+    {
+        munmap(mapping, info.st_size);
+        throw std::runtime_error(std::string(path) + " is not an elf file");
+    }
+
+    const auto* sections = reinterpret_cast<const ElfW(Shdr)*>(bytes + elf->e_shoff);
+
+    // the full symbol table if the binary is not stripped, otherwise the exported ones
+    const ElfW(Shdr)* table = nullptr;
+    for (int type : { SHT_SYMTAB, SHT_DYNSYM })
+    {
+        for (size_t i = 0; i < elf->e_shnum && !table; ++i)
+        {
+            if (sections[i].sh_type == static_cast<ElfW(Word)>(type)) table = &sections[i];
+        }
+    }
+
+    if (table)
+    {
+        const auto* symbols = reinterpret_cast<const ElfW(Sym)*>(bytes + table->sh_offset);
+        const char* names = reinterpret_cast<const char*>(bytes + sections[table->sh_link].sh_offset);
+        const size_t count = table->sh_size / sizeof(ElfW(Sym));
+
+        for (size_t i = 0; i < count; ++i)
+        {
+            if (ELF64_ST_TYPE(symbols[i].st_info) == STT_FUNC && symbols[i].st_value != 0)
+            {
+                mSymbols.push_back({ symbols[i].st_value, symbols[i].st_size, demangle(names + symbols[i].st_name) });
+            }
+        }
+    }
+
+    munmap(mapping, info.st_size);
+
+    std::sort(mSymbols.begin(), mSymbols.end(), [](const Symbol& a, const Symbol& b) { return a.address < b.address; });
+
+    std::pair<uint64_t, std::vector<std::pair<uint64_t, uint64_t>>> main;
+    dl_iterate_phdr(findMainProgram, &main);
+
+    mLoadBias = main.first;
+    for (auto& [begin, end] : main.second)
+    {
+        mExecutable.push_back({ begin, end });
+    }
+}
+
+SymbolTable::Location SymbolTable::lookup(uint64_t address) const
+{
+    Location location;
+    location.function = "??";
+
+    bool inMain = std::any_of(mExecutable.begin(), mExecutable.end(),
+                              [&](const Range& range) { return address >= range.begin && address < range.end; });
+
+    if (inMain)
+    {
+        location.object = mObject;
+        location.offset = address - mLoadBias;
+
+        // last symbol starting at or before the address
+        auto it = std::upper_bound(mSymbols.begin(), mSymbols.end(), location.offset,
+                                   [](uint64_t value, const Symbol& symbol) { return value < symbol.address; });
+
+        if (it != mSymbols.begin())
+        {
+            --it;
+            if (it->size == 0 || location.offset < it->address + it->size)
+            {
+                location.function = it->name;
+            }
+        }
+
+        return location;
+    }
+
+    Dl_info info;
+    if (dladdr(reinterpret_cast<void*>(address), &info) != 0)
+    {
+        location.object = info.dli_fname ? baseName(info.dli_fname) : "??";
+        location.offset = address - reinterpret_cast<uint64_t>(info.dli_fbase);
+
+        if (info.dli_sname)
+        {
+            location.function = demangle(info.dli_sname);
+        }
+    }
+    else
+    {
+        location.object = "??";
+        location.offset = address;
+    }
+
+    return location;
+}
+
+std::string SymbolTable::demangle(const char* name)
+{
+    int status = 0;
+    char* demangled = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+
+    if (status != 0 || demangled == nullptr)
+    {
+        return name;
+    }
+
+    std::string result = demangled;
+    std::free(demangled);
+
+    return result;
+}
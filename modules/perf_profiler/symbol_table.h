@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// maps instruction addresses of the running process to function names without an external
+// perf/addr2line, functions of the executable come from its own .symtab (so static
+// functions are found too), shared libraries only expose their dynamic symbols through dladdr
+class SymbolTable
+{
+public:
+    struct Location
+    {
+        std::string function;   // demangled, "??" if unknown
+        std::string object;     // file name of the executable or shared library
+        uint64_t offset = 0;    // address relative to the object's load address (addr2line input)
+    };
+
+    // reads /proc/self/exe, throws if it is not an elf file
+    SymbolTable();
+
+    Location lookup(uint64_t address) const;
+
+    static std::string demangle(const char* name);
+
+private:
+    struct Symbol
+    {
+        uint64_t address;
+        uint64_t size;
+        std::string name;
+    };
+
+    struct Range
+    {
+        uint64_t begin;
+        uint64_t end;
+    };
+
+    std::vector<Symbol> mSymbols;       // sorted by address, unrelocated
+    std::vector<Range> mExecutable;     // relocated executable segments of the main program
+    uint64_t mLoadBias = 0;
+    std::string mObject;
+};
@@ -0,0 +1,289 @@
+// tests/test_perf_profiler.cpp
+
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch_all.hpp>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <linux/perf_event.h>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+// expose internals for testing
+#define private public
+#include "perf_profiler.h"
+#undef private
+#include "symbol_table.h"
+#include "threading.h"
+
+namespace probe
+{
+    // a function of the test binary the symbol table has to find
+    __attribute__((noinline)) int knownFunction(int value)
+    {
+        asm volatile("" : "+r"(value));
+        return value * 3 + 1;
+    }
+}
+
+namespace
+{
+    // writes a record at position of the ring, wrapping around its end like the kernel does
+    void writeRecord(std::vector<unsigned char>& ring, uint64_t position, const std::vector<unsigned char>& record)
+    {
+        for (size_t i = 0; i < record.size(); ++i)
+        {
+            ring[(position + i) & (ring.size() - 1)] = record[i];
+        }
+    }
+
+    std::vector<unsigned char> sampleRecord(uint64_t ip)
+    {
+        perf_event_header header{};
+        header.type = PERF_RECORD_SAMPLE;
+        header.size = sizeof(header) + sizeof(ip);
+
+        std::vector<unsigned char> record(header.size);
+        memcpy(record.data(), &header, sizeof(header));
+        memcpy(record.data() + sizeof(header), &ip, sizeof(ip));
+        return record;
+    }
+
+    std::vector<unsigned char> lostRecord(uint64_t count)
+    {
+        perf_event_header header{};
+        header.type = PERF_RECORD_LOST;
+        header.size = sizeof(header) + 2 * sizeof(uint64_t);
+
+        const uint64_t id = 7;
+        std::vector<unsigned char> record(header.size);
+        memcpy(record.data(), &header, sizeof(header));
+        memcpy(record.data() + sizeof(header), &id, sizeof(id));
+        memcpy(record.data() + sizeof(header) + sizeof(id), &count, sizeof(count));
+        return record;
+    }
+}
+
+TEST_CASE("Symbol table finds functions of the running binary")
+{
+    SymbolTable table;
+
+    const uint64_t address = reinterpret_cast<uint64_t>(&probe::knownFunction);
+    REQUIRE(probe::knownFunction(2) == 7);
+
+    auto location = table.lookup(address);
+    REQUIRE(location.function == "probe::knownFunction(int)");
+    REQUIRE(location.object == "perf_profiler_tests");
+
+    // an address inside the function resolves to it too
+    REQUIRE(table.lookup(address + 1).function == "probe::knownFunction(int)");
+
+    // nothing is mapped in the first page
+    auto unmapped = table.lookup(0x10);
+    REQUIRE(unmapped.function == "??");
+    REQUIRE(unmapped.object == "??");
+    REQUIRE(unmapped.offset == 0x10);
+
+    REQUIRE(SymbolTable::demangle("_ZN5probe13knownFunctionEi") == "probe::knownFunction(int)");
+    REQUIRE(SymbolTable::demangle("not_mangled") == "not_mangled");
+}
+
+TEST_CASE("Perf sampler drains records that wrap around the end of the ring")
+{
+    // a small ring whose tail sits a few bytes before its end, so the first header is split
+    std::vector<unsigned char> ring(256, 0);
+    perf_event_mmap_page page{};
+
+    const uint64_t start = 3 * ring.size() - 4;
+    uint64_t head = start;
+
+    const std::vector<uint64_t> ips = { 0x1000, 0x2000, 0x1000, 0x3000 };
+    for (size_t i = 0; i < ips.size(); ++i)
+    {
+        auto record = sampleRecord(ips[i]);
+        writeRecord(ring, head, record);
+        head += record.size();
+
+        if (i == 1)
+        {
+            auto lost = lostRecord(5);
+            writeRecord(ring, head, lost);
+            head += lost.size();
+        }
+    }
+
+    page.data_tail = start;
+    page.data_head = head;
+
+    std::unordered_map<uint64_t, uint64_t> samples;
+    REQUIRE(PerfSampler::drainRing(page, ring.data(), ring.size(), samples) == 5);
+
+    REQUIRE(samples.size() == 3);
+    REQUIRE(samples[0x1000] == 2);
+    REQUIRE(samples[0x2000] == 1);
+    REQUIRE(samples[0x3000] == 1);
+
+    // the space is handed back and a second drain finds nothing
+    REQUIRE(page.data_tail == head);
+    REQUIRE(PerfSampler::drainRing(page, ring.data(), ring.size(), samples) == 0);
+    REQUIRE(samples[0x1000] == 2);
+}
+
+TEST_CASE("Perf sections add up the counts of every thread")
+{
+    PerfProfiler& profiler = PerfProfiler::getInstance();
+    std::string name = "perf_profiler_tests";
+    profiler.setProfilerName(name);
+
+    // software events need no pmu, they still need perf_event_open to be allowed
+    profiler.setEvents("task-clock,page-faults");
+
+    std::unique_ptr<PerfSection> section;
+    try
+    {
+        section = profiler.createSectionProfiler("aggregation");
+    }
+    catch (const std::runtime_error& e)
+    {
+        WARN("perf events are not available, skipped: " << e.what());
+        return;
+    }
+
+    std::vector<double> values(1 << 20, 1.0);
+    for (int iteration = 0; iteration < 3; ++iteration)
+    {
+        section->start();
+        Threading::parallelFor(0, values.size(), Threading::evenGrain(values.size()), [&](size_t first, size_t last)
+        {
+            for (size_t i = first; i < last; ++i)
+            {
+                values[i] = values[i] * 1.0001 + 0.5;
+            }
+        });
+        section->stop();
+    }
+
+    profiler.mProfileData.clear();
+    section.reset();
+
+    // name: value lines of the totals, min / max / imbalance lines and one line per thread
+    std::map<std::string, long long> totals;
+    std::map<std::string, std::array<double, 3>> spread;
+    std::map<std::string, std::vector<long long>> perThread;
+    size_t threads = 0;
+
+    std::istringstream in(profiler.mProfileData);
+    std::string line;
+    while (std::getline(in, line))
+    {
+        std::istringstream fields(line);
+        std::string key;
+        fields >> key;
+
+        if (key == "threads:")
+        {
+            fields >> threads;
+        }
+        else if (key == "task-clock:" || key == "page-faults:")
+        {
+            fields >> totals[key.substr(0, key.size() - 1)];
+        }
+        else if (line.find(" min / max / imbalance: ") != std::string::npos)
+        {
+            std::string separator;
+            std::array<double, 3> v;
+            std::istringstream numbers(line.substr(line.find(": ") + 2));
+            numbers >> v[0] >> separator >> v[1] >> separator >> v[2];
+            spread[key] = v;
+        }
+        else if (key == "thread")
+        {
+            std::string index;
+            std::string pair;
+            fields >> index;
+            while (fields >> pair)
+            {
+                const size_t equals = pair.find('=');
+                perThread[pair.substr(0, equals)].push_back(std::stoll(pair.substr(equals + 1)));
+            }
+        }
+    }
+
+    REQUIRE(threads == Threading::numThreads());
+
+    for (const std::string event : { "task-clock", "page-faults" })
+    {
+        const auto& counts = perThread[event];
+        REQUIRE(counts.size() == threads);
+
+        long long sum = 0;
+        long long min = counts[0];
+        long long max = counts[0];
+        for (long long count : counts)
+        {
+            sum += count;
+            min = std::min(min, count);
+            max = std::max(max, count);
+        }
+
+        REQUIRE(totals[event] == sum);
+        REQUIRE(spread[event][0] == min);
+        REQUIRE(spread[event][1] == max);
+
+        const double mean = static_cast<double>(sum) / static_cast<double>(threads);
+        const double imbalance = mean == 0.0 ? 0.0 : static_cast<double>(max) / mean;
+        REQUIRE(spread[event][2] == Catch::Approx(imbalance).epsilon(1e-4));
+    }
+
+    // the work itself is counted
+    REQUIRE(totals["task-clock"] > 0);
+}
+
+TEST_CASE("Perf event lists expand presets, names and raw codes")
+{
+    // presets expand in order and events they share are only counted once
+    auto events = PerfProfiler::parseEvents("default,memory");
+    std::vector<std::string> names;
+    for (const auto& event : events)
+    {
+        names.push_back(event.name);
+    }
+    REQUIRE(names == std::vector<std::string>{ "cache-references", "cache-misses", "cycles", "instructions", "branch-misses",
+                                               "L1-dcache-load-misses", "LLC-load-misses", "dTLB-load-misses", "stalled-cycles-backend" });
+
+    events = PerfProfiler::parseEvents("LLC-load-misses");
+    REQUIRE(events.size() == 1);
+    REQUIRE(events[0].type == PERF_TYPE_HW_CACHE);
+    REQUIRE(events[0].config == (PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)));
+
+    events = PerfProfiler::parseEvents("cycles,r01c7");
+    REQUIRE(events.size() == 2);
+    REQUIRE(events[1].type == PERF_TYPE_RAW);
+    REQUIRE(events[1].config == 0x1c7);
+    REQUIRE(events[1].name == "r01c7");
+
+    REQUIRE_THROWS_AS(PerfProfiler::parseEvents("cycles,not-an-event"), std::runtime_error);
+    REQUIRE_THROWS_AS(PerfProfiler::parseEvents("r01zz"), std::runtime_error);
+    REQUIRE_THROWS_AS(PerfProfiler::parseEvents(""), std::runtime_error);
+
+    // one raw code more than a group can hold
+    std::string tooMany;
+    for (size_t i = 0; i <= PerfGroup::MAX_EVENTS; ++i)
+    {
+        tooMany += (i == 0 ? "r" : ",r") + std::to_string(100 + i);
+    }
+    REQUIRE_THROWS_AS(PerfProfiler::parseEvents(tooMany), std::runtime_error);
+    tooMany = tooMany.substr(0, tooMany.rfind(','));
+    REQUIRE(PerfProfiler::parseEvents(tooMany).size() == PerfGroup::MAX_EVENTS);
+}
@@ -0,0 +1,479 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+
+Profiler& Profiler::getInstance()
+{
+    static Profiler instance;
+    return instance;
+}
+
+Profiler::Stats Profiler::computeStats(const Region& region, size_t numIterations)
+{
+    Stats stats;
+    stats.count = region.samples.size();
+
+    if (stats.count == 0) return stats;
+
+    std::vector<double> sorted(stats.count);
+    for (size_t i = 0; i < stats.count; ++i)
+    {
+        sorted[i] = region.samples[i].ms;
+        stats.total += sorted[i];
+    }
+
+    std::sort(sorted.begin(), sorted.end());
+
+    // iterations the region was not entered in count as 0 towards the mean
+    const size_t divisor = (region.perIteration && numIterations > 0) ? numIterations : stats.count;
+    stats.mean = stats.total / static_cast<double>(divisor);
+
+    stats.min = sorted.front();
+    stats.max = sorted.back();
+    stats.median = (stats.count % 2 == 1) ? sorted[stats.count / 2]
+                                          : 0.5 * (sorted[stats.count / 2 - 1] + sorted[stats.count / 2]);
+
+    // nearest rank
+    size_t rank = static_cast<size_t>(std::ceil(0.99 * static_cast<double>(stats.count)));
+    stats.p99 = sorted[std::max<size_t>(rank, 1) - 1];
+
+    return stats;
+}
+
+Profiler::LoopStats Profiler::computeLoopStats(const Loop& loop)
+{
+    LoopStats stats;
+    stats.steps = loop.samples.size();
+
+    if (stats.steps == 0) return stats;
+
+    double totalWall = 0.0;
+    double totalThreadTime = 0.0;
+    double totalWait = 0.0;
+
+    for (const LoopSample& sample : loop.samples)
+    {
+        const size_t numThreads = sample.busyMs.size();
+        stats.threadBusy.resize(std::max(stats.threadBusy.size(), numThreads), 0.0);
+
+        double sum = 0.0;
+        double max = 0.0;
+        for (size_t t = 0; t < numThreads; ++t)
+        {
+            sum += sample.busyMs[t];
+            max = std::max(max, sample.busyMs[t]);
+            stats.threadBusy[t] += sample.busyMs[t];
+        }
+
+        const double mean = sum / static_cast<double>(numThreads);
+        const double imbalance = mean > 0.0 ? max / mean : 1.0;
+
+        stats.imbalanceMean += imbalance;
+        stats.imbalanceMax = std::max(stats.imbalanceMax, imbalance);
+
+        totalWall += sample.wallMs;
+        totalThreadTime += sample.wallMs * static_cast<double>(numThreads);
+        totalWait += std::max(0.0, sample.wallMs * static_cast<double>(numThreads) - sum);
+        stats.waitMean += std::max(0.0, sample.wallMs - mean);
+    }
+
+    const double steps = static_cast<double>(stats.steps);
+    stats.wallMean = totalWall / steps;
+    stats.imbalanceMean /= steps;
+    stats.waitMean /= steps;
+    stats.idleFraction = totalThreadTime > 0.0 ? totalWait / totalThreadTime : 0.0;
+
+    return stats;
+}
+
+#ifdef TIME_PROFILE
+void Profiler::beginIteration(size_t iteration)
+{
+    mInIteration = true;
+    mIteration = iteration;
+}
+
+void Profiler::endIteration()
+{
+    if (mInIteration && mEnabled)
+    {
+        ++mNumIterations;
+    }
+
+    mInIteration = false;
+}
+
+size_t Profiler::findChild(size_t parent, const char* name)
+{
+    const std::vector<size_t>& siblings = (parent == NO_PARENT) ? mRoots : mRegions[parent].children;
+
+    for (size_t child : siblings)
+    {
+        if (std::strcmp(mRegions[child].name.c_str(), name) == 0) return child;
+    }
+
+    Region region;
+    region.name = name;
+    region.parent = parent;
+    mRegions.emplace_back(std::move(region));
+
+    size_t id = mRegions.size() - 1;
+    if (parent == NO_PARENT)
+    {
+        mRoots.push_back(id);
+    }
+    else
+    {
+        mRegions[parent].children.push_back(id);
+    }
+
+    return id;
+}
+
+void Profiler::enter(const char* name)
+{
+    if (Threading::threadId() != 0)
+    {
+        throw std::runtime_error(std::string("profile region entered by a worker thread: ") + name);
+    }
+
+    size_t parent = mStack.empty() ? NO_PARENT : mStack.back();
+    mStack.push_back(findChild(parent, name));
+}
+
+void Profiler::exit(double ms)
+{
+    Region& region = mRegions[mStack.back()];
+    mStack.pop_back();
+
+    if (mInIteration)
+    {
+        region.perIteration = true;
+
+        // a region entered more than once per iteration accumulates into one sample
+        if (!region.samples.empty() && region.samples.back().iteration == mIteration)
+        {
+            region.samples.back().ms += ms;
+            return;
+        }
+
+        region.samples.push_back({mIteration, ms});
+    }
+    else
+    {
+        region.samples.push_back({region.samples.size(), ms});
+    }
+}
+
+void Profiler::reset()
+{
+    mLoops.clear();
+    mRegions.clear();
+    mRoots.clear();
+    mStack.clear();
+    mNumIterations = 0;
+    mInIteration = false;
+}
+
+std::string Profiler::path(size_t region, const char* separator) const
+{
+    std::string result = mRegions[region].name;
+
+    for (size_t parent = mRegions[region].parent; parent != NO_PARENT; parent = mRegions[parent].parent)
+    {
+        result = mRegions[parent].name + separator + result;
+    }
+
+    return result;
+}
+
+bool Profiler::getStats(const std::string& regionPath, Stats& stats) const
+{
+    for (size_t i = 0; i < mRegions.size(); ++i)
+    {
+        if (path(i, " > ") == regionPath)
+        {
+            stats = computeStats(mRegions[i], mNumIterations);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void Profiler::addLoopSample(const char* name, double wallMs, const std::vector<double>& busyMs)
+{
+    Loop* loop = nullptr;
+    for (Loop& candidate : mLoops)
+    {
+        if (std::strcmp(candidate.name.c_str(), name) == 0)
+        {
+            loop = &candidate;
+            break;
+        }
+    }
+
+    if (loop == nullptr)
+    {
+        mLoops.push_back({name, {}});
+        loop = &mLoops.back();
+    }
+
+    const size_t iteration = mInIteration ? mIteration : loop->samples.size();
+
+    // loops run more than once per iteration (center of mass levels) make up one step
+    if (mInIteration && !loop->samples.empty() && loop->samples.back().iteration == iteration &&
+        loop->samples.back().busyMs.size() == busyMs.size())
+    {
+        LoopSample& sample = loop->samples.back();
+        sample.wallMs += wallMs;
+        for (size_t t = 0; t < busyMs.size(); ++t)
+        {
+            sample.busyMs[t] += busyMs[t];
+        }
+        return;
+    }
+
+    loop->samples.push_back({iteration, wallMs, busyMs});
+}
+
+bool Profiler::getLoopStats(const std::string& name, LoopStats& stats) const
+{
+    for (const Loop& loop : mLoops)
+    {
+        if (loop.name == name)
+        {
+            stats = computeLoopStats(loop);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void Profiler::writeBalanceCsv(const std::string& filename) const
+{
+    std::ofstream file(filename);
+
+    if (!file.is_open())
+    {
+        throw std::runtime_error("unable to open file to store simulation profile: " + filename);
+    }
+
+    file << std::setprecision(9);
+    file << "iteration,loop,threads,wall_ms,mean_busy_ms,max_busy_ms,imbalance,mean_wait_ms\n";
+
+    for (const Loop& loop : mLoops)
+    {
+        for (const LoopSample& sample : loop.samples)
+        {
+            double sum = 0.0;
+            double max = 0.0;
+            for (double busy : sample.busyMs)
+            {
+                sum += busy;
+                max = std::max(max, busy);
+            }
+
+            const double mean = sum / static_cast<double>(sample.busyMs.size());
+
+            file << sample.iteration << ",\"" << loop.name << "\"," << sample.busyMs.size() << ","
+                 << sample.wallMs << "," << mean << "," << max << ","
+                 << (mean > 0.0 ? max / mean : 1.0) << "," << std::max(0.0, sample.wallMs - mean) << "\n";
+        }
+    }
+}
+
+void Profiler::writeTextRegion(std::ostream& out, size_t region, int depth) const
+{
+    const Region& r = mRegions[region];
+    Stats stats = computeStats(r, mNumIterations);
+
+    out << std::string(4 * depth, ' ') << r.name;
+    if (r.perIteration)
+    {
+        out << ": " << stats.mean << "\n";
+    }
+    else
+    {
+        // one time cost, not averaged per iteration
+        out << " (total): " << stats.total << "\n";
+    }
+
+    for (size_t child : r.children)
+    {
+        writeTextRegion(out, child, depth + 1);
+    }
+}
+
+void Profiler::writeText(const std::string& filename) const
+{
+    std::ofstream file(filename);
+
+    if (!file.is_open())
+    {
+        throw std::runtime_error("unable to open file to store simulation profile: " + filename);
+    }
+
+    double overall = 0.0;
+
+    file << "all times in milliseconds\n";
+    for (size_t root : mRoots)
+    {
+        if (!mRegions[root].perIteration) continue;
+
+        writeTextRegion(file, root, 0);
+        overall += computeStats(mRegions[root], mNumIterations).mean;
+    }
+
+    file << "overall: " << overall << "\n";
+
+    for (size_t root : mRoots)
+    {
+        if (!mRegions[root].perIteration) writeTextRegion(file, root, 0);
+    }
+}
+
+namespace
+{
+    std::string jsonString(const std::string& text)
+    {
+        std::string result = "\"";
+
+        for (char c : text)
+        {
+            if (c == '"' || c == '\\') result += '\\';
+            result += c;
+        }
+
+        return result + "\"";
+    }
+}
+
+void Profiler::writeJsonRegion(std::ostream& out, size_t region, int depth) const
+{
+    const Region& r = mRegions[region];
+    Stats stats = computeStats(r, mNumIterations);
+    const std::string indent(2 * depth, ' ');
+
+    out << indent << "{\n";
+    out << indent << "  \"name\": " << jsonString(r.name) << ",\n";
+    out << indent << "  \"path\": " << jsonString(path(region, " > ")) << ",\n";
+    out << indent << "  \"per_iteration\": " << (r.perIteration ? "true" : "false") << ",\n";
+    out << indent << "  \"count\": " << stats.count << ",\n";
+    out << indent << "  \"total\": " << stats.total << ",\n";
+    out << indent << "  \"mean\": " << stats.mean << ",\n";
+    out << indent << "  \"min\": " << stats.min << ",\n";
+    out << indent << "  \"median\": " << stats.median << ",\n";
+    out << indent << "  \"p99\": " << stats.p99 << ",\n";
+    out << indent << "  \"max\": " << stats.max << ",\n";
+
+    out << indent << "  \"iterations\": [";
+    for (size_t i = 0; i < r.samples.size(); ++i)
+    {
+        out << (i == 0 ? "" : ", ") << r.samples[i].iteration;
+    }
+    out << "],\n";
+
+    out << indent << "  \"samples\": [";
+    for (size_t i = 0; i < r.samples.size(); ++i)
+    {
+        out << (i == 0 ? "" : ", ") << r.samples[i].ms;
+    }
+    out << "],\n";
+
+    out << indent << "  \"children\": [";
+    for (size_t i = 0; i < r.children.size(); ++i)
+    {
+        out << (i == 0 ? "\n" : ",\n");
+        writeJsonRegion(out, r.children[i], depth + 2);
+    }
+    out << (r.children.empty() ? "" : "\n" + indent + "  ") << "]\n";
+
+    out << indent << "}";
+}
+
+void Profiler::writeJsonLoops(std::ostream& out) const
+{
+    out << "  \"parallel_loops\": [";
+
+    for (size_t i = 0; i < mLoops.size(); ++i)
+    {
+        LoopStats stats = computeLoopStats(mLoops[i]);
+
+        out << (i == 0 ? "\n" : ",\n");
+        out << "    {\n";
+        out << "      \"name\": " << jsonString(mLoops[i].name) << ",\n";
+        out << "      \"steps\": " << stats.steps << ",\n";
+        out << "      \"wall_mean\": " << stats.wallMean << ",\n";
+        out << "      \"imbalance_mean\": " << stats.imbalanceMean << ",\n";
+        out << "      \"imbalance_max\": " << stats.imbalanceMax << ",\n";
+        out << "      \"wait_mean\": " << stats.waitMean << ",\n";
+        out << "      \"idle_fraction\": " << stats.idleFraction << ",\n";
+        out << "      \"thread_busy\": [";
+        for (size_t t = 0; t < stats.threadBusy.size(); ++t)
+        {
+            out << (t == 0 ? "" : ", ") << stats.threadBusy[t];
+        }
+        out << "]\n";
+        out << "    }";
+    }
+
+    out << (mLoops.empty() ? "" : "\n  ") << "],\n";
+}
+
+void Profiler::writeJson(const std::string& filename) const
+{
+    std::ofstream file(filename);
+
+    if (!file.is_open())
+    {
+        throw std::runtime_error("unable to open file to store simulation profile: " + filename);
+    }
+
+    file << std::setprecision(9);
+    file << "{\n";
+    file << "  \"name\": " << jsonString(mName) << ",\n";
+    file << "  \"units\": \"ms\",\n";
+    file << "  \"threads\": " << Threading::numThreads() << ",\n";
+    file << "  \"iterations\": " << mNumIterations << ",\n";
+    writeJsonLoops(file);
+    file << "  \"regions\": [";
+    for (size_t i = 0; i < mRoots.size(); ++i)
+    {
+        file << (i == 0 ? "\n" : ",\n");
+        writeJsonRegion(file, mRoots[i], 2);
+    }
+    file << (mRoots.empty() ? "" : "\n  ") << "]\n";
+    file << "}\n";
+}
+
+void Profiler::writeCsv(const std::string& filename) const
+{
+    std::ofstream file(filename);
+
+    if (!file.is_open())
+    {
+        throw std::runtime_error("unable to open file to store simulation profile: " + filename);
+    }
+
+    file << std::setprecision(9);
+    file << "iteration,region,ms\n";
+
+    for (size_t i = 0; i < mRegions.size(); ++i)
+    {
+        if (!mRegions[i].perIteration) continue;
+
+        const std::string regionPath = path(i, " > ");
+        for (const Sample& sample : mRegions[i].samples)
+        {
+            file << sample.iteration << ",\"" << regionPath << "\"," << sample.ms << "\n";
+        }
+    }
+}
+#endif
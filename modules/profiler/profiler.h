@@ -0,0 +1,358 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "threading.h"
+#include "tracer.h"
+
+// wall clock profiler with nested named regions
+//
+// regions are entered/left by the thread driving the simulation, either outside of
+// parallel regions or as the master thread of a team that stays alive for a whole
+// iteration (the other threads of the team ignore their ProfileRegions), a region
+// entered while another one is open becomes its child so the same name can show up
+// under different parents
+//
+// every region keeps one sample per iteration (time summed over all entries in that
+// iteration) so the report has min/median/p99 next to the mean and the per iteration
+// csv shows warm up and outlier steps, regions entered outside of an iteration (final
+// file write, ...) keep one sample per entry and are reported as totals
+//
+// built without TIME_PROFILE (-DTIME_PROFILING=OFF) every call below is an empty
+// inline function, at runtime nothing is timed unless setEnabled(true) was called
+class Profiler
+{
+public:
+    struct Stats
+    {
+        size_t count = 0;
+        double total = 0.0;
+        double mean = 0.0;      // per iteration for iteration regions, per sample otherwise
+        double min = 0.0;
+        double median = 0.0;
+        double p99 = 0.0;
+        double max = 0.0;
+    };
+
+    struct Sample
+    {
+        size_t iteration;
+        double ms;
+    };
+
+    struct Region
+    {
+        std::string name;
+        size_t parent;
+        std::vector<size_t> children;
+        std::vector<Sample> samples;
+        bool perIteration = false;
+    };
+
+    // one execution of a parallel loop (summed over all executions in an iteration)
+    struct LoopSample
+    {
+        size_t iteration;
+        double wallMs;
+        std::vector<double> busyMs;     // [thread]
+    };
+
+    struct Loop
+    {
+        std::string name;
+        std::vector<LoopSample> samples;
+    };
+
+    struct LoopStats
+    {
+        size_t steps = 0;
+        double wallMean = 0.0;          // per step
+        double imbalanceMean = 0.0;     // max / mean busy time of the threads
+        double imbalanceMax = 0.0;
+        double waitMean = 0.0;          // per step and thread, wall - busy
+        double idleFraction = 0.0;      // thread time spent waiting / thread time
+        std::vector<double> threadBusy; // [thread] total over all steps
+    };
+
+    static constexpr size_t NO_PARENT = static_cast<size_t>(-1);
+
+    static Profiler& getInstance();
+
+#ifdef TIME_PROFILE
+    inline void setEnabled(bool enabled)
+    {
+        mEnabled = enabled;
+    }
+
+    inline bool isEnabled() const
+    {
+        return mEnabled;
+    }
+
+    // name shows up in the json output, iteration regions are divided by the
+    // number of iterations between beginIteration/endIteration
+    inline void setName(const std::string& name)
+    {
+        mName = name;
+    }
+
+    void beginIteration(size_t iteration);
+    void endIteration();
+
+    void enter(const char* name);
+    void exit(double ms);
+
+    // discards every region and sample
+    void reset();
+
+    // "a > b > c" path of region names, returns false if the region was never entered
+    bool getStats(const std::string& path, Stats& stats) const;
+
+    // called by ParallelLoop once the parallel region has joined
+    void addLoopSample(const char* name, double wallMs, const std::vector<double>& busyMs);
+
+    bool getLoopStats(const std::string& name, LoopStats& stats) const;
+
+    // one row per parallel loop and iteration (iteration,loop,threads,wall_ms,mean_busy_ms,max_busy_ms,imbalance,mean_wait_ms)
+    void writeBalanceCsv(const std::string& filename) const;
+
+    // simulationName.txt, mean per iteration in the layout tools/plot_timing_results.py reads
+    void writeText(const std::string& filename) const;
+
+    // regions with stats and per iteration samples
+    void writeJson(const std::string& filename) const;
+
+    // one row per region and iteration (iteration,region,ms)
+    void writeCsv(const std::string& filename) const;
+#else
+    inline void setEnabled(bool) {}
+    inline bool isEnabled() const { return false; }
+    inline void setName(const std::string&) {}
+    inline void beginIteration(size_t) {}
+    inline void endIteration() {}
+    inline void enter(const char*) {}
+    inline void exit(double) {}
+    inline void reset() {}
+    inline bool getStats(const std::string&, Stats&) const { return false; }
+    inline void addLoopSample(const char*, double, const std::vector<double>&) {}
+    inline bool getLoopStats(const std::string&, LoopStats&) const { return false; }
+    inline void writeBalanceCsv(const std::string&) const {}
+    inline void writeText(const std::string&) const {}
+    inline void writeJson(const std::string&) const {}
+    inline void writeCsv(const std::string&) const {}
+#endif
+
+    static Stats computeStats(const Region& region, size_t numIterations);
+
+    static LoopStats computeLoopStats(const Loop& loop);
+
+private:
+    Profiler() = default;
+
+#ifdef TIME_PROFILE
+    size_t findChild(size_t parent, const char* name);
+    std::string path(size_t region, const char* separator) const;
+    void writeJsonRegion(std::ostream& out, size_t region, int depth) const;
+    void writeTextRegion(std::ostream& out, size_t region, int depth) const;
+    void writeJsonLoops(std::ostream& out) const;
+
+    bool mEnabled = false;
+    bool mInIteration = false;
+    size_t mIteration = 0;
+    size_t mNumIterations = 0;
+    std::string mName;
+    std::vector<Region> mRegions;
+    std::vector<size_t> mRoots;
+    std::vector<size_t> mStack;
+    std::vector<Loop> mLoops;
+#endif
+};
+
+// times the enclosing scope, stop() ends the region early (the scope has to
+// outlive something constructed inside the region), also shows up in the trace
+// when tracing is enabled
+//
+// inside a parallel region every thread may construct it but only the master thread
+// records, the region should end after a barrier to cover the work of the whole team
+class ProfileRegion
+{
+public:
+#ifdef TIME_PROFILE
+    explicit ProfileRegion(const char* name)
+        : mName(name)
+        , mActive(Profiler::getInstance().isEnabled() && Threading::threadId() == 0)
+        , mTraced(Tracer::isEnabled() && Threading::threadId() == 0)
+    {
+        if (mActive)
+        {
+            Profiler::getInstance().enter(name);
+        }
+
+        if (mActive || mTraced)
+        {
+            mStart = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~ProfileRegion()
+    {
+        stop();
+    }
+
+    inline void stop()
+    {
+        if (!mActive && !mTraced) return;
+
+        auto end = std::chrono::steady_clock::now();
+
+        if (mActive)
+        {
+            std::chrono::duration<double, std::milli> elapsed = end - mStart;
+            Profiler::getInstance().exit(elapsed.count());
+        }
+
+        if (mTraced)
+        {
+            Tracer::record(mName, mStart, end);
+        }
+
+        mActive = false;
+        mTraced = false;
+    }
+#else
+    explicit ProfileRegion(const char*) {}
+
+    inline void stop() {}
+#endif
+
+    ProfileRegion(const ProfileRegion&) = delete;
+    ProfileRegion& operator=(const ProfileRegion&) = delete;
+
+private:
+#ifdef TIME_PROFILE
+    const char* mName;
+    bool mActive;
+    bool mTraced;
+    std::chrono::steady_clock::time_point mStart;
+#endif
+};
+
+#ifdef TIME_PROFILE
+#define PROFILE_REGION(name) ProfileRegion PROFILE_COMBINE(profileRegion_, __LINE__)(name)
+#else
+#define PROFILE_REGION(name)
+#endif
+
+// busy time of every thread in one parallel loop, constructed by the thread that starts
+// the loop, every chunk is timed with a ThreadBusy that adds to the slot of the thread
+// running it:
+//
+//     ParallelLoop loop("name");
+//     Threading::parallelFor(0, n, grain, [&](size_t first, size_t last)
+//     {
+//         ThreadBusy busy(loop);
+//         ...
+//     });
+//
+// what is left of the loop's wall time is spent waiting for the slowest thread (and
+// forking/joining or stealing)
+class ParallelLoop
+{
+public:
+#ifdef TIME_PROFILE
+    explicit ParallelLoop(const char* name)
+        : mName(name)
+        , mActive(Profiler::getInstance().isEnabled())
+    {
+        if (mActive)
+        {
+            mBusy.resize(Threading::numThreads());
+            mStart = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~ParallelLoop()
+    {
+        if (!mActive) return;
+
+        std::chrono::duration<double, std::milli> wall = std::chrono::steady_clock::now() - mStart;
+
+        std::vector<double> busy(mBusy.size());
+        for (size_t i = 0; i < mBusy.size(); ++i)
+        {
+            busy[i] = mBusy[i].ms;
+        }
+
+        Profiler::getInstance().addLoopSample(mName, wall.count(), busy);
+    }
+#else
+    explicit ParallelLoop(const char*) {}
+#endif
+
+    ParallelLoop(const ParallelLoop&) = delete;
+    ParallelLoop& operator=(const ParallelLoop&) = delete;
+
+private:
+    friend class ThreadBusy;
+
+#ifdef TIME_PROFILE
+    // one cache line per thread so the threads do not share lines
+    struct alignas(64) Slot
+    {
+        double ms = 0.0;
+    };
+
+    const char* mName;
+    bool mActive;
+    std::chrono::steady_clock::time_point mStart;
+    std::vector<Slot> mBusy;
+#endif
+};
+
+// times the calling thread's share of a ParallelLoop, also a span in the trace
+class ThreadBusy
+{
+public:
+#ifdef TIME_PROFILE
+    explicit ThreadBusy(ParallelLoop& loop)
+        : mLoop(loop)
+        , mTimed(loop.mActive || Tracer::isEnabled())
+    {
+        if (mTimed) mStart = std::chrono::steady_clock::now();
+    }
+
+    ~ThreadBusy()
+    {
+        if (!mTimed) return;
+
+        auto end = std::chrono::steady_clock::now();
+
+        size_t tid = Threading::threadId();
+        if (mLoop.mActive && tid < mLoop.mBusy.size())
+        {
+            std::chrono::duration<double, std::milli> elapsed = end - mStart;
+            mLoop.mBusy[tid].ms += elapsed.count();
+        }
+
+        if (Tracer::isEnabled())
+        {
+            Tracer::record(mLoop.mName, mStart, end);
+        }
+    }
+#else
+    explicit ThreadBusy(ParallelLoop&) {}
+#endif
+
+    ThreadBusy(const ThreadBusy&) = delete;
+    ThreadBusy& operator=(const ThreadBusy&) = delete;
+
+private:
+#ifdef TIME_PROFILE
+    ParallelLoop& mLoop;
+    bool mTimed;
+    std::chrono::steady_clock::time_point mStart;
+#endif
+};
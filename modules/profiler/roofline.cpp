@@ -0,0 +1,150 @@
+#include "roofline.h"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <new>
+#include <sstream>
+
+#include "threading.h"
+
+Roofline::Machine Roofline::detect()
+{
+    Machine machine;
+    machine.threads = Threading::numThreads();
+    machine.clockGhz = clockGhz();
+
+    // two fma pipes per core on every x86 server core we run on
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f"))
+    {
+        machine.isa = "avx512";
+        machine.vectorFlopsPerCycle = 2 * 2 * 8;
+    }
+    else if (__builtin_cpu_supports("fma") && __builtin_cpu_supports("avx2"))
+    {
+        machine.isa = "avx2+fma";
+        machine.vectorFlopsPerCycle = 2 * 2 * 4;
+    }
+    else if (__builtin_cpu_supports("avx"))
+    {
+        machine.isa = "avx";
+        machine.vectorFlopsPerCycle = 2 * 4;
+    }
+    else
+    {
+        machine.isa = "sse2";
+        machine.vectorFlopsPerCycle = 2 * 2;
+    }
+
+    machine.scalarFlopsPerCycle = (machine.isa == "avx" || machine.isa == "sse2") ? 2 : 4;
+#else
+    machine.isa = "unknown";
+#endif
+
+    machine.peakGflops = machine.threads * machine.clockGhz * machine.vectorFlopsPerCycle;
+    machine.scalarPeakGflops = machine.threads * machine.clockGhz * machine.scalarFlopsPerCycle;
+    machine.bandwidthGBs = measureBandwidth();
+
+    return machine;
+}
+
+double Roofline::measureBandwidth(size_t elementsPerArray)
+{
+    static constexpr int REPETITIONS = 5;
+    static constexpr size_t ALIGNMENT = 64;
+
+    auto allocate = [&]()
+    {
+        return static_cast<double*>(::operator new(elementsPerArray * sizeof(double), std::align_val_t(ALIGNMENT)));
+    };
+
+    double* a = allocate();
+    double* b = allocate();
+    double* c = allocate();
+
+    // first touch with the chunks of the triad so pages are local to the thread using them
+    const size_t grain = Threading::evenGrain(elementsPerArray);
+
+    Threading::parallelFor(0, elementsPerArray, grain, [&](size_t first, size_t last)
+    {
+        for (size_t i = first; i < last; ++i)
+        {
+            a[i] = 0.0;
+            b[i] = 1.0;
+            c[i] = 2.0;
+        }
+    });
+
+    const double scalar = 3.0;
+    double best = 0.0;
+
+    for (int repetition = 0; repetition < REPETITIONS; ++repetition)
+    {
+        auto start = std::chrono::steady_clock::now();
+
+        Threading::parallelFor(0, elementsPerArray, grain, [&](size_t first, size_t last)
+        {
+            for (size_t i = first; i < last; ++i)
+            {
+                a[i] = b[i] + scalar * c[i];
+            }
+        });
+
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        // two loads and a store per element, write allocate traffic is not counted (as in stream)
+        const double bytes = 3.0 * sizeof(double) * static_cast<double>(elementsPerArray);
+        best = std::max(best, bytes / elapsed.count() * 1e-9);
+    }
+
+    // keep the compiler from dropping the triad
+    volatile double sink = a[elementsPerArray / 2];
+    (void)sink;
+
+    ::operator delete(a, std::align_val_t(ALIGNMENT));
+    ::operator delete(b, std::align_val_t(ALIGNMENT));
+    ::operator delete(c, std::align_val_t(ALIGNMENT));
+
+    return best;
+}
+
+double Roofline::clockGhz()
+{
+    std::ifstream maxFrequency("/sys/devices/system/cpu/cpu0/cpufreq/cpuinfo_max_freq");
+    double khz = 0.0;
+
+    if (maxFrequency >> khz && khz > 0.0)
+    {
+        return khz * 1e-6;
+    }
+
+    std::ifstream cpuinfo("/proc/cpuinfo");
+    std::string line;
+
+    while (std::getline(cpuinfo, line))
+    {
+        if (line.rfind("cpu MHz", 0) == 0)
+        {
+            size_t colon = line.find(':');
+            if (colon != std::string::npos)
+            {
+                return std::stod(line.substr(colon + 1)) * 1e-3;
+            }
+        }
+    }
+
+    return 0.0;
+}
+
+std::string Roofline::describe(const Machine& machine)
+{
+    std::ostringstream out;
+
+    out << machine.threads << " threads at " << machine.clockGhz << " GHz (" << machine.isa << "), peak "
+        << machine.peakGflops << " GFLOP/s vector / " << machine.scalarPeakGflops << " GFLOP/s scalar, stream triad "
+        << machine.bandwidthGBs << " GB/s";
+
+    return out.str();
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// compute and memory roofs of the machine the simulation runs on, used to put the
+// achieved GFLOP/s of a kernel next to what the hardware could do at its arithmetic intensity
+class Roofline
+{
+public:
+    struct Machine
+    {
+        size_t threads = 0;
+        double clockGhz = 0.0;              // 0 if it could not be detected
+        size_t vectorFlopsPerCycle = 0;     // double precision per core (fma counts as 2)
+        size_t scalarFlopsPerCycle = 0;
+        std::string isa;
+        double peakGflops = 0.0;            // all threads, full vector width
+        double scalarPeakGflops = 0.0;      // all threads, scalar code
+        double bandwidthGBs = 0.0;          // measured stream triad
+    };
+
+    // clock, isa and a short stream triad, takes a fraction of a second
+    static Machine detect();
+
+    // best of a few stream triad runs (a[i] = b[i] + s * c[i]) with every thread of the threading backend
+    static double measureBandwidth(size_t elementsPerArray = size_t(1) << 23);
+
+    // max frequency of cpu0, falls back to the current frequency in /proc/cpuinfo
+    static double clockGhz();
+
+    // gflop/s attainable at the given arithmetic intensity (flop / byte)
+    static inline double attainable(const Machine& machine, double intensity, bool scalar)
+    {
+        double peak = scalar ? machine.scalarPeakGflops : machine.peakGflops;
+        double memory = intensity * machine.bandwidthGBs;
+
+        return (peak > 0.0 && peak < memory) ? peak : memory;
+    }
+
+    static std::string describe(const Machine& machine);
+
+private:
+    Roofline() = default;
+};
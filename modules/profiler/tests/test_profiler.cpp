@@ -0,0 +1,238 @@
+// tests/test_profiler.cpp
+
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch_all.hpp>
+
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+
+#include "profiler.h"
+#include "roofline.h"
+
+TEST_CASE("Region stats report min, median, p99 and per iteration mean")
+{
+    Profiler::Region region;
+    region.perIteration = true;
+
+    // 100 iterations of 1 ms with a single 50 ms outlier
+    for (size_t i = 0; i < 100; ++i)
+    {
+        region.samples.push_back({i, i == 10 ? 50.0 : 1.0});
+    }
+
+    Profiler::Stats stats = Profiler::computeStats(region, 100);
+    REQUIRE(stats.count == 100);
+    REQUIRE(stats.total == Catch::Approx(149.0));
+    REQUIRE(stats.mean == Catch::Approx(1.49));
+    REQUIRE(stats.min == 1.0);
+    REQUIRE(stats.median == 1.0);
+    REQUIRE(stats.p99 == 1.0);
+    REQUIRE(stats.max == 50.0);
+
+    // a region skipped in half the iterations counts them as 0 towards the mean
+    stats = Profiler::computeStats(region, 200);
+    REQUIRE(stats.mean == Catch::Approx(0.745));
+
+    region.samples = {{0, 4.0}, {1, 1.0}, {2, 3.0}, {3, 2.0}};
+    stats = Profiler::computeStats(region, 4);
+    REQUIRE(stats.median == Catch::Approx(2.5));
+    REQUIRE(stats.p99 == 4.0);
+}
+
+TEST_CASE("Loop stats report imbalance and barrier wait per step")
+{
+    Profiler::Loop loop;
+    loop.name = "loop";
+
+    // thread 1 does twice the work of thread 0 and the others wait for it at the barrier
+    loop.samples.push_back({0, 10.0, {5.0, 10.0}});
+    loop.samples.push_back({1, 10.0, {10.0, 10.0}});
+
+    Profiler::LoopStats stats = Profiler::computeLoopStats(loop);
+    REQUIRE(stats.steps == 2);
+    REQUIRE(stats.wallMean == Catch::Approx(10.0));
+    REQUIRE(stats.imbalanceMax == Catch::Approx(10.0 / 7.5));
+    REQUIRE(stats.imbalanceMean == Catch::Approx(0.5 * (10.0 / 7.5 + 1.0)));
+    REQUIRE(stats.waitMean == Catch::Approx(0.5 * 2.5));
+    REQUIRE(stats.idleFraction == Catch::Approx(5.0 / 40.0));
+    REQUIRE(stats.threadBusy[0] == Catch::Approx(15.0));
+    REQUIRE(stats.threadBusy[1] == Catch::Approx(20.0));
+}
+
+#ifdef TIME_PROFILE
+TEST_CASE("Nested regions are keyed by their parent and accumulate per iteration")
+{
+    Profiler& profiler = Profiler::getInstance();
+    profiler.reset();
+    profiler.setEnabled(true);
+
+    for (size_t i = 0; i < 3; ++i)
+    {
+        profiler.beginIteration(i);
+        {
+            PROFILE_REGION("outer");
+            PROFILE_REGION("inner");
+        }
+        {
+            PROFILE_REGION("other");
+            PROFILE_REGION("inner");
+        }
+        {
+            // entered twice, still one sample per iteration
+            PROFILE_REGION("other");
+        }
+        profiler.endIteration();
+    }
+
+    {
+        PROFILE_REGION("final");
+    }
+
+    // a loop run twice in an iteration is one step
+    profiler.beginIteration(3);
+    for (int i = 0; i < 2; ++i)
+    {
+        ParallelLoop loop("loop");
+
+        Threading::onEveryThread([&](size_t)
+        {
+            ThreadBusy busy(loop);
+        });
+    }
+    profiler.endIteration();
+
+    Profiler::LoopStats loopStats;
+    REQUIRE(profiler.getLoopStats("loop", loopStats));
+    REQUIRE(loopStats.steps == 1);
+
+    Profiler::Stats stats;
+    REQUIRE(profiler.getStats("outer", stats));
+    REQUIRE(stats.count == 3);
+    REQUIRE(profiler.getStats("outer > inner", stats));
+    REQUIRE(stats.count == 3);
+    REQUIRE(profiler.getStats("other > inner", stats));
+    REQUIRE(stats.count == 3);
+    REQUIRE(profiler.getStats("other", stats));
+    REQUIRE(stats.count == 3);
+    REQUIRE(profiler.getStats("final", stats));
+    REQUIRE(stats.count == 1);
+    REQUIRE_FALSE(profiler.getStats("inner", stats));
+
+    // disabled at runtime nothing is recorded
+    profiler.reset();
+    profiler.setEnabled(false);
+    {
+        PROFILE_REGION("outer");
+    }
+    REQUIRE_FALSE(profiler.getStats("outer", stats));
+}
+#endif
+
+#ifdef TIME_PROFILE
+TEST_CASE("Tracer keeps the newest events of every thread")
+{
+    Tracer& tracer = Tracer::getInstance();
+    tracer.enable(4);
+
+    std::string workerName;
+    Threading::onEveryThread([&](size_t thread)
+    {
+        TRACE_SCOPE("worker");
+        if (thread == 1) workerName = Threading::threadName();
+    });
+
+    // 7 events on the main thread (it is also worker 0), the 3 oldest are overwritten
+    for (int i = 0; i < 6; ++i)
+    {
+        TRACE_SCOPE("step");
+    }
+
+    std::string filename = "test_tracer.trace.json";
+    size_t dropped = tracer.write(filename);
+    REQUIRE(dropped == 3);
+
+    std::ifstream file(filename);
+    std::string contents((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    size_t stepEvents = 0;
+    for (size_t pos = contents.find("\"name\": \"step\""); pos != std::string::npos; pos = contents.find("\"name\": \"step\"", pos + 1))
+    {
+        ++stepEvents;
+    }
+
+    REQUIRE(stepEvents == 4);
+
+    // with a single thread the worker event is one of the overwritten ones
+    if (Threading::numThreads() > 1)
+    {
+        REQUIRE(contents.find("\"name\": \"worker\"") != std::string::npos);
+        REQUIRE(contents.find("\"name\": \"" + workerName + "\"") != std::string::npos);
+    }
+
+    std::remove(filename.c_str());
+}
+#endif
+
+TEST_CASE("Roofline attainable performance is the lower of the two roofs")
+{
+    Roofline::Machine machine;
+    machine.peakGflops = 100.0;
+    machine.scalarPeakGflops = 25.0;
+    machine.bandwidthGBs = 10.0;
+
+    // memory bound below the ridge point
+    REQUIRE(Roofline::attainable(machine, 0.5, false) == Catch::Approx(5.0));
+    REQUIRE(Roofline::attainable(machine, 0.5, true) == Catch::Approx(5.0));
+
+    // compute bound above it, scalar code has a lower ridge point
+    REQUIRE(Roofline::attainable(machine, 5.0, false) == Catch::Approx(50.0));
+    REQUIRE(Roofline::attainable(machine, 5.0, true) == Catch::Approx(25.0));
+    REQUIRE(Roofline::attainable(machine, 20.0, false) == Catch::Approx(100.0));
+
+    // without a detected clock only the memory roof is known
+    machine.peakGflops = 0.0;
+    REQUIRE(Roofline::attainable(machine, 20.0, false) == Catch::Approx(200.0));
+
+    REQUIRE(Roofline::measureBandwidth(size_t(1) << 16) > 0.0);
+}
+
+TEST_CASE("Only the master thread of a team records regions")
+{
+    auto& profiler = Profiler::getInstance();
+    profiler.reset();
+    profiler.setEnabled(true);
+
+    profiler.beginIteration(0);
+    Threading::onEveryThread([](size_t)
+    {
+        PROFILE_REGION("team");
+    });
+    profiler.endIteration();
+
+    Profiler::Stats stats;
+    REQUIRE(profiler.getStats("team", stats));
+    REQUIRE(stats.count == 1);
+
+    std::atomic<bool> workerThrew{false};
+    Threading::onEveryThread([&](size_t thread)
+    {
+        if (thread == 1)
+        {
+            try
+            {
+                profiler.enter("worker");
+            }
+            catch (const std::runtime_error&)
+            {
+                workerThrew = true;
+            }
+        }
+    });
+    REQUIRE(workerThrew == (Threading::numThreads() > 1));
+
+    profiler.reset();
+    profiler.setEnabled(false);
+}
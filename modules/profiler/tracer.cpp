@@ -0,0 +1,82 @@
+#include "tracer.h"
+
+#include <algorithm>
+#include <bit>
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+
+#include "threading.h"
+
+Tracer& Tracer::getInstance()
+{
+    static Tracer instance;
+    return instance;
+}
+
+#ifdef TIME_PROFILE
+void Tracer::enable(size_t eventsPerThread)
+{
+    mCapacity = std::bit_ceil(std::max<size_t>(eventsPerThread, 1));
+    sStart = Clock::now();
+    sEnabled = true;
+}
+
+Tracer::ThreadBuffer* Tracer::registerThread()
+{
+    auto buffer = std::make_unique<ThreadBuffer>();
+    buffer->events.resize(mCapacity);
+    buffer->mask = mCapacity - 1;
+    buffer->threadName = Threading::threadName();
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    mBuffers.emplace_back(std::move(buffer));
+    tBuffer = mBuffers.back().get();
+
+    return tBuffer;
+}
+
+size_t Tracer::write(const std::string& filename) const
+{
+    std::ofstream file(filename);
+
+    if (!file.is_open())
+    {
+        throw std::runtime_error("unable to open file to write trace: " + filename);
+    }
+
+    size_t dropped = 0;
+    bool first = true;
+
+    file << std::fixed << std::setprecision(3);
+    file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+
+    for (size_t tid = 0; tid < mBuffers.size(); ++tid)
+    {
+        const ThreadBuffer& buffer = *mBuffers[tid];
+
+        file << (first ? "" : ",\n")
+             << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << tid
+             << ", \"args\": {\"name\": \"" << buffer.threadName << "\"}}";
+        first = false;
+
+        // oldest surviving event first
+        const size_t count = std::min(buffer.head, buffer.events.size());
+        dropped += buffer.head - count;
+
+        for (size_t i = buffer.head - count; i < buffer.head; ++i)
+        {
+            const Event& event = buffer.events[i & buffer.mask];
+
+            // complete events in microseconds
+            file << ",\n{\"name\": \"" << event.name << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << tid
+                 << ", \"ts\": " << static_cast<double>(event.beginNs) * 1e-3
+                 << ", \"dur\": " << static_cast<double>(event.endNs - event.beginNs) * 1e-3 << "}";
+        }
+    }
+
+    file << "\n]}\n";
+
+    return dropped;
+}
+#endif
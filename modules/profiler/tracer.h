@@ -0,0 +1,125 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// timeline of begin/end events on every thread, written as a chrome trace
+// (open in https://ui.perfetto.dev or chrome://tracing)
+//
+// every thread appends to its own ring buffer so recording never synchronizes,
+// a full buffer overwrites its oldest events (the end of a long run is kept and
+// the number of dropped events is reported), buffers are only read by write()
+// which has to be called outside of parallel regions
+//
+// compiled out together with the profiler regions (-DTIME_PROFILING=OFF)
+class Tracer
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Event
+    {
+        const char* name;       // string literal, never copied
+        int64_t beginNs;
+        int64_t endNs;
+    };
+
+    static constexpr size_t DEFAULT_EVENTS_PER_THREAD = size_t(1) << 18;
+
+    static Tracer& getInstance();
+
+#ifdef TIME_PROFILE
+    static inline bool isEnabled()
+    {
+        return sEnabled;
+    }
+
+    // capacity is rounded up to a power of two, has to be called before any event is recorded
+    void enable(size_t eventsPerThread = DEFAULT_EVENTS_PER_THREAD);
+
+    static inline void record(const char* name, Clock::time_point begin, Clock::time_point end)
+    {
+        ThreadBuffer* buffer = tBuffer ? tBuffer : getInstance().registerThread();
+
+        Event& event = buffer->events[buffer->head & buffer->mask];
+        event.name = name;
+        event.beginNs = std::chrono::duration_cast<std::chrono::nanoseconds>(begin - sStart).count();
+        event.endNs = std::chrono::duration_cast<std::chrono::nanoseconds>(end - sStart).count();
+        ++buffer->head;
+    }
+
+    // events still in the buffers, returns the number of events that were overwritten
+    size_t write(const std::string& filename) const;
+#else
+    static inline bool isEnabled() { return false; }
+    inline void enable(size_t = DEFAULT_EVENTS_PER_THREAD) {}
+    static inline void record(const char*, Clock::time_point, Clock::time_point) {}
+    inline size_t write(const std::string&) const { return 0; }
+#endif
+
+private:
+    Tracer() = default;
+
+#ifdef TIME_PROFILE
+    struct ThreadBuffer
+    {
+        std::vector<Event> events;
+        size_t mask;
+        size_t head = 0;        // total events recorded, only touched by the owning thread
+        std::string threadName;
+    };
+
+    // once per thread, the only place that takes a lock
+    ThreadBuffer* registerThread();
+
+    inline static bool sEnabled = false;
+    inline static thread_local ThreadBuffer* tBuffer = nullptr;
+    inline static Clock::time_point sStart;
+
+    size_t mCapacity = 0;
+    std::mutex mMutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> mBuffers;
+#endif
+};
+
+// records the enclosing scope on the calling thread, safe inside parallel regions and tasks
+class TraceScope
+{
+public:
+#ifdef TIME_PROFILE
+    explicit TraceScope(const char* name)
+        : mName(Tracer::isEnabled() ? name : nullptr)
+    {
+        if (mName) mBegin = Tracer::Clock::now();
+    }
+
+    ~TraceScope()
+    {
+        if (mName) Tracer::record(mName, mBegin, Tracer::Clock::now());
+    }
+#else
+    explicit TraceScope(const char*) {}
+#endif
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+#ifdef TIME_PROFILE
+    const char* mName;
+    Tracer::Clock::time_point mBegin;
+#endif
+};
+
+#define PROFILE_COMBINE_IMPL(a, b) a##b
+#define PROFILE_COMBINE(a, b) PROFILE_COMBINE_IMPL(a, b)
+
+#ifdef TIME_PROFILE
+#define TRACE_SCOPE(name) TraceScope PROFILE_COMBINE(traceScope_, __LINE__)(name)
+#else
+#define TRACE_SCOPE(name)
+#endif
@@ -0,0 +1,319 @@
+// tests/test_threading.cpp
+
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch_all.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sched.h>
+
+#include "threading.h"
+#include "topology.h"
+#include "work_stealing_deque.h"
+#include "work_stealing_pool.h"
+
+namespace
+{
+    uint64_t fibonacci(uint64_t n)
+    {
+        if (n < 2) return n;
+
+        uint64_t a = 0;
+        uint64_t b = 0;
+
+        TaskGroup group;
+        group.spawn([&a, n]() { a = fibonacci(n - 1); });
+        b = fibonacci(n - 2);
+        group.sync();
+
+        return a + b;
+    }
+}
+
+TEST_CASE("Work stealing deque pops newest first and steals oldest first")
+{
+    std::vector<int> values(4);
+    WorkStealingDeque<int*> deque(4);
+
+    REQUIRE(deque.capacity() == 4);
+    REQUIRE(deque.pop() == nullptr);
+    REQUIRE(deque.steal() == nullptr);
+
+    for (auto& value : values)
+    {
+        REQUIRE(deque.push(&value));
+    }
+
+    // full, the caller has to run the item itself
+    int extra = 0;
+    REQUIRE_FALSE(deque.push(&extra));
+
+    REQUIRE(deque.pop() == &values[3]);
+    REQUIRE(deque.steal() == &values[0]);
+    REQUIRE(deque.pop() == &values[2]);
+    REQUIRE(deque.steal() == &values[1]);
+    REQUIRE(deque.empty());
+    REQUIRE(deque.pop() == nullptr);
+}
+
+TEST_CASE("Every item of a work stealing deque is taken exactly once under contention")
+{
+    static constexpr size_t NUM_ITEMS = 100000;
+    static constexpr size_t NUM_THIEVES = 3;
+
+    std::vector<int> items(NUM_ITEMS);
+    std::vector<std::atomic<int>> taken(NUM_ITEMS);
+    WorkStealingDeque<int*> deque(256);
+
+    std::atomic<bool> done{false};
+    std::vector<std::thread> thieves;
+
+    for (size_t t = 0; t < NUM_THIEVES; ++t)
+    {
+        thieves.emplace_back([&]()
+        {
+            while (!done.load() || !deque.empty())
+            {
+                if (int* item = deque.steal())
+                {
+                    taken[item - items.data()].fetch_add(1);
+                }
+            }
+        });
+    }
+
+    // the owner pushes everything and pops every other round
+    for (size_t i = 0; i < NUM_ITEMS; ++i)
+    {
+        while (!deque.push(&items[i]))
+        {
+            if (int* item = deque.pop()) taken[item - items.data()].fetch_add(1);
+        }
+
+        if (i % 2 == 0)
+        {
+            if (int* item = deque.pop()) taken[item - items.data()].fetch_add(1);
+        }
+    }
+
+    while (int* item = deque.pop())
+    {
+        taken[item - items.data()].fetch_add(1);
+    }
+
+    done = true;
+    for (auto& thief : thieves)
+    {
+        thief.join();
+    }
+
+    for (const auto& count : taken)
+    {
+        REQUIRE(count.load() == 1);
+    }
+}
+
+TEST_CASE("Work stealing pool runs submitted tasks and broadcasts to every worker")
+{
+    WorkStealingPool pool(4, 16);
+    REQUIRE(pool.size() == 4);
+    REQUIRE(pool.workerId() == 0);
+
+    std::atomic<size_t> pending{0};
+    std::atomic<size_t> sum{0};
+
+    // more tasks than the deque holds, the overflow runs inline
+    for (size_t i = 1; i <= 1000; ++i)
+    {
+        auto* task = new WorkStealingPool::Closure([&sum, i]() { sum.fetch_add(i); });
+        task->pending = &pending;
+
+        pending.fetch_add(1);
+        pool.submit(task);
+    }
+
+    pool.wait(pending);
+    REQUIRE(sum.load() == 500500);
+
+    std::vector<size_t> calls(pool.size(), 0);
+    std::set<std::thread::id> threads;
+    std::mutex mutex;
+
+    pool.broadcast([&](size_t worker)
+    {
+        ++calls[worker];
+
+        std::lock_guard<std::mutex> lock(mutex);
+        threads.insert(std::this_thread::get_id());
+    });
+
+    REQUIRE(std::all_of(calls.begin(), calls.end(), [](size_t count) { return count == 1; }));
+    REQUIRE(threads.size() == pool.size());
+
+    // a thread the pool does not own runs everything inline
+    std::thread([&]()
+    {
+        REQUIRE(pool.workerId() == WorkStealingPool::NOT_A_WORKER);
+        REQUIRE_FALSE(pool.runOne());
+    }).join();
+}
+
+TEST_CASE("Parallel for covers every index exactly once in chunks of the grain")
+{
+    const size_t begin = 3;
+    const size_t end = 10007;
+    const size_t grain = 64;
+
+    std::vector<std::atomic<int>> visits(end);
+    std::atomic<size_t> chunks{0};
+    std::atomic<bool> aligned{true};
+
+    Threading::parallelFor(begin, end, grain, [&](size_t first, size_t last)
+    {
+        chunks.fetch_add(1);
+        if ((first - begin) % grain != 0 || (last - first != grain && last != end)) aligned = false;
+        if (Threading::threadId() >= Threading::numThreads()) aligned = false;
+
+        for (size_t i = first; i < last; ++i)
+        {
+            visits[i].fetch_add(1);
+        }
+    });
+
+    REQUIRE(aligned.load());
+    REQUIRE(chunks.load() == (end - begin + grain - 1) / grain);
+
+    for (size_t i = 0; i < end; ++i)
+    {
+        REQUIRE(visits[i].load() == (i >= begin ? 1 : 0));
+    }
+
+    // empty ranges never call the body
+    Threading::parallelFor(5, 5, 1, [&](size_t, size_t) { aligned = false; });
+    REQUIRE(aligned.load());
+}
+
+TEST_CASE("Parallel reduce combines the chunks in order")
+{
+    const size_t count = 100000;
+
+    // floating point sums are only reproducible if the order is fixed
+    auto sum = [&]()
+    {
+        return Threading::parallelReduce(size_t(0), count, 1000, 0.0,
+                                         [](size_t first, size_t last)
+                                         {
+                                             double partial = 0.0;
+                                             for (size_t i = first; i < last; ++i) partial += 1.0 / (1.0 + i);
+                                             return partial;
+                                         },
+                                         [](double a, double b) { return a + b; });
+    };
+
+    double serial = 0.0;
+    for (size_t first = 0; first < count; first += 1000)
+    {
+        double partial = 0.0;
+        for (size_t i = first; i < first + 1000; ++i) partial += 1.0 / (1.0 + i);
+        serial += partial;
+    }
+
+    REQUIRE(sum() == serial);
+    REQUIRE(sum() == sum());
+
+    // non commutative combine
+    std::vector<size_t> order = Threading::parallelReduce(size_t(0), size_t(100), 7, std::vector<size_t>{},
+                                                          [](size_t first, size_t) { return std::vector<size_t>{ first }; },
+                                                          [](std::vector<size_t> a, const std::vector<size_t>& b)
+                                                          {
+                                                              a.insert(a.end(), b.begin(), b.end());
+                                                              return a;
+                                                          });
+
+    REQUIRE(order.size() == 15);
+    REQUIRE(std::is_sorted(order.begin(), order.end()));
+}
+
+TEST_CASE("Nested task groups spawned from tasks all complete")
+{
+    uint64_t result = 0;
+    Threading::runTasks([&]() { result = fibonacci(20); });
+
+    REQUIRE(result == 6765);
+}
+
+TEST_CASE("Every thread of the backend runs per thread setup once")
+{
+    std::vector<std::atomic<int>> calls(Threading::numThreads());
+
+    Threading::onEveryThread([&](size_t thread)
+    {
+        calls[thread].fetch_add(1);
+    });
+
+    for (const auto& count : calls)
+    {
+        REQUIRE(count.load() == 1);
+    }
+
+    REQUIRE(Threading::threadId() == 0);
+    REQUIRE(Threading::threadName() == "main");
+}
+
+TEST_CASE("Topology covers the allowed cpus and binds every thread to one")
+{
+    auto& topology = Topology::getInstance();
+    REQUIRE(topology.numNodes() >= 1);
+
+    std::set<int> cpus;
+    for (size_t node = 0; node < topology.numNodes(); ++node)
+    {
+        REQUIRE_FALSE(topology.cpus(node).empty());
+
+        for (int cpu : topology.cpus(node))
+        {
+            REQUIRE(topology.nodeOfCpu(cpu) == node);
+            REQUIRE(cpus.insert(cpu).second);
+        }
+    }
+
+    auto unbound = topology.bindThreads(Topology::Binding::None);
+    REQUIRE(unbound.size() == Threading::numThreads());
+
+    for (auto binding : { Topology::Binding::Spread, Topology::Binding::Close })
+    {
+        const auto threadCpus = topology.bindThreads(binding);
+        REQUIRE(threadCpus.size() == Threading::numThreads());
+
+        // every thread runs on the cpu it was given from now on
+        std::vector<int> running(Threading::numThreads(), -1);
+        std::vector<size_t> nodes(Threading::numThreads(), 0);
+        Threading::onEveryThread([&](size_t thread)
+        {
+            running[thread] = sched_getcpu();
+            nodes[thread] = topology.currentNode();
+        });
+
+        for (size_t thread = 0; thread < threadCpus.size(); ++thread)
+        {
+            REQUIRE(cpus.count(threadCpus[thread]) == 1);
+            REQUIRE(running[thread] == threadCpus[thread]);
+            REQUIRE(nodes[thread] == topology.nodeOfCpu(threadCpus[thread]));
+        }
+
+        // no cpu is used twice before every allowed one is used
+        std::set<int> distinct(threadCpus.begin(), threadCpus.end());
+        REQUIRE(distinct.size() == std::min(threadCpus.size(), cpus.size()));
+    }
+
+    REQUIRE(Topology::bindingFromString("spread") == Topology::Binding::Spread);
+    REQUIRE(std::string(Topology::bindingName(Topology::Binding::Close)) == "close");
+    REQUIRE_THROWS_AS(Topology::bindingFromString("compact"), std::runtime_error);
+}
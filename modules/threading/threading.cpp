@@ -0,0 +1,40 @@
+#include "threading.h"
+
+const char* Threading::backendName()
+{
+#ifdef THREADING_NATIVE
+    return "native";
+#else
+    return "openmp";
+#endif
+}
+
+size_t Threading::numThreads()
+{
+#ifdef THREADING_NATIVE
+    return WorkStealingPool::getInstance().size();
+#else
+    return static_cast<size_t>(omp_get_max_threads());
+#endif
+}
+
+size_t Threading::threadId()
+{
+#ifdef THREADING_NATIVE
+    // threads outside of the pool only ever run work inline
+    const size_t id = WorkStealingPool::getInstance().workerId();
+    return id == WorkStealingPool::NOT_A_WORKER ? 0 : id;
+#else
+    return static_cast<size_t>(omp_get_thread_num());
+#endif
+}
+
+std::string Threading::threadName()
+{
+#ifdef THREADING_NATIVE
+    const size_t id = threadId();
+    return id == 0 ? "main" : "pool thread " + std::to_string(id);
+#else
+    return omp_in_parallel() ? "omp thread " + std::to_string(omp_get_thread_num()) : "main";
+#endif
+}
@@ -0,0 +1,241 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <omp.h>
+
+#ifdef THREADING_NATIVE
+#include "work_stealing_pool.h"
+#endif
+
+// parallel loops and tasks of the engine behind one interface, built either on openmp
+// (default) or on the native work stealing pool (-DTHREADING_BACKEND=native), the call
+// sites are the same for both:
+//
+//     Threading::parallelFor(0, n, grain, [&](size_t first, size_t last) { ... });
+//
+//     Threading::runTasks([&]() { recurse(root); });
+//     void recurse(Node* node)
+//     {
+//         TaskGroup group;
+//         group.spawn([=]() { recurse(node->child); });
+//         group.sync();
+//     }
+//
+// both backends use OMP_NUM_THREADS threads, exceptions must not escape a loop body or task
+class Threading
+{
+public:
+    // "openmp" or "native"
+    static const char* backendName();
+
+    static size_t numThreads();
+
+    // 0 for the thread that drives the simulation, unique among the threads running the
+    // chunks of a loop or the tasks of a group at the same time
+    static size_t threadId();
+
+    // "main" outside of parallel work, the backend's name for the thread otherwise
+    static std::string threadName();
+
+    // one chunk per thread, what schedule(static) hands out
+    static inline size_t evenGrain(size_t count)
+    {
+        const size_t threads = numThreads();
+        return std::max<size_t>((count + threads - 1) / threads, 1);
+    }
+
+    // body(first, last) for every chunk [first, last) of grain items of [begin, end), the
+    // chunks run concurrently in no particular order, no more chunks than threads is
+    // schedule(static, 1) and more is schedule(dynamic) with openmp, the native pool splits
+    // the chunks recursively and balances them by stealing
+    template <class Body>
+    static void parallelFor(size_t begin, size_t end, size_t grain, const Body& body)
+    {
+        if (end <= begin) return;
+
+        grain = std::max<size_t>(grain, 1);
+        const size_t numChunks = (end - begin + grain - 1) / grain;
+
+        auto runChunk = [&](size_t chunk)
+        {
+            body(begin + chunk * grain, std::min(end, begin + (chunk + 1) * grain));
+        };
+
+        if (numChunks == 1)
+        {
+            runChunk(0);
+            return;
+        }
+
+#ifdef THREADING_NATIVE
+        splitChunks(0, numChunks, runChunk);
+#else
+        if (numChunks <= numThreads())
+        {
+            #pragma omp parallel for schedule(static, 1)
+            for (size_t chunk = 0; chunk < numChunks; ++chunk)
+            {
+                runChunk(chunk);
+            }
+        }
+        else
+        {
+            #pragma omp parallel for schedule(dynamic)
+            for (size_t chunk = 0; chunk < numChunks; ++chunk)
+            {
+                runChunk(chunk);
+            }
+        }
+#endif
+    }
+
+    // map(first, last) of every chunk, combined in chunk order so the result only depends
+    // on the grain and not on which thread ran which chunk
+    template <class T, class Map, class Combine>
+    static T parallelReduce(size_t begin, size_t end, size_t grain, T identity, const Map& map, const Combine& combine)
+    {
+        if (end <= begin) return identity;
+
+        grain = std::max<size_t>(grain, 1);
+        const size_t numChunks = (end - begin + grain - 1) / grain;
+
+        std::vector<T> partial(numChunks, identity);
+
+        parallelFor(0, numChunks, 1, [&](size_t first, size_t last)
+        {
+            for (size_t chunk = first; chunk < last; ++chunk)
+            {
+                partial[chunk] = map(begin + chunk * grain, std::min(end, begin + (chunk + 1) * grain));
+            }
+        });
+
+        T result = std::move(identity);
+        for (auto& value : partial)
+        {
+            result = combine(std::move(result), value);
+        }
+
+        return result;
+    }
+
+    // root runs on the calling thread with every other thread free to run the tasks it
+    // spawns, with openmp this is the parallel region with a single construct tasks need
+    template <class Root>
+    static void runTasks(const Root& root)
+    {
+#ifdef THREADING_NATIVE
+        root();
+#else
+        #pragma omp parallel
+        {
+            #pragma omp single
+            {
+                root();
+            }
+        }
+#endif
+    }
+
+    // function(threadId) exactly once on every thread of the backend (per thread setup),
+    // only from the main thread outside of parallel work
+    template <class Function>
+    static void onEveryThread(const Function& function)
+    {
+#ifdef THREADING_NATIVE
+        WorkStealingPool::getInstance().broadcast(function);
+#else
+        #pragma omp parallel num_threads(static_cast<int>(numThreads()))
+        {
+            function(static_cast<size_t>(omp_get_thread_num()));
+        }
+#endif
+    }
+
+private:
+    Threading() = default;
+
+#ifdef THREADING_NATIVE
+    // the upper half of the chunks becomes a task until a single chunk is left, a thief
+    // takes the oldest and so the biggest half
+    template <class RunChunk>
+    static void splitChunks(size_t first, size_t last, const RunChunk& runChunk);
+#endif
+};
+
+// tasks spawned by one scope, sync() returns once all of them (and everything they
+// synced on) are done, the destructor syncs
+//
+// with openmp spawn is an omp task and sync a taskwait, which waits for every child
+// task of the current task, the same thing as long as a scope uses a single group
+class TaskGroup
+{
+public:
+    TaskGroup() = default;
+
+    ~TaskGroup()
+    {
+        sync();
+    }
+
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+    // function is copied into the task, captured references have to outlive the sync
+    template <class F>
+    void spawn(F&& function)
+    {
+#ifdef THREADING_NATIVE
+        auto* task = new WorkStealingPool::Closure<std::decay_t<F>>(std::forward<F>(function));
+        task->pending = &mPending;
+
+        mPending.fetch_add(1, std::memory_order_relaxed);
+        WorkStealingPool::getInstance().submit(task);
+#else
+        std::decay_t<F> task(std::forward<F>(function));
+
+        #pragma omp task firstprivate(task)
+        {
+            task();
+        }
+#endif
+    }
+
+    inline void sync()
+    {
+#ifdef THREADING_NATIVE
+        WorkStealingPool::getInstance().wait(mPending);
+#else
+        #pragma omp taskwait
+#endif
+    }
+
+private:
+#ifdef THREADING_NATIVE
+    std::atomic<size_t> mPending{0};
+#endif
+};
+
+#ifdef THREADING_NATIVE
+template <class RunChunk>
+void Threading::splitChunks(size_t first, size_t last, const RunChunk& runChunk)
+{
+    TaskGroup group;
+
+    while (last - first > 1)
+    {
+        const size_t middle = first + (last - first) / 2;
+        group.spawn([middle, last, &runChunk]() { splitChunks(middle, last, runChunk); });
+        last = middle;
+    }
+
+    runChunk(first);
+    group.sync();
+}
+#endif
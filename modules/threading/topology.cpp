@@ -0,0 +1,244 @@
+#include "topology.h"
+#include "threading.h"
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+#include <pthread.h>
+#include <sched.h>
+
+namespace
+{
+    // "0-17,36-53"
+    std::vector<int> parseCpuList(const std::string& list)
+    {
+        std::vector<int> cpus;
+        std::istringstream ranges(list);
+        std::string range;
+
+        while (std::getline(ranges, range, ','))
+        {
+            if (range.empty()) continue;
+
+            const size_t dash = range.find('-');
+            const int first = std::stoi(range.substr(0, dash));
+            const int last = dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+
+            for (int cpu = first; cpu <= last; ++cpu)
+            {
+                cpus.emplace_back(cpu);
+            }
+        }
+
+        return cpus;
+    }
+
+    std::string readLine(const std::string& path)
+    {
+        std::ifstream file(path);
+        std::string line;
+        std::getline(file, line);
+        return line;
+    }
+
+    // the lowest cpu of a core stands for the core, the others are its smt siblings
+    bool isFirstOfCore(int cpu)
+    {
+        const auto siblings = parseCpuList(readLine("/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/thread_siblings_list"));
+        return siblings.empty() || siblings.front() == cpu;
+    }
+}
+
+Topology::Binding Topology::bindingFromString(const std::string& name)
+{
+    if (name == "none")     return Binding::None;
+    if (name == "close")    return Binding::Close;
+    if (name == "spread")   return Binding::Spread;
+
+    throw std::runtime_error("unknown affinity: " + name);
+}
+
+const char* Topology::bindingName(Binding binding)
+{
+    switch (binding)
+    {
+    case Binding::None:     return "none";
+    case Binding::Close:    return "close";
+    case Binding::Spread:   return "spread";
+    }
+
+    return "";
+}
+
+Topology& Topology::getInstance()
+{
+    static Topology instance;
+    return instance;
+}
+
+Topology::Topology()
+{
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+    {
+        throw std::runtime_error("unable to read the cpus the process may run on");
+    }
+
+    std::vector<std::vector<int>> nodes;
+    for (size_t node = 0; ; ++node)
+    {
+        std::ifstream cpulist("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+        if (!cpulist.is_open()) break;
+
+        std::string line;
+        std::getline(cpulist, line);
+        nodes.emplace_back(parseCpuList(line));
+    }
+
+    // no numa information, every cpu on one node
+    if (nodes.empty())
+    {
+        nodes.emplace_back();
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+        {
+            if (CPU_ISSET(cpu, &allowed)) nodes.back().emplace_back(cpu);
+        }
+    }
+
+    for (const auto& nodeCpus : nodes)
+    {
+        std::vector<int> cores;
+        std::vector<int> siblings;
+
+        for (int cpu : nodeCpus)
+        {
+            if (cpu >= CPU_SETSIZE || !CPU_ISSET(cpu, &allowed)) continue;
+
+            (isFirstOfCore(cpu) ? cores : siblings).emplace_back(cpu);
+        }
+
+        // nodes without a cpu the process may use (memory only or outside the cpuset)
+        if (cores.empty() && siblings.empty()) continue;
+
+        const size_t node = mNodeCpus.size();
+        for (int cpu : nodeCpus)
+        {
+            if (static_cast<size_t>(cpu) >= mCpuNode.size()) mCpuNode.resize(cpu + 1, 0);
+            mCpuNode[cpu] = node;
+        }
+
+        cores.insert(cores.end(), siblings.begin(), siblings.end());
+        mNodeCpus.emplace_back(std::move(cores));
+    }
+
+    if (mNodeCpus.empty())
+    {
+        throw std::runtime_error("no cpu the process may run on");
+    }
+}
+
+size_t Topology::nodeOfCpu(int cpu) const
+{
+    return cpu >= 0 && static_cast<size_t>(cpu) < mCpuNode.size() ? mCpuNode[cpu] : 0;
+}
+
+size_t Topology::currentNode() const
+{
+    return nodeOfCpu(sched_getcpu());
+}
+
+std::vector<int> Topology::bindThreads(Binding binding)
+{
+    const size_t numThreads = Threading::numThreads();
+    std::vector<int> threadCpus(numThreads, -1);
+
+    if (binding == Binding::None)
+    {
+        Threading::onEveryThread([&](size_t thread) { threadCpus[thread] = sched_getcpu(); });
+        return threadCpus;
+    }
+
+    // cores before smt siblings on every node, so neither placement doubles up on a core
+    // while another one is idle
+    std::vector<int> order;
+    if (binding == Binding::Close)
+    {
+        for (const auto& nodeCpus : mNodeCpus) order.insert(order.end(), nodeCpus.begin(), nodeCpus.end());
+
+        // a node's smt siblings come after the cores of every node
+        std::stable_partition(order.begin(), order.end(), [](int cpu) { return isFirstOfCore(cpu); });
+    }
+    else
+    {
+        size_t longest = 0;
+        for (const auto& nodeCpus : mNodeCpus) longest = std::max(longest, nodeCpus.size());
+
+        for (size_t i = 0; i < longest; ++i)
+        {
+            for (const auto& nodeCpus : mNodeCpus)
+            {
+                if (i < nodeCpus.size()) order.emplace_back(nodeCpus[i]);
+            }
+        }
+    }
+
+    // more threads than cpus share them in the same order
+    for (size_t thread = 0; thread < numThreads; ++thread)
+    {
+        threadCpus[thread] = order[thread % order.size()];
+    }
+
+    std::atomic<bool> failed{false};
+    Threading::onEveryThread([&](size_t thread)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(threadCpus[thread], &set);
+
+        if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) failed = true;
+    });
+
+    if (failed)
+    {
+        throw std::runtime_error(std::string("unable to bind the threads with affinity ") + bindingName(binding));
+    }
+
+    return threadCpus;
+}
+
+std::string Topology::describe(const std::vector<int>& threadCpus) const
+{
+    std::ostringstream out;
+
+    for (size_t node = 0; node < numNodes(); ++node)
+    {
+        std::ostringstream threads;
+        std::ostringstream cpus;
+        size_t count = 0;
+
+        for (size_t thread = 0; thread < threadCpus.size(); ++thread)
+        {
+            if (threadCpus[thread] < 0 || nodeOfCpu(threadCpus[thread]) != node) continue;
+
+            threads << " " << thread;
+            cpus << " " << threadCpus[thread];
+            ++count;
+        }
+
+        out << (node > 0 ? ", " : "") << "node " << node << ": ";
+        if (count == 0)
+        {
+            out << "no threads";
+        }
+        else
+        {
+            out << "threads" << threads.str() << " on cpus" << cpus.str();
+        }
+    }
+
+    return out.str();
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// numa nodes and cpus of the machine as linux reports them in /sys/devices/system/node,
+// limited to the cpus the process may run on (taskset, slurm cpusets), a single node with
+// every allowed cpu where there is no numa information
+class Topology
+{
+public:
+    // how bindThreads places the threads of the backend, one cpu each:
+    //  - None keeps whatever OMP_PROC_BIND/OMP_PLACES or the scheduler decide
+    //  - Close fills one numa node after the other (18 threads on 2x18 cores stay on one socket)
+    //  - Spread deals the threads round robin over the nodes (18 threads use both sockets)
+    enum class Binding
+    {
+        None,
+        Close,
+        Spread
+    };
+
+    // none, close or spread, throws for anything else
+    static Binding bindingFromString(const std::string& name);
+
+    static const char* bindingName(Binding binding);
+
+    static Topology& getInstance();
+
+    inline size_t numNodes() const
+    {
+        return mNodeCpus.size();
+    }
+
+    // allowed cpus of node, the first hardware thread of every core before the smt siblings
+    inline const std::vector<int>& cpus(size_t node) const
+    {
+        return mNodeCpus[node];
+    }
+
+    // 0 for cpus linux does not report
+    size_t nodeOfCpu(int cpu) const;
+
+    // node of the cpu the calling thread runs on right now, stable once the thread is bound
+    size_t currentNode() const;
+
+    // binds every thread of the backend to one cpu, only from the main thread outside of
+    // parallel work, returns the cpu of every thread (where it ran for None)
+    std::vector<int> bindThreads(Binding binding);
+
+    // "node 0: threads 0 2 4 on cpus 0 1 2, node 1: ..." for the cpus bindThreads returned
+    std::string describe(const std::vector<int>& threadCpus) const;
+
+private:
+    Topology();
+
+    std::vector<std::vector<int>> mNodeCpus;    // [node]
+    std::vector<size_t> mCpuNode;               // [cpu]
+};
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// bounded chase-lev deque (with the c11 memory orders of le et al., ppopp 2013), the owning
+// thread pushes and pops at the bottom, any other thread steals from the top, T has to be
+// a pointer (nullptr means empty or lost the race for the last item)
+template <class T>
+class WorkStealingDeque
+{
+public:
+    explicit WorkStealingDeque(size_t capacity)
+        : mCapacity(std::bit_ceil(std::max<size_t>(capacity, 2)))
+        , mMask(mCapacity - 1)
+        , mBuffer(std::make_unique<std::atomic<T>[]>(mCapacity))
+    {
+    }
+
+    WorkStealingDeque(const WorkStealingDeque&) = delete;
+    WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+    // owner only, returns false if the deque is full (the caller runs the item itself)
+    bool push(T item)
+    {
+        const int64_t bottom = mBottom.load(std::memory_order_relaxed);
+        const int64_t top = mTop.load(std::memory_order_acquire);
+
+        if (bottom - top >= static_cast<int64_t>(mCapacity)) return false;
+
+        // a release store instead of the paper's release fence, the same on x86 and visible
+        // to thread sanitizer
+        mBuffer[bottom & mMask].store(item, std::memory_order_relaxed);
+        mBottom.store(bottom + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    // owner only, newest item first
+    T pop()
+    {
+        const int64_t bottom = mBottom.load(std::memory_order_relaxed) - 1;
+        mBottom.store(bottom, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t top = mTop.load(std::memory_order_relaxed);
+
+        if (top > bottom)
+        {
+            mBottom.store(bottom + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+
+        T item = mBuffer[bottom & mMask].load(std::memory_order_relaxed);
+
+        // the last item, race the thieves for it
+        if (top == bottom)
+        {
+            if (!mTop.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+            {
+                item = nullptr;
+            }
+            mBottom.store(bottom + 1, std::memory_order_relaxed);
+        }
+
+        return item;
+    }
+
+    // any thread, oldest item first
+    T steal()
+    {
+        int64_t top = mTop.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        const int64_t bottom = mBottom.load(std::memory_order_acquire);
+
+        if (top >= bottom) return nullptr;
+
+        T item = mBuffer[top & mMask].load(std::memory_order_relaxed);
+        if (!mTop.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst, std::memory_order_relaxed))
+        {
+            return nullptr;
+        }
+
+        return item;
+    }
+
+    inline bool empty() const
+    {
+        return mTop.load(std::memory_order_relaxed) >= mBottom.load(std::memory_order_relaxed);
+    }
+
+    inline size_t capacity() const
+    {
+        return mCapacity;
+    }
+
+private:
+    // owner and thieves write different ends, keep them off each other's cache line
+    alignas(64) std::atomic<int64_t> mTop{0};
+    alignas(64) std::atomic<int64_t> mBottom{0};
+    alignas(64) const size_t mCapacity;
+    const size_t mMask;
+    std::unique_ptr<std::atomic<T>[]> mBuffer;
+};
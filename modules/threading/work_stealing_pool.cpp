@@ -0,0 +1,260 @@
+#include "work_stealing_pool.h"
+
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+
+namespace
+{
+    thread_local WorkStealingPool* tPool = nullptr;
+    thread_local size_t tWorker = WorkStealingPool::NOT_A_WORKER;
+
+    // victim selection, xorshift seeded per thread so thieves do not all hit the same deque
+    size_t nextVictim()
+    {
+        thread_local uint64_t state = 0x9e3779b97f4a7c15ull ^ reinterpret_cast<uintptr_t>(&state);
+
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+
+        return static_cast<size_t>(state);
+    }
+}
+
+WorkStealingPool::WorkStealingPool(size_t numThreads, size_t dequeCapacity)
+    : mPreviousPool(tPool)
+    , mPreviousWorker(tWorker)
+{
+    if (numThreads == 0)
+    {
+        throw std::runtime_error("trying to create a thread pool with 0 threads");
+    }
+
+    for (size_t i = 0; i < numThreads; ++i)
+    {
+        mDeques.emplace_back(std::make_unique<WorkStealingDeque<Task*>>(dequeCapacity));
+    }
+
+    tPool = this;
+    tWorker = 0;
+
+    mThreads.reserve(numThreads - 1);
+    for (size_t id = 1; id < numThreads; ++id)
+    {
+        mThreads.emplace_back([this, id](std::stop_token stop) { workerLoop(stop, id); });
+    }
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+    for (auto& thread : mThreads)
+    {
+        thread.request_stop();
+    }
+
+    wake(true);
+
+    // joins
+    mThreads.clear();
+
+    tPool = mPreviousPool;
+    tWorker = mPreviousWorker;
+}
+
+WorkStealingPool& WorkStealingPool::getInstance()
+{
+    static WorkStealingPool instance(defaultNumThreads());
+    return instance;
+}
+
+size_t WorkStealingPool::defaultNumThreads()
+{
+    // only the first entry of a nested list ("8,4") applies to the outermost level
+    if (const char* value = std::getenv("OMP_NUM_THREADS"))
+    {
+        try
+        {
+            long threads = std::stol(value);
+            if (threads > 0) return static_cast<size_t>(threads);
+        }
+        catch (const std::exception&)
+        {
+        }
+    }
+
+    return std::max<size_t>(std::thread::hardware_concurrency(), 1);
+}
+
+size_t WorkStealingPool::workerId() const
+{
+    return tPool == this ? tWorker : NOT_A_WORKER;
+}
+
+void WorkStealingPool::submit(Task* task)
+{
+    const size_t id = workerId();
+
+    if (id == NOT_A_WORKER || !mDeques[id]->push(task))
+    {
+        execute(task);
+        return;
+    }
+
+    wake(false);
+}
+
+bool WorkStealingPool::runOne()
+{
+    const size_t id = workerId();
+    if (id == NOT_A_WORKER) return false;
+
+    Task* task = mDeques[id]->pop();
+    if (task == nullptr) task = steal(id);
+    if (task == nullptr) return false;
+
+    execute(task);
+
+    return true;
+}
+
+void WorkStealingPool::wait(const std::atomic<size_t>& pending)
+{
+    while (pending.load(std::memory_order_acquire) != 0)
+    {
+        if (!runOne())
+        {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void WorkStealingPool::broadcast(const std::function<void(size_t)>& function)
+{
+    if (workerId() != 0)
+    {
+        throw std::runtime_error("thread pool broadcast started by a thread other than worker 0");
+    }
+
+    mBroadcast = &function;
+    mBroadcastRemaining.store(size() - 1, std::memory_order_relaxed);
+    mBroadcastEpoch.fetch_add(1, std::memory_order_release);
+    wake(true);
+
+    function(0);
+
+    while (mBroadcastRemaining.load(std::memory_order_acquire) != 0)
+    {
+        std::this_thread::yield();
+    }
+
+    mBroadcast = nullptr;
+}
+
+void WorkStealingPool::workerLoop(std::stop_token stop, size_t id)
+{
+    tPool = this;
+    tWorker = id;
+
+    // broadcasts started before this thread got here are still run
+    uint64_t seenBroadcast = 0;
+
+    while (!stop.stop_requested())
+    {
+        const uint64_t epoch = mBroadcastEpoch.load(std::memory_order_acquire);
+        if (epoch != seenBroadcast)
+        {
+            seenBroadcast = epoch;
+            (*mBroadcast)(id);
+            mBroadcastRemaining.fetch_sub(1, std::memory_order_release);
+            continue;
+        }
+
+        if (runOne()) continue;
+
+        bool found = false;
+        for (int round = 0; round < SPIN_ROUNDS && !found; ++round)
+        {
+            std::this_thread::yield();
+            found = hasWork(seenBroadcast);
+        }
+
+        if (found) continue;
+
+        // announce the sleeper before the last look so a submit either sees it and
+        // signals or happened before the look and is found by it
+        const uint32_t signal = mSignal.load(std::memory_order_acquire);
+        mSleepers.fetch_add(1, std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if (!hasWork(seenBroadcast) && !stop.stop_requested())
+        {
+            mSignal.wait(signal, std::memory_order_acquire);
+        }
+
+        mSleepers.fetch_sub(1, std::memory_order_relaxed);
+    }
+}
+
+WorkStealingPool::Task* WorkStealingPool::steal(size_t thief)
+{
+    const size_t numWorkers = size();
+    const size_t start = nextVictim();
+
+    for (size_t i = 0; i < numWorkers; ++i)
+    {
+        const size_t victim = (start + i) % numWorkers;
+        if (victim == thief) continue;
+
+        if (Task* task = mDeques[victim]->steal())
+        {
+            return task;
+        }
+    }
+
+    return nullptr;
+}
+
+void WorkStealingPool::execute(Task* task)
+{
+    std::atomic<size_t>* pending = task->pending;
+
+    task->run();
+    delete task;
+
+    if (pending)
+    {
+        pending->fetch_sub(1, std::memory_order_release);
+    }
+}
+
+bool WorkStealingPool::hasWork(uint64_t seenBroadcast) const
+{
+    if (mBroadcastEpoch.load(std::memory_order_acquire) != seenBroadcast) return true;
+
+    for (const auto& deque : mDeques)
+    {
+        if (!deque->empty()) return true;
+    }
+
+    return false;
+}
+
+void WorkStealingPool::wake(bool all)
+{
+    // pairs with the fence of a worker going to sleep
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    if (mSleepers.load(std::memory_order_relaxed) == 0) return;
+
+    mSignal.fetch_add(1, std::memory_order_release);
+
+    if (all)
+    {
+        mSignal.notify_all();
+    }
+    else
+    {
+        mSignal.notify_one();
+    }
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "work_stealing_deque.h"
+
+// fixed set of std::jthread workers with one chase-lev deque each, the thread that creates
+// the pool is worker 0 and only runs tasks while it waits for them, spawned tasks go to the
+// bottom of the spawning worker's deque (newest first for the owner, depth first like the
+// serial recursion) and idle workers steal from the top of a random victim (oldest first,
+// which is the biggest piece of work of a recursive split)
+//
+// workers that found nothing to run for a while sleep on an atomic until new tasks are
+// submitted, so an idle pool does not compete with the host for cores
+class WorkStealingPool
+{
+public:
+    // a spawned closure, deleted by the thread that runs it
+    struct Task
+    {
+        virtual ~Task() = default;
+        virtual void run() = 0;
+
+        std::atomic<size_t>* pending = nullptr;     // decremented once the task is done
+    };
+
+    template <class F>
+    struct Closure : Task
+    {
+        explicit Closure(F function) : function(std::move(function)) {}
+
+        void run() override
+        {
+            function();
+        }
+
+        F function;
+    };
+
+    static constexpr size_t NOT_A_WORKER = SIZE_MAX;
+
+    // numThreads includes the calling thread, tasks queued past dequeCapacity run inline
+    explicit WorkStealingPool(size_t numThreads, size_t dequeCapacity = DEFAULT_DEQUE_CAPACITY);
+
+    ~WorkStealingPool();
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    // pool of the native threading backend, created by the first call with OMP_NUM_THREADS
+    // threads (hardware concurrency if unset) so job scripts work for both backends
+    static WorkStealingPool& getInstance();
+
+    static size_t defaultNumThreads();
+
+    inline size_t size() const
+    {
+        return mDeques.size();
+    }
+
+    // index of the calling thread in this pool, NOT_A_WORKER for threads the pool does not own
+    size_t workerId() const;
+
+    // takes ownership, a thread that is not a worker (or whose deque is full) runs it right away
+    void submit(Task* task);
+
+    // runs one queued task, the caller's own deque first then a steal, false if there was none
+    bool runOne();
+
+    // returns once pending is 0, runs queued tasks (not necessarily its own) while waiting
+    void wait(const std::atomic<size_t>& pending);
+
+    // function(workerId) once on every worker, returns when all are done, only for worker 0
+    // while no tasks are running (per thread setup like perf counters)
+    void broadcast(const std::function<void(size_t)>& function);
+
+private:
+    static constexpr size_t DEFAULT_DEQUE_CAPACITY = 4096;
+
+    // yields before a worker goes to sleep, tasks tend to come in bursts
+    static constexpr int SPIN_ROUNDS = 64;
+
+    void workerLoop(std::stop_token stop, size_t id);
+
+    Task* steal(size_t thief);
+
+    void execute(Task* task);
+
+    // a worker has something to do, a queued task or a broadcast it did not run yet
+    bool hasWork(uint64_t seenBroadcast) const;
+
+    void wake(bool all);
+
+    std::vector<std::unique_ptr<WorkStealingDeque<Task*>>> mDeques;    // [worker]
+
+    // sleeping workers wait for mSignal to change
+    alignas(64) std::atomic<uint32_t> mSignal{0};
+    alignas(64) std::atomic<size_t> mSleepers{0};
+
+    const std::function<void(size_t)>* mBroadcast = nullptr;
+    std::atomic<uint64_t> mBroadcastEpoch{0};
+    std::atomic<size_t> mBroadcastRemaining{0};
+
+    // the pool (and its worker index) the creating thread belonged to before this one
+    WorkStealingPool* mPreviousPool;
+    size_t mPreviousWorker;
+
+    std::vector<std::jthread> mThreads;     // last so the workers start on a complete pool
+};
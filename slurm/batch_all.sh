@@ -8,3 +8,7 @@ sbatch benchmark_scaling_p1.sh
 sbatch benchmark_scaling_p9.sh
 sbatch benchmark_scaling_p18.sh
 sbatch benchmark_scaling_p36.sh
+sbatch benchmark_structured_p36.sh
+sbatch benchmark_persistent_p36.sh
+sbatch benchmark_threading.sh
+sbatch benchmark_numa.sh
@@ -0,0 +1,33 @@
+#!/bin/bash
+# (See https://arc-ts.umich.edu/greatlakes/user-guide/ for command details)
+
+# Set up batch job settings
+#SBATCH --job-name=cse587_semester_project
+#SBATCH --cpus-per-task=36
+#SBATCH --exclusive
+#SBATCH --time=01:00:00
+#SBATCH --account=cse587f25s001_class
+#SBATCH --partition=standard
+
+# the 18 to 36 thread step is where the second socket joins, every placement is run with
+# both counts (18 threads close stay on one socket, spread use both), -tuning none keeps
+# the settings the same for every run
+./../install/bin/tools/particle_file_generator -box -500 -500 -500 500 500 500 -mass 10 100 -vel 10 40 -acc 0 5 -n 1000000 -f particle_numa.txt -seed 587
+
+for threads in 18 36
+do
+    export OMP_NUM_THREADS=${threads}
+
+    # perform tests (do 10 iterations of the simulation)
+    for affinity in none close spread
+    do
+        ./../install/bin/b_hut -t 0.01 -l 0.1 -in particle_numa.txt -out numa_${affinity}_p${threads} -p -tuning none -affinity ${affinity} > numa_${affinity}_p${threads}.log
+        rm numa_${affinity}_p${threads}.abc
+    done
+
+    ./../install/bin/b_hut -t 0.01 -l 0.1 -in particle_numa.txt -out numa_replicate_p${threads} -p -tuning none -affinity spread -replicate 4 > numa_replicate_p${threads}.log
+    rm numa_replicate_p${threads}.abc
+done
+
+# cleanup
+rm particle_numa.txt
@@ -5,12 +5,20 @@
 #SBATCH --job-name=cse587_semester_project
 #SBATCH --cpus-per-task=36
 #SBATCH --exclusive
-#SBATCH --time=00:15:00
+#SBATCH --time=01:00:00
 #SBATCH --account=cse587f25s001_class
 #SBATCH --partition=standard
 
-export OMP_NUM_THREADS=2  && ./../install/bin/benchmark_octree > results_p2.txt
-export OMP_NUM_THREADS=4  && ./../install/bin/benchmark_octree > results_p4.txt
-export OMP_NUM_THREADS=9  && ./../install/bin/benchmark_octree > results_p9.txt
-export OMP_NUM_THREADS=18 && ./../install/bin/benchmark_octree > results_p18.txt
-export OMP_NUM_THREADS=36 && ./../install/bin/benchmark_octree > results_p36.txt
+# every run adds its thread count's row to octree_calibration.txt for b_hut -build auto
+export OMP_NUM_THREADS=2  && ./../install/bin/benchmark_octree uniform octree_calibration.txt > results_p2.txt
+export OMP_NUM_THREADS=4  && ./../install/bin/benchmark_octree uniform octree_calibration.txt > results_p4.txt
+export OMP_NUM_THREADS=9  && ./../install/bin/benchmark_octree uniform octree_calibration.txt > results_p9.txt
+export OMP_NUM_THREADS=18 && ./../install/bin/benchmark_octree uniform octree_calibration.txt > results_p18.txt
+export OMP_NUM_THREADS=36 && ./../install/bin/benchmark_octree uniform octree_calibration.txt > results_p36.txt
+
+# clustered workloads build much deeper trees than the uniform box
+for workload in plummer hernquist disk pair clustered
+do
+    export OMP_NUM_THREADS=9  && ./../install/bin/benchmark_octree ${workload} > results_${workload}_p9.txt
+    export OMP_NUM_THREADS=36 && ./../install/bin/benchmark_octree ${workload} > results_${workload}_p36.txt
+done
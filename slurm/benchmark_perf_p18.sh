@@ -10,10 +10,10 @@
 #SBATCH --partition=standard
 
 # generate particle files for this run
-./../install/bin/tools/particle_file_generator -box -500 -500 -500 500 500 500 -mass 10 100 -vel 10 40 -acc 0 5 -n 10000 -f particle_ten_thousand_p18.txt
-./../install/bin/tools/particle_file_generator -box -500 -500 -500 500 500 500 -mass 10 100 -vel 10 40 -acc 0 5 -n 100000 -f particle_hundred_thousand_p18.txt
-./../install/bin/tools/particle_file_generator -box -500 -500 -500 500 500 500 -mass 10 100 -vel 10 40 -acc 0 5 -n 500000 -f particle_five_hundred_thousand_p18.txt
-./../install/bin/tools/particle_file_generator -box -500 -500 -500 500 500 500 -mass 10 100 -vel 10 40 -acc 0 5 -n 1000000 -f particle_million_p18.txt
+./../install/bin/tools/particle_file_generator -box -500 -500 -500 500 500 500 -mass 10 100 -vel 10 40 -acc 0 5 -n 10000 -f particle_ten_thousand_p18.txt -seed 587
+./../install/bin/tools/particle_file_generator -box -500 -500 -500 500 500 500 -mass 10 100 -vel 10 40 -acc 0 5 -n 100000 -f particle_hundred_thousand_p18.txt -seed 587
+./../install/bin/tools/particle_file_generator -box -500 -500 -500 500 500 500 -mass 10 100 -vel 10 40 -acc 0 5 -n 500000 -f particle_five_hundred_thousand_p18.txt -seed 587
+./../install/bin/tools/particle_file_generator -box -500 -500 -500 500 500 500 -mass 10 100 -vel 10 40 -acc 0 5 -n 1000000 -f particle_million_p18.txt -seed 587
 
 export OMP_NUM_THREADS=18
 
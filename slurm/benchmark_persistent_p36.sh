@@ -0,0 +1,28 @@
+#!/bin/bash
+# (See https://arc-ts.umich.edu/greatlakes/user-guide/ for command details)
+
+# Set up batch job settings
+#SBATCH --job-name=cse587_semester_project
+#SBATCH --cpus-per-task=36
+#SBATCH --exclusive
+#SBATCH --time=00:15:00
+#SBATCH --account=cse587f25s001_class
+#SBATCH --partition=standard
+
+export OMP_NUM_THREADS=36
+
+# small particle counts where fork/join and barriers are a noticeable part of a step,
+# every run once with a parallel region per phase and once with -persistent
+for n in 10000 100000
+do
+    ./../install/bin/tools/particle_file_generator -box -500 -500 -500 500 500 500 -mass 10 100 -vel 10 40 -acc 0 5 -n ${n} -f particle_${n}_p36.txt -seed 587
+
+    # perform tests (do 100 iterations of the simulation)
+    ./../install/bin/b_hut -t 0.01 -l 1 -in particle_${n}_p36.txt -out phases_${n}_p36 -p
+    ./../install/bin/b_hut -t 0.01 -l 1 -in particle_${n}_p36.txt -out persistent_${n}_p36 -p -persistent
+
+    # cleanup
+    rm particle_${n}_p36.txt
+    rm phases_${n}_p36.abc
+    rm persistent_${n}_p36.abc
+done
@@ -0,0 +1,25 @@
+#!/bin/bash
+# (See https://arc-ts.umich.edu/greatlakes/user-guide/ for command details)
+
+# Set up batch job settings
+#SBATCH --job-name=cse587_semester_project
+#SBATCH --cpus-per-task=36
+#SBATCH --exclusive
+#SBATCH --time=00:30:00
+#SBATCH --account=cse587f25s001_class
+#SBATCH --partition=standard
+
+export OMP_NUM_THREADS=36
+
+# same particle count and simulation as benchmark_scaling_p36.sh on structured initial conditions
+for model in plummer hernquist disk pair clustered
+do
+    ./../install/bin/tools/particle_file_generator -model ${model} -total_mass 1e9 -radius 100 -n 1000000 -f particle_million_${model}_p36.txt -seed 587 -binary
+
+    # perform tests (do 10 iterations of the simulation)
+    ./../install/bin/b_hut -t 0.1 -l 1 -in particle_million_${model}_p36.txt -out million_${model}_p36 -p
+
+    # cleanup
+    rm particle_million_${model}_p36.txt
+    rm million_${model}_p36.abc
+done
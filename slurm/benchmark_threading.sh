@@ -0,0 +1,32 @@
+#!/bin/bash
+# (See https://arc-ts.umich.edu/greatlakes/user-guide/ for command details)
+
+# Set up batch job settings
+#SBATCH --job-name=cse587_semester_project
+#SBATCH --cpus-per-task=36
+#SBATCH --exclusive
+#SBATCH --time=01:00:00
+#SBATCH --account=cse587f25s001_class
+#SBATCH --partition=standard
+
+# install/ is the default openmp build, install_native/ a second build configured with
+# -DTHREADING_BACKEND=native -DCMAKE_INSTALL_PREFIX=install_native
+for backend in openmp native
+do
+    install=./../install
+    if [ "${backend}" == "native" ]; then
+        install=./../install_native
+    fi
+
+    if [ ! -x ${install}/bin/benchmark_threading ]; then
+        echo "no ${backend} build in ${install}, skipping"
+        continue
+    fi
+
+    for threads in 2 9 18 36
+    do
+        export OMP_NUM_THREADS=${threads} && ${install}/bin/benchmark_threading > threading_${backend}_p${threads}.txt
+    done
+
+    export OMP_NUM_THREADS=36 && ${install}/bin/benchmark_threading plummer > threading_${backend}_plummer_p36.txt
+done
@@ -0,0 +1,22 @@
+#!/bin/bash
+# (See https://arc-ts.umich.edu/greatlakes/user-guide/ for command details)
+
+# Set up batch job settings
+#SBATCH --job-name=cse587_semester_project
+#SBATCH --cpus-per-task=36
+#SBATCH --exclusive
+#SBATCH --time=00:30:00
+#SBATCH --account=cse587f25s001_class
+#SBATCH --partition=standard
+
+# every node of the partition is the same machine, so one tuning file serves all of them
+# (pass -tuning b_hut_tuning_standard.txt to the runs), each thread count adds its own row
+./../install/bin/tools/particle_file_generator -box -500 -500 -500 500 500 500 -mass 10 100 -vel 10 40 -acc 0 5 -n 1000000 -f particle_tune.txt -seed 587
+
+for threads in 9 18 36
+do
+    export OMP_NUM_THREADS=${threads} && ./../install/bin/b_hut -tune -in particle_tune.txt -tuning b_hut_tuning_standard.txt > tune_p${threads}.txt
+done
+
+# cleanup
+rm particle_tune.txt
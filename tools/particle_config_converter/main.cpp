@@ -0,0 +1,102 @@
+#include <iostream>
+#include <chrono>
+
+#include "particle_config.hpp"
+
+struct UserInput
+{
+    std::string inFile;
+    std::string outFile;
+    ParticleConfig::Format format;
+};
+
+bool parseArgs(int argc, char** argv, UserInput &out)
+{
+    int argsParsed = 0;
+
+    for (int i=1; i<argc; ++i)
+    {
+        std::string a = argv[i];
+
+        auto need = [&](int k){ return (i+k) < argc; };
+
+        if (a=="-in")
+        {
+            if (!need(1)) return false;
+
+            out.inFile = argv[i+1];
+            i+=1;
+            ++argsParsed;
+        }
+        else if (a=="-out")
+        {
+            if (!need(1)) return false;
+
+            out.outFile = argv[i+1];
+            i+=1;
+            ++argsParsed;
+        }
+        else if (a=="-to")
+        {
+            if (!need(1)) return false;
+
+            std::string format = argv[i+1];
+            if (format == "text")
+            {
+                out.format = ParticleConfig::Format::Text;
+            }
+            else if (format == "binary")
+            {
+                out.format = ParticleConfig::Format::Binary;
+            }
+            else
+            {
+                return false;
+            }
+            i+=1;
+            ++argsParsed;
+        }
+        else
+        {
+            return false;
+        }
+    }
+
+    return argsParsed == 3;
+}
+
+int main(int argc, char* argv[])
+{
+    UserInput input;
+    bool success = parseArgs(argc, argv, input);
+
+    if (success)
+    {
+        try
+        {
+            auto start = std::chrono::steady_clock::now();
+            auto particles = ParticleConfig::parse(input.inFile);
+            std::chrono::duration<double, std::milli> parseMs = std::chrono::steady_clock::now() - start;
+
+            start = std::chrono::steady_clock::now();
+            ParticleConfig::write(particles, input.outFile, input.format);
+            std::chrono::duration<double, std::milli> writeMs = std::chrono::steady_clock::now() - start;
+
+            std::cout << "converted " << particles.size() << " particles (parse " << parseMs.count()
+                      << " ms, write " << writeMs.count() << " ms)" << std::endl;
+        }
+        catch(const std::exception& e)
+        {
+            std::cerr << e.what() << '\n';
+        }
+    }
+    else
+    {
+        std::cout << "Usage: ./particle_config_converter -in in_file -out out_file -to format" << std::endl;
+        std::cout << "in_file - particle config file to convert (text or binary, detected automatically)" << std::endl;
+        std::cout << "out_file - output file name" << std::endl;
+        std::cout << "format - text or binary" << std::endl;
+    }
+
+    return 0;
+}
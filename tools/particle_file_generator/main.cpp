@@ -7,11 +7,16 @@ struct UserInput
     ParticleConfig::Limits limits;
     size_t numParticles;
     std::string outFile;
+    uint64_t seed = ParticleConfig::randomSeed();
+    ParticleConfig::Format format = ParticleConfig::Format::Text;
+    bool useModel = false;
+    ParticleConfig::Model model;
 };
 
 bool parseArgs(int argc, char** argv, UserInput &out)
 {
     int argsParsed = 0;
+    int limitsParsed = 0;
 
     for (int i=1; i<argc; ++i)
     {
@@ -27,7 +32,7 @@ bool parseArgs(int argc, char** argv, UserInput &out)
             out.limits.boundingBox[0] = { d(1), d(2), d(3) };
             out.limits.boundingBox[1] = { d(4), d(5), d(6) };
             i+=6;
-            ++argsParsed;
+            ++limitsParsed;
         }
         else if (a=="-mass")
         {
@@ -35,7 +40,7 @@ bool parseArgs(int argc, char** argv, UserInput &out)
         
             out.limits.massLimits = { d(1), d(2) };
             i+=2;
-            ++argsParsed;
+            ++limitsParsed;
         }
         else if (a=="-vel")
         {
@@ -43,7 +48,7 @@ bool parseArgs(int argc, char** argv, UserInput &out)
         
             out.limits.velocityLimits = { d(1), d(2) };
             i+=2;
-            ++argsParsed;
+            ++limitsParsed;
         }
         else if (a=="-acc") 
         {
@@ -51,7 +56,7 @@ bool parseArgs(int argc, char** argv, UserInput &out)
          
             out.limits.accelerationLimits = { d(1), d(2) };
             i+=2;
-            ++argsParsed;
+            ++limitsParsed;
         }
         else if (a=="-n")
         {
@@ -69,13 +74,61 @@ bool parseArgs(int argc, char** argv, UserInput &out)
             i+=1;
             ++argsParsed;
         }
+        else if (a=="-binary")
+        {
+            out.format = ParticleConfig::Format::Binary;
+        }
+        else if (a=="-model")
+        {
+            if (!need(1)) return false;
+
+            try
+            {
+                out.model.distribution = ParticleConfig::distributionFromString(argv[i+1]);
+            }
+            catch (const std::exception&)
+            {
+                return false;
+            }
+            out.useModel = true;
+            i+=1;
+        }
+        else if (a=="-total_mass")
+        {
+            if (!need(1)) return false;
+
+            out.model.totalMass = d(1);
+            i+=1;
+        }
+        else if (a=="-radius")
+        {
+            if (!need(1)) return false;
+
+            out.model.scaleRadius = d(1);
+            i+=1;
+        }
+        else if (a=="-center")
+        {
+            if (!need(3)) return false;
+
+            out.model.center = { d(1), d(2), d(3) };
+            i+=3;
+        }
+        else if (a=="-seed")
+        {
+            if (!need(1)) return false;
+
+            out.seed = std::strtoull(argv[i+1], nullptr, 10);
+            i+=1;
+        }
         else 
         {
             return false;
         }
     }
 
-    return argsParsed == 6;
+    // a model replaces the uniform box limits
+    return argsParsed == 2 && limitsParsed == (out.useModel ? 0 : 4);
 }
 
 int main(int argc, char* argv[])
@@ -87,7 +140,16 @@ int main(int argc, char* argv[])
     {
         try
         {
-            ParticleConfig::generate(input.numParticles, input.limits, input.outFile);
+            if (input.useModel)
+            {
+                ParticleConfig::generate(input.numParticles, input.model, input.outFile, input.seed, input.format);
+            }
+            else
+            {
+                ParticleConfig::generate(input.numParticles, input.limits, input.outFile, input.seed, input.format);
+            }
+
+            std::cout << "generated " << input.numParticles << " particles with seed " << input.seed << std::endl;
         }
         catch(const std::exception& e)
         {
@@ -96,13 +158,20 @@ int main(int argc, char* argv[])
     }
     else
     {
-        std::cout << "Usage: ./particle_config_generator -box A B C D E F -mass H I -vel J K -acc L M -n N -f file_name" << std::endl;
+        std::cout << "Usage: ./particle_config_generator -box A B C D E F -mass H I -vel J K -acc L M -n N -f file_name -seed S -binary" << std::endl;
+        std::cout << "       ./particle_config_generator -model MODEL -total_mass T -radius R -center X Y Z -n N -f file_name -seed S -binary" << std::endl;
         std::cout << "A,B,C - lower limits of bounding box" << std::endl;
         std::cout << "D,E,F - upper limits of bounding box" << std::endl;
         std::cout << "H,I - mass limits for particles" << std::endl;
         std::cout << "J,K - velocity limits for particles" << std::endl;
         std::cout << "L,M - acceleration limits for particles" << std::endl;
         std::cout << "file_name - output file name" << std::endl;
+        std::cout << "S - optional seed, the same seed always generates the same particles (random if omitted)" << std::endl;
+        std::cout << "MODEL - plummer, hernquist, disk, pair or clustered, replaces -box/-mass/-vel/-acc" << std::endl;
+        std::cout << "T - optional total mass of the model in kg (default 1e9)" << std::endl;
+        std::cout << "R - optional scale radius of the model in m (default 100)" << std::endl;
+        std::cout << "X,Y,Z - optional center of the model (default origin)" << std::endl;
+        std::cout << "-binary - optional, write the binary particle config format instead of text" << std::endl;
     }
 
     return 0;
@@ -0,0 +1,60 @@
+import os
+import csv
+import argparse
+import matplotlib.pyplot as plt
+
+def parse_file(path):
+    # simulationName.profile.csv: iteration,region,ms
+    data = {}
+    with open(path) as f:
+        for row in csv.DictReader(f):
+            iterations, times = data.setdefault(row["region"], ([], []))
+            iterations.append(int(row["iteration"]))
+            times.append(float(row["ms"]))
+    return data
+
+def percentile(values, p):
+    # nearest rank, same as the profiler's p99
+    ordered = sorted(values)
+    rank = max(1, -(-len(ordered) * p // 100))
+    return ordered[int(rank) - 1]
+
+def main():
+    parser = argparse.ArgumentParser(description="plot per iteration timings.")
+    parser.add_argument("--input", help="simulationName.profile.csv file written with -p")
+    parser.add_argument("--output", help="directory to save output plots")
+    parser.add_argument("--regions", help="comma separated regions to plot (default: all)")
+    args = parser.parse_args()
+
+    os.makedirs(args.output, exist_ok=True)
+
+    data = parse_file(args.input)
+    regions = args.regions.split(",") if args.regions else list(data.keys())
+
+    for region in regions:
+        if region not in data:
+            print(f"no samples for region: {region}")
+            continue
+
+        iterations, times = data[region]
+        median = percentile(times, 50)
+        p99 = percentile(times, 99)
+
+        plt.figure(figsize=(10, 6))
+        plt.plot(iterations, times, marker=".", linewidth=0.8)
+        plt.axhline(median, color="green", linestyle="--", label=f"median = {median:.3f}")
+        plt.axhline(p99, color="red", linestyle="--", label=f"p99 = {p99:.3f}")
+
+        plt.xlabel("Iteration")
+        plt.ylabel("Time (ms)")
+        plt.title(f"{region} per iteration")
+        plt.legend()
+        plt.grid(True)
+        plt.tight_layout()
+
+        safeRegion = region.replace(" > ", "__").replace(" ", "_").replace("/", "_")
+        plt.savefig(os.path.join(args.output, f"{safeRegion}.png"))
+        plt.close()
+
+if __name__ == "__main__":
+    main()
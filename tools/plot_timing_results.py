@@ -3,6 +3,7 @@ import re
 import argparse
 import matplotlib.pyplot as plt
 import math
+import json
 
 def parse_filename(filename):
     particleMap = {
@@ -12,7 +13,7 @@ def parse_filename(filename):
         "million": 1_000_000
     }
 
-    m = re.match(r"(.+)_p(\d+)\.txt", filename)
+    m = re.match(r"(.+)_p(\d+)\.(?:txt|profile\.json)$", filename)
     if not m:
         return None
 
@@ -45,6 +46,28 @@ def parse_file(path):
                 data[name.strip()] = float(value.strip())
     return data
 
+def parse_json_file(path, statistic):
+    # simulationName.profile.json, regions are keyed by name like the .txt layout
+    data = {}
+
+    def visit(region):
+        if region["per_iteration"]:
+            data[region["name"]] = region[statistic]
+        for child in region["children"]:
+            visit(child)
+
+    with open(path) as f:
+        profile = json.load(f)
+
+    overall = 0.0
+    for region in profile["regions"]:
+        visit(region)
+        if region["per_iteration"]:
+            overall += region[statistic]
+
+    data["overall"] = overall
+    return data
+
 def determine_big_o_coeff(field, x, y):
     denom = 0.0
     if field == "octree creation" or field == "overall" or field == "applying forces calculation" or field == "insert points" or field == "generate leaf nodes" or field == "center of mass calculation":
@@ -59,13 +82,17 @@ def main():
     parser = argparse.ArgumentParser(description="plot profiling data.")
     parser.add_argument("--input", help="directory containing profiling .txt files")
     parser.add_argument("--output", help="directory to save output plots")
+    parser.add_argument("--statistic", default="mean", choices=["mean", "min", "median", "p99", "max"],
+                        help="per iteration statistic to plot, anything but mean reads the .profile.json files")
     args = parser.parse_args()
 
     os.makedirs(args.output, exist_ok=True)
 
+    useJson = args.statistic != "mean"
+
     records = []
     for fname in os.listdir(args.input):
-        if not fname.endswith(".txt"):
+        if not fname.endswith(".profile.json" if useJson else ".txt"):
             continue
 
         parsed = parse_filename(fname)
@@ -73,7 +100,8 @@ def main():
             continue
 
         particles, threads = parsed
-        timings = parse_file(os.path.join(args.input, fname))
+        path = os.path.join(args.input, fname)
+        timings = parse_json_file(path, args.statistic) if useJson else parse_file(path)
 
         records.append((particles, threads, timings))
 
@@ -134,7 +162,7 @@ def main():
                 coeffs += f"n={xi} coeff={c:.7f}\n"
 
             plt.xlabel("Particle Count")
-            plt.ylabel("Time (ms)")
+            plt.ylabel(f"Time (ms, {args.statistic})")
             plt.title(f"{field} vs Particle Count (Threads = {thread})")
             plt.grid(True)
             plt.xscale("log")
@@ -182,7 +210,7 @@ def main():
                 )
 
             plt.xlabel("Thread Count")
-            plt.ylabel("Time (ms)")
+            plt.ylabel(f"Time (ms, {args.statistic})")
             plt.title(f"{field} vs Thread Count (Particles = {particles}, Serial = {y[0]})")
             plt.grid(True)
             plt.tight_layout()
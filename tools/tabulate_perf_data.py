@@ -21,6 +21,10 @@ def parse_filename(filename):
     return None if particles is None else (particles, threads)
 
 
+# per section totals/metrics are "name: number" lines, per thread, profiler and sample lines are skipped
+SKIPPED_PREFIXES = ("thread ", "threads", "profiler ", "empty section", "counter read mode", "sample")
+
+
 def parse_file(path):
     data = {}
     currentSection = None
@@ -34,20 +38,37 @@ def parse_file(path):
                 data[currentSection] = {}
                 continue
 
-            if currentSection is None:
+            if currentSection is None or line.startswith(SKIPPED_PREFIXES):
                 continue
 
             if ":" in line:
-                name, value = line.split(":")
+                name, value = line.split(":", 1)
                 name = name.strip()
-                value = value.strip()
 
-                if name in ("cache-miss %", "cache-misses / instructions", "IPC"):
-                    data[currentSection][name] = float(value)
+                if "min / max / imbalance" in name:
+                    continue
+
+                try:
+                    data[currentSection][name] = float(value.strip())
+                except ValueError:
+                    continue
 
     return data
 
 
+def recorded_metrics(records):
+    # derived metrics (ratios) of whatever events were recorded, raw totals when there are none
+    names = []
+    for (_, _, perf) in records:
+        for section in perf.values():
+            for name in section:
+                if name not in names:
+                    names.append(name)
+
+    derived = [n for n in names if "/" in n or n in ("IPC", "cache-miss %")]
+    return derived if derived else names
+
+
 def particle_label(n):
     if n == 10_000:
         return "10k"
@@ -60,25 +81,30 @@ def particle_label(n):
     return str(n)
 
 
-def write_latex_table(path, rows, firstHeader, caption):
+def write_latex_table(path, rows, firstHeader, metrics, caption):
     with open(path, "w") as out:
         out.write("\\begin{table}[H]\n")
         out.write("\\centering\n")
-        out.write("\\begin{tabular}{c|c|c|c}\n")
-
-        out.write(
-            f"\\textbf{{{firstHeader}}} & "
-            f"\\textbf{{IPC}} & "
-            f"\\textbf{{cache-miss \\%}} & "
-            "\\begin{tabular}{c}\n"
-            "\\textbf{cache-misses} \\\\\n"
-            "\\textbf{/ instructions}\n"
-            "\\end{tabular} \\\\\n"
-        )
+        out.write("\\begin{tabular}{" + "|".join(["c"] * (len(metrics) + 1)) + "}\n")
+
+        headers = [f"\\textbf{{{firstHeader}}}"]
+        for metric in metrics:
+            if " / " in metric:
+                numerator, denominator = metric.split(" / ", 1)
+                headers.append(
+                    "\\begin{tabular}{c}\n"
+                    f"\\textbf{{{latex(numerator)}}} \\\\\n"
+                    f"\\textbf{{/ {latex(denominator)}}}\n"
+                    "\\end{tabular}"
+                )
+            else:
+                headers.append(f"\\textbf{{{latex(metric)}}}")
+
+        out.write(" & ".join(headers) + " \\\\\n")
 
         for r in rows:
             out.write("\\hline\n")
-            out.write(f"{r[0]} & {r[1]} & {r[2]} & {r[3]} \\\\\n")
+            out.write(" & ".join(str(v) for v in r) + " \\\\\n")
 
         out.write("\\hline\n")
         out.write("\\end{tabular}\n")
@@ -86,10 +112,15 @@ def write_latex_table(path, rows, firstHeader, caption):
         out.write("\\end{table}\n")
 
 
+def latex(text):
+    return text.replace("%", "\\%").replace("_", "\\_")
+
+
 def main():
     parser = argparse.ArgumentParser(description="plot perf data.")
     parser.add_argument("--input", help="directory containing .perf.txt files")
     parser.add_argument("--output", help="directory to save output tables")
+    parser.add_argument("--metrics", help="comma separated metrics to tabulate (default: all derived metrics that were recorded)")
     args = parser.parse_args()
 
     os.makedirs(args.output, exist_ok=True)
@@ -116,11 +147,7 @@ def main():
     particleValues = sorted(set(r[0] for r in records))
     threadValues = sorted(set(r[1] for r in records))
 
-    metrics = [
-        "IPC",
-        "cache-miss %",
-        "cache-misses / instructions"
-    ]
+    metrics = args.metrics.split(",") if args.metrics else recorded_metrics(records)
 
     # fix thread count and write tables
     for thread in threadValues:
@@ -141,17 +168,12 @@ def main():
             for (particles, _, perf) in subset:
                 sectionData = perf.get(section, {})
                 vals = [sectionData.get(m, 0.0) for m in metrics]
-                rows.append((
-                    particle_label(particles),
-                    f"{vals[0]:.6f}",
-                    f"{vals[1]:.6f}",
-                    f"{vals[2]:.6f}"
-                ))
+                rows.append([particle_label(particles)] + [f"{v:.6f}" for v in vals])
 
             caption = f"{section.replace('_', ' ')} metrics vs particle count (threads = {thread})"
             tablePath = os.path.join(threadDir, f"{section}.txt")
 
-            write_latex_table(tablePath, rows, "Particles", caption)
+            write_latex_table(tablePath, rows, "Particles", metrics, caption)
 
     # fix particle count and write tables
     for particles in particleValues:
@@ -172,17 +194,12 @@ def main():
             for (_, threads, perf) in subset:
                 sectionData = perf.get(section, {})
                 vals = [sectionData.get(m, 0.0) for m in metrics]
-                rows.append((
-                    threads,
-                    f"{vals[0]:.6f}",
-                    f"{vals[1]:.6f}",
-                    f"{vals[2]:.6f}"
-                ))
+                rows.append([threads] + [f"{v:.6f}" for v in vals])
 
             caption = f"{section.replace('_', ' ')} metrics vs thread count (particles = {particle_label(particles)})"
             tablePath = os.path.join(particleDir, f"{section}.txt")
 
-            write_latex_table(tablePath, rows, "Threads", caption)
+            write_latex_table(tablePath, rows, "Threads", metrics, caption)
 
 
 if __name__ == "__main__":